@@ -0,0 +1,323 @@
+///\file    BroadcastQueue.hpp
+///\brief   Thread-safe fan-out queue where every subscriber sees every item
+///\author  Raoul Wols
+///\date    October, 2026
+
+#pragma once
+
+#include <rwols/SafeQueue.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace rwols {
+
+/// A bounded thread-safe queue that delivers every item to every subscriber.
+/// Items are stored once, in one ring, and each subscriber reads them through
+/// its own cursor:
+/// \code
+///   rwols::BroadcastQueue<Event> q(1024);
+///   auto a = q.Subscribe();
+///   auto b = q.Subscribe();
+///   q.Push(event);
+///   const Event &seen = a.Pop(); // the same object b.Pop() returns
+///   a.TaskDone();
+/// \endcode
+/// A popped item stays valid until its subscriber calls TaskDone() for it. A
+/// slot is reclaimed once every subscriber is done with it, and Push() blocks
+/// while the slowest subscriber is a full ring behind. Join() waits until all
+/// subscribers are done with all items. A subscriber only sees items pushed
+/// after it subscribed; items pushed while nobody subscribes are dropped.
+template <class T> class BroadcastQueue final {
+public:
+  using value_type = T;
+  using size_type = std::size_t;
+  using const_reference = const value_type &;
+
+  class Subscriber;
+
+  struct TaskDoneGuard {
+    TaskDoneGuard(const TaskDoneGuard &) = delete;
+    TaskDoneGuard(TaskDoneGuard &&);
+    TaskDoneGuard &operator=(const TaskDoneGuard &) = delete;
+    TaskDoneGuard &operator=(TaskDoneGuard &&);
+    ~TaskDoneGuard() noexcept(false);
+
+  private:
+    Subscriber *mS = nullptr;
+    TaskDoneGuard(Subscriber *);
+    friend class Subscriber;
+  };
+
+  /// One reader of the queue. Unsubscribes on destruction, which also
+  /// releases the items it did not finish.
+  class Subscriber {
+  public:
+    Subscriber(const Subscriber &) = delete;
+    Subscriber(Subscriber &&);
+    Subscriber &operator=(const Subscriber &) = delete;
+    Subscriber &operator=(Subscriber &&);
+    ~Subscriber();
+
+    const_reference Pop();
+    std::pair<const_reference, TaskDoneGuard> PopWithGuard();
+    template <class Rep, class Period>
+    const_reference Pop(const std::chrono::duration<Rep, Period> &timeout);
+    template <class Rep, class Period>
+    std::pair<const_reference, TaskDoneGuard>
+    PopWithGuard(const std::chrono::duration<Rep, Period> &timeout);
+
+    /// Marks the oldest item popped by this subscriber as done.
+    void TaskDone();
+
+  private:
+    BroadcastQueue *mQ = nullptr;
+    std::uint64_t mCursor = 0;   // Next item to pop.
+    std::uint64_t mReleased = 0; // Every item before this one is done.
+
+    explicit Subscriber(BroadcastQueue *);
+    void Unsubscribe();
+    friend class BroadcastQueue;
+  };
+
+  explicit BroadcastQueue(size_type capacity);
+  BroadcastQueue(const BroadcastQueue &) = delete;
+  BroadcastQueue &operator=(const BroadcastQueue &) = delete;
+  ~BroadcastQueue();
+
+  Subscriber Subscribe();
+
+  void Push(const_reference item);
+  void Push(value_type &&item);
+  template <class... Args> void Emplace(Args &&... args);
+
+  void Join();
+
+  size_type capacity() const noexcept { return mCapacity; }
+
+private:
+  using UniqueLock = std::unique_lock<std::mutex>;
+  using LockGuard = std::lock_guard<std::mutex>;
+  using Slot = typename std::aligned_storage<sizeof(value_type),
+                                             alignof(value_type)>::type;
+
+  std::mutex mMutex;
+  std::condition_variable mNotEmpty, mNotFull, mAllTasksDone;
+  size_type mCapacity;
+  std::unique_ptr<Slot[]> mSlots;
+  // Monotonic positions: items in [mHead, mTail) are alive.
+  std::uint64_t mHead = 0, mTail = 0;
+  std::vector<Subscriber *> mSubscribers;
+
+  value_type &At(std::uint64_t position) {
+    return *reinterpret_cast<value_type *>(&mSlots[position % mCapacity]);
+  }
+  void Reclaim();
+  bool AllDone() const;
+};
+
+// Implementation follows.
+
+template <class T>
+BroadcastQueue<T>::TaskDoneGuard::TaskDoneGuard(TaskDoneGuard &&other)
+    : mS(other.mS) {
+  other.mS = nullptr;
+}
+
+template <class T>
+typename BroadcastQueue<T>::TaskDoneGuard &
+BroadcastQueue<T>::TaskDoneGuard::operator=(TaskDoneGuard &&other) {
+  mS = other.mS;
+  other.mS = nullptr;
+  return *this;
+}
+
+template <class T>
+BroadcastQueue<T>::TaskDoneGuard::TaskDoneGuard(Subscriber *s) : mS(s) {}
+
+template <class T>
+BroadcastQueue<T>::TaskDoneGuard::~TaskDoneGuard() noexcept(false) {
+  if (mS)
+    mS->TaskDone();
+}
+
+template <class T>
+BroadcastQueue<T>::Subscriber::Subscriber(BroadcastQueue *q) : mQ(q) {
+  LockGuard lock(q->mMutex);
+  mCursor = mReleased = q->mTail;
+  q->mSubscribers.push_back(this);
+}
+
+template <class T>
+BroadcastQueue<T>::Subscriber::Subscriber(Subscriber &&other)
+    : mQ(other.mQ) {
+  if (!mQ)
+    return;
+  LockGuard lock(mQ->mMutex);
+  mCursor = other.mCursor;
+  mReleased = other.mReleased;
+  std::replace(mQ->mSubscribers.begin(), mQ->mSubscribers.end(), &other,
+               this);
+  other.mQ = nullptr;
+}
+
+template <class T>
+typename BroadcastQueue<T>::Subscriber &BroadcastQueue<T>::Subscriber::
+operator=(Subscriber &&other) {
+  if (this == &other)
+    return *this;
+  Unsubscribe();
+  mQ = other.mQ;
+  if (mQ) {
+    LockGuard lock(mQ->mMutex);
+    mCursor = other.mCursor;
+    mReleased = other.mReleased;
+    std::replace(mQ->mSubscribers.begin(), mQ->mSubscribers.end(), &other,
+                 this);
+    other.mQ = nullptr;
+  }
+  return *this;
+}
+
+template <class T> BroadcastQueue<T>::Subscriber::~Subscriber() {
+  Unsubscribe();
+}
+
+template <class T> void BroadcastQueue<T>::Subscriber::Unsubscribe() {
+  if (!mQ)
+    return;
+  {
+    LockGuard lock(mQ->mMutex);
+    auto &subscribers = mQ->mSubscribers;
+    subscribers.erase(std::find(subscribers.begin(), subscribers.end(), this));
+    mQ->Reclaim();
+    if (mQ->AllDone())
+      mQ->mAllTasksDone.notify_all();
+  }
+  mQ = nullptr;
+}
+
+template <class T>
+typename BroadcastQueue<T>::const_reference
+BroadcastQueue<T>::Subscriber::Pop() {
+  assert(mQ && "Pop() on a moved-from Subscriber");
+  UniqueLock lock(mQ->mMutex);
+  mQ->mNotEmpty.wait(lock, [this]() { return mCursor != mQ->mTail; });
+  return mQ->At(mCursor++);
+}
+
+template <class T>
+std::pair<typename BroadcastQueue<T>::const_reference,
+          typename BroadcastQueue<T>::TaskDoneGuard>
+BroadcastQueue<T>::Subscriber::PopWithGuard() {
+  const_reference item = Pop();
+  return std::pair<const_reference, TaskDoneGuard>(item, TaskDoneGuard(this));
+}
+
+template <class T>
+template <class Rep, class Period>
+typename BroadcastQueue<T>::const_reference BroadcastQueue<T>::Subscriber::Pop(
+    const std::chrono::duration<Rep, Period> &timeout) {
+  assert(mQ && "Pop() on a moved-from Subscriber");
+  UniqueLock lock(mQ->mMutex);
+  if (mQ->mNotEmpty.wait_for(lock, timeout,
+                             [this]() { return mCursor != mQ->mTail; }))
+    return mQ->At(mCursor++);
+  throw TimeoutError();
+}
+
+template <class T>
+template <class Rep, class Period>
+std::pair<typename BroadcastQueue<T>::const_reference,
+          typename BroadcastQueue<T>::TaskDoneGuard>
+BroadcastQueue<T>::Subscriber::PopWithGuard(
+    const std::chrono::duration<Rep, Period> &timeout) {
+  const_reference item = Pop(timeout);
+  return std::pair<const_reference, TaskDoneGuard>(item, TaskDoneGuard(this));
+}
+
+template <class T> void BroadcastQueue<T>::Subscriber::TaskDone() {
+  assert(mQ && "TaskDone() on a moved-from Subscriber");
+  LockGuard lock(mQ->mMutex);
+  assert(mReleased < mCursor && "TaskDone() called too many times");
+  const bool wasSlowest = mReleased == mQ->mHead;
+  ++mReleased;
+  if (wasSlowest)
+    mQ->Reclaim();
+  if (mReleased == mQ->mTail && mQ->AllDone())
+    mQ->mAllTasksDone.notify_all();
+}
+
+template <class T>
+BroadcastQueue<T>::BroadcastQueue(size_type capacity)
+    : mCapacity(capacity), mSlots(new Slot[capacity]) {
+  if (capacity == 0)
+    throw std::invalid_argument("BroadcastQueue capacity must be positive");
+}
+
+template <class T> BroadcastQueue<T>::~BroadcastQueue() {
+  Join();
+  assert(mSubscribers.empty() && "Subscribers must not outlive their queue");
+  for (; mHead != mTail; ++mHead)
+    At(mHead).~value_type();
+}
+
+template <class T>
+typename BroadcastQueue<T>::Subscriber BroadcastQueue<T>::Subscribe() {
+  return Subscriber(this);
+}
+
+template <class T> void BroadcastQueue<T>::Reclaim() {
+  auto oldest = mTail;
+  for (const auto *subscriber : mSubscribers)
+    oldest = std::min(oldest, subscriber->mReleased);
+  if (oldest == mHead)
+    return;
+  for (; mHead != oldest; ++mHead)
+    At(mHead).~value_type();
+  mNotFull.notify_all();
+}
+
+template <class T> bool BroadcastQueue<T>::AllDone() const {
+  return std::all_of(
+      mSubscribers.begin(), mSubscribers.end(),
+      [this](const Subscriber *s) { return s->mReleased == mTail; });
+}
+
+template <class T>
+template <class... Args>
+void BroadcastQueue<T>::Emplace(Args &&... args) {
+  {
+    UniqueLock lock(mMutex);
+    mNotFull.wait(lock, [this]() { return mTail - mHead < mCapacity; });
+    new (&mSlots[mTail % mCapacity]) value_type(std::forward<Args>(args)...);
+    ++mTail;
+    if (mSubscribers.empty()) {
+      Reclaim();
+      return;
+    }
+  }
+  // Every subscriber wants this item.
+  mNotEmpty.notify_all();
+}
+
+template <class T> void BroadcastQueue<T>::Push(const_reference item) {
+  Emplace(item);
+}
+
+template <class T> void BroadcastQueue<T>::Push(value_type &&item) {
+  Emplace(std::move(item));
+}
+
+template <class T> void BroadcastQueue<T>::Join() {
+  UniqueLock lock(mMutex);
+  mAllTasksDone.wait(lock, [this]() { return AllDone(); });
+}
+
+} // namespace rwols
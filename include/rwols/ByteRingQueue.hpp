@@ -0,0 +1,361 @@
+///\file    ByteRingQueue.hpp
+///\brief   Thread-safe queue of variable-length byte records in one ring
+///\author  Raoul Wols
+///\date    October, 2026
+
+#pragma once
+
+#include <rwols/SafeQueue.hpp>
+
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+
+namespace rwols {
+
+/// A thread-safe queue of variable-length byte records that are stored
+/// back to back in one contiguous ring buffer. A record is written in place
+/// and read in place, so a message costs no allocation and no copy:
+/// \code
+///   rwols::ByteRingQueue q(1 << 20);
+///   auto writer = q.Reserve(size);
+///   std::memcpy(writer.data(), message, size);
+///   writer.Commit();
+///   // in a consumer:
+///   auto reader = q.Pop();
+///   Process(reader.data(), reader.size());
+/// \endcode
+/// Records come out in the order they were reserved. A Reader's bytes stay
+/// valid until it is released, which also marks the task done. Ring space is
+/// reclaimed up to the oldest record that is not released yet.
+class ByteRingQueue final {
+public:
+  using size_type = std::size_t;
+
+  /// Reserved bytes that only the producer can see until Commit(). A Writer
+  /// destroyed without committing gives up its record.
+  class Writer {
+  public:
+    Writer(const Writer &) = delete;
+    Writer(Writer &&);
+    Writer &operator=(const Writer &) = delete;
+    Writer &operator=(Writer &&);
+    ~Writer();
+
+    char *data() const noexcept { return mData; }
+    size_type size() const noexcept { return mSize; }
+
+    void Commit();
+
+  private:
+    ByteRingQueue *mQ = nullptr;
+    std::uint64_t mPosition = 0;
+    char *mData = nullptr;
+    size_type mSize = 0;
+
+    Writer(ByteRingQueue *, std::uint64_t, char *, size_type);
+    friend class ByteRingQueue;
+  };
+
+  /// View of a popped record. Release() or destruction hands its bytes back
+  /// to the ring and marks the task done.
+  class Reader {
+  public:
+    Reader(const Reader &) = delete;
+    Reader(Reader &&);
+    Reader &operator=(const Reader &) = delete;
+    Reader &operator=(Reader &&);
+    ~Reader();
+
+    const char *data() const noexcept { return mData; }
+    size_type size() const noexcept { return mSize; }
+
+    void Release();
+
+  private:
+    ByteRingQueue *mQ = nullptr;
+    std::uint64_t mPosition = 0;
+    const char *mData = nullptr;
+    size_type mSize = 0;
+
+    Reader(ByteRingQueue *, std::uint64_t, const char *, size_type);
+    friend class ByteRingQueue;
+  };
+
+  /// capacity is rounded up to a multiple of 8 bytes. Every record takes an
+  /// 8-byte header plus its size rounded up to 8 bytes.
+  explicit ByteRingQueue(size_type capacity);
+  ~ByteRingQueue();
+
+  /// Blocks until `size` contiguous bytes are free. Throws std::length_error
+  /// if the record can never fit.
+  Writer Reserve(size_type size);
+  template <class Rep, class Period>
+  Writer Reserve(size_type size,
+                 const std::chrono::duration<Rep, Period> &timeout);
+
+  Reader Pop();
+  template <class Rep, class Period>
+  Reader Pop(const std::chrono::duration<Rep, Period> &timeout);
+
+  void Join();
+
+  size_type capacity() const noexcept { return mCapacity; }
+
+private:
+  using UniqueLock = std::unique_lock<std::mutex>;
+  using LockGuard = std::lock_guard<std::mutex>;
+
+  enum class State : std::uint32_t {
+    Reserved,
+    Committed,
+    Popped,
+    Released,
+    Skip // Padding at the end of the ring, or an abandoned reservation.
+  };
+
+  struct RecordHeader {
+    std::uint32_t size;
+    State state;
+  };
+
+  std::mutex mMutex;
+  std::condition_variable mNotEmpty, mNotFull, mAllTasksDone;
+  size_type mCapacity;
+  std::unique_ptr<std::uint64_t[]> mRing;
+  // Monotonic byte positions: reclaimed up to mHead, popped up to mRead,
+  // reserved up to mTail.
+  std::uint64_t mHead = 0, mRead = 0, mTail = 0;
+  std::size_t mUnfinishedTasks = 0;
+
+  static size_type Padded(size_type size) { return (size + 7) & ~size_type(7); }
+  size_type RecordBytes(size_type size) const;
+  RecordHeader &HeaderAt(std::uint64_t position);
+  char *PayloadAt(std::uint64_t position);
+  bool CanReserve(size_type bytes);
+  Writer DoReserve(size_type size);
+  bool CanPop();
+  Reader DoPop();
+  void Reclaim();
+  void Finish(std::uint64_t position, State state);
+};
+
+// Implementation follows.
+
+inline ByteRingQueue::Writer::Writer(ByteRingQueue *q, std::uint64_t position,
+                                     char *data, size_type size)
+    : mQ(q), mPosition(position), mData(data), mSize(size) {}
+
+inline ByteRingQueue::Writer::Writer(Writer &&other)
+    : mQ(other.mQ), mPosition(other.mPosition), mData(other.mData),
+      mSize(other.mSize) {
+  other.mQ = nullptr;
+}
+
+inline ByteRingQueue::Writer &ByteRingQueue::Writer::
+operator=(Writer &&other) {
+  if (this != &other) {
+    if (mQ)
+      mQ->Finish(mPosition, State::Skip);
+    mQ = other.mQ;
+    mPosition = other.mPosition;
+    mData = other.mData;
+    mSize = other.mSize;
+    other.mQ = nullptr;
+  }
+  return *this;
+}
+
+inline ByteRingQueue::Writer::~Writer() {
+  if (mQ)
+    mQ->Finish(mPosition, State::Skip);
+}
+
+inline void ByteRingQueue::Writer::Commit() {
+  assert(mQ && "Commit() on a moved-from or committed Writer");
+  mQ->Finish(mPosition, State::Committed);
+  mQ = nullptr;
+}
+
+inline ByteRingQueue::Reader::Reader(ByteRingQueue *q, std::uint64_t position,
+                                     const char *data, size_type size)
+    : mQ(q), mPosition(position), mData(data), mSize(size) {}
+
+inline ByteRingQueue::Reader::Reader(Reader &&other)
+    : mQ(other.mQ), mPosition(other.mPosition), mData(other.mData),
+      mSize(other.mSize) {
+  other.mQ = nullptr;
+}
+
+inline ByteRingQueue::Reader &ByteRingQueue::Reader::
+operator=(Reader &&other) {
+  if (this != &other) {
+    if (mQ)
+      Release();
+    mQ = other.mQ;
+    mPosition = other.mPosition;
+    mData = other.mData;
+    mSize = other.mSize;
+    other.mQ = nullptr;
+  }
+  return *this;
+}
+
+inline ByteRingQueue::Reader::~Reader() {
+  if (mQ)
+    Release();
+}
+
+inline void ByteRingQueue::Reader::Release() {
+  assert(mQ && "Release() on a moved-from or released Reader");
+  auto *q = mQ;
+  mQ = nullptr;
+  q->Finish(mPosition, State::Released);
+}
+
+inline ByteRingQueue::ByteRingQueue(size_type capacity)
+    : mCapacity(Padded(capacity)) {
+  if (mCapacity < 2 * sizeof(RecordHeader))
+    throw std::invalid_argument("ByteRingQueue capacity is too small");
+  mRing.reset(new std::uint64_t[mCapacity / sizeof(std::uint64_t)]);
+}
+
+inline ByteRingQueue::~ByteRingQueue() {
+  Join();
+  assert(mUnfinishedTasks == 0 && "Expected all tasks to be finished");
+}
+
+inline ByteRingQueue::size_type
+ByteRingQueue::RecordBytes(size_type size) const {
+  return sizeof(RecordHeader) + Padded(size);
+}
+
+inline ByteRingQueue::RecordHeader &
+ByteRingQueue::HeaderAt(std::uint64_t position) {
+  return *reinterpret_cast<RecordHeader *>(
+      reinterpret_cast<char *>(mRing.get()) + position % mCapacity);
+}
+
+inline char *ByteRingQueue::PayloadAt(std::uint64_t position) {
+  return reinterpret_cast<char *>(&HeaderAt(position)) + sizeof(RecordHeader);
+}
+
+inline bool ByteRingQueue::CanReserve(size_type bytes) {
+  const auto offset = mTail % mCapacity;
+  const auto padding = offset + bytes > mCapacity ? mCapacity - offset : 0;
+  if (padding != 0 && mHead == mTail) {
+    // Nothing is stored, so start over at the beginning of the ring.
+    mHead = mRead = mTail = mTail + padding;
+    return true;
+  }
+  return mCapacity - (mTail - mHead) >= padding + bytes;
+}
+
+inline ByteRingQueue::Writer ByteRingQueue::DoReserve(size_type size) {
+  const auto bytes = RecordBytes(size);
+  const auto offset = mTail % mCapacity;
+  if (offset + bytes > mCapacity) {
+    HeaderAt(mTail) = RecordHeader{
+        static_cast<std::uint32_t>(mCapacity - offset - sizeof(RecordHeader)),
+        State::Skip};
+    mTail += mCapacity - offset;
+  }
+  const auto position = mTail;
+  HeaderAt(position) =
+      RecordHeader{static_cast<std::uint32_t>(size), State::Reserved};
+  mTail += bytes;
+  return Writer(this, position, PayloadAt(position), size);
+}
+
+inline ByteRingQueue::Writer ByteRingQueue::Reserve(size_type size) {
+  if (RecordBytes(size) > mCapacity)
+    throw std::length_error("Record does not fit in the ring");
+  UniqueLock lock(mMutex);
+  const auto bytes = RecordBytes(size);
+  mNotFull.wait(lock, [&]() { return CanReserve(bytes); });
+  return DoReserve(size);
+}
+
+template <class Rep, class Period>
+ByteRingQueue::Writer
+ByteRingQueue::Reserve(size_type size,
+                       const std::chrono::duration<Rep, Period> &timeout) {
+  if (RecordBytes(size) > mCapacity)
+    throw std::length_error("Record does not fit in the ring");
+  UniqueLock lock(mMutex);
+  const auto bytes = RecordBytes(size);
+  if (mNotFull.wait_for(lock, timeout, [&]() { return CanReserve(bytes); }))
+    return DoReserve(size);
+  throw TimeoutError();
+}
+
+inline bool ByteRingQueue::CanPop() {
+  while (mRead != mTail && HeaderAt(mRead).state == State::Skip)
+    mRead += RecordBytes(HeaderAt(mRead).size);
+  return mRead != mTail && HeaderAt(mRead).state == State::Committed;
+}
+
+inline ByteRingQueue::Reader ByteRingQueue::DoPop() {
+  const auto position = mRead;
+  auto &header = HeaderAt(position);
+  header.state = State::Popped;
+  mRead += RecordBytes(header.size);
+  return Reader(this, position, PayloadAt(position), header.size);
+}
+
+inline ByteRingQueue::Reader ByteRingQueue::Pop() {
+  UniqueLock lock(mMutex);
+  mNotEmpty.wait(lock, [this]() { return CanPop(); });
+  return DoPop();
+}
+
+template <class Rep, class Period>
+ByteRingQueue::Reader
+ByteRingQueue::Pop(const std::chrono::duration<Rep, Period> &timeout) {
+  UniqueLock lock(mMutex);
+  if (mNotEmpty.wait_for(lock, timeout, [this]() { return CanPop(); }))
+    return DoPop();
+  throw TimeoutError();
+}
+
+inline void ByteRingQueue::Reclaim() {
+  while (mHead != mRead) {
+    const auto &header = HeaderAt(mHead);
+    if (header.state != State::Released && header.state != State::Skip)
+      break;
+    mHead += RecordBytes(header.size);
+  }
+}
+
+inline void ByteRingQueue::Finish(std::uint64_t position, State state) {
+  LockGuard lock(mMutex);
+  HeaderAt(position).state = state;
+  if (state == State::Committed) {
+    ++mUnfinishedTasks;
+    // Consumers may be waiting on this record even if later ones are ready.
+    mNotEmpty.notify_all();
+    return;
+  }
+  if (state == State::Released) {
+    assert(mUnfinishedTasks > 0 && "Released more records than committed");
+    --mUnfinishedTasks;
+    if (mUnfinishedTasks == 0)
+      mAllTasksDone.notify_all();
+  } else {
+    // An abandoned reservation may have been holding up the consumers.
+    mNotEmpty.notify_all();
+  }
+  // Step over skipped records at the read position, so that their space is
+  // reclaimed too.
+  CanPop();
+  Reclaim();
+  mNotFull.notify_all();
+}
+
+inline void ByteRingQueue::Join() {
+  UniqueLock lock(mMutex);
+  mAllTasksDone.wait(lock, [this]() { return mUnfinishedTasks == 0; });
+}
+
+} // namespace rwols
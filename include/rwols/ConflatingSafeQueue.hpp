@@ -0,0 +1,236 @@
+///\file    ConflatingSafeQueue.hpp
+///\brief   Thread-safe last-value queue that conflates updates per key
+///\author  Raoul Wols
+///\date    October, 2026
+
+#pragma once
+
+#include <rwols/SafeQueue.hpp>
+
+#include <cassert>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <unordered_map>
+#include <utility>
+
+namespace rwols {
+
+/// A thread-safe queue of key-value updates that holds at most one pending
+/// update per key. Pushing a key that is still waiting replaces its value in
+/// place, and the entry keeps its position in the queue:
+/// \code
+///   rwols::ConflatingSafeQueue<Symbol, Quote> q;
+///   q.Push("ABC", quote1);
+///   q.Push("XYZ", quote2);
+///   q.Push("ABC", quote3); // replaces quote1, still ahead of XYZ
+///   auto update = q.PopWithGuard(); // {"ABC", quote3}
+/// \endcode
+/// Consumers only see the latest value of each key, and the queue never holds
+/// more entries than there are distinct keys. A conflated push is not a new
+/// task, so every popped entry needs exactly one TaskDone().
+template <class K, class V, class Hash = std::hash<K>,
+          class KeyEqual = std::equal_to<K>>
+class ConflatingSafeQueue final {
+public:
+  using key_type = K;
+  using mapped_type = V;
+  using value_type = std::pair<key_type, mapped_type>;
+  using size_type = std::size_t;
+
+  struct TaskDoneGuard {
+    TaskDoneGuard(const TaskDoneGuard &) = delete;
+    TaskDoneGuard(TaskDoneGuard &&);
+    TaskDoneGuard &operator=(const TaskDoneGuard &) = delete;
+    TaskDoneGuard &operator=(TaskDoneGuard &&);
+    ~TaskDoneGuard() noexcept(false);
+
+  private:
+    ConflatingSafeQueue *mQ = nullptr;
+    TaskDoneGuard(ConflatingSafeQueue *);
+    friend class ConflatingSafeQueue;
+  };
+
+  ConflatingSafeQueue() = default;
+  ~ConflatingSafeQueue();
+
+  /// Returns false if the update replaced a pending one.
+  bool Push(const key_type &key, const mapped_type &value);
+  bool Push(const key_type &key, mapped_type &&value);
+
+  value_type Pop();
+  std::pair<value_type, TaskDoneGuard> PopWithGuard();
+  template <class Rep, class Period>
+  value_type Pop(const std::chrono::duration<Rep, Period> &timeout);
+  template <class Rep, class Period>
+  std::pair<value_type, TaskDoneGuard>
+  PopWithGuard(const std::chrono::duration<Rep, Period> &timeout);
+
+  void TaskDone();
+
+  void Join();
+
+  /// Keys with a pending update.
+  size_type Size();
+  /// Updates that replaced a pending one, since construction.
+  std::uint64_t Conflated();
+
+private:
+  using UniqueLock = std::unique_lock<std::mutex>;
+  using LockGuard = std::lock_guard<std::mutex>;
+
+  std::mutex mMutex;
+  std::condition_variable mNotEmpty, mAllTasksDone;
+  std::deque<key_type> mOrder;
+  std::unordered_map<key_type, mapped_type, Hash, KeyEqual> mLatest;
+  std::size_t mUnfinishedTasks = 0;
+  std::uint64_t mConflated = 0;
+
+  template <class U> bool PushImpl(const key_type &key, U &&value);
+  value_type TakeFront();
+};
+
+// Implementation follows.
+
+template <class K, class V, class H, class E>
+ConflatingSafeQueue<K, V, H, E>::TaskDoneGuard::TaskDoneGuard(
+    TaskDoneGuard &&other)
+    : mQ(other.mQ) {
+  other.mQ = nullptr;
+}
+
+template <class K, class V, class H, class E>
+typename ConflatingSafeQueue<K, V, H, E>::TaskDoneGuard &
+ConflatingSafeQueue<K, V, H, E>::TaskDoneGuard::
+operator=(TaskDoneGuard &&other) {
+  mQ = other.mQ;
+  other.mQ = nullptr;
+  return *this;
+}
+
+template <class K, class V, class H, class E>
+ConflatingSafeQueue<K, V, H, E>::TaskDoneGuard::TaskDoneGuard(
+    ConflatingSafeQueue *q)
+    : mQ(q) {}
+
+template <class K, class V, class H, class E>
+ConflatingSafeQueue<K, V, H, E>::TaskDoneGuard::~TaskDoneGuard() noexcept(
+    false) {
+  if (mQ)
+    mQ->TaskDone();
+}
+
+template <class K, class V, class H, class E>
+ConflatingSafeQueue<K, V, H, E>::~ConflatingSafeQueue() {
+  Join();
+  assert(mUnfinishedTasks == 0 && "Expected all tasks to be finished");
+}
+
+template <class K, class V, class H, class E>
+template <class U>
+bool ConflatingSafeQueue<K, V, H, E>::PushImpl(const key_type &key,
+                                               U &&value) {
+  {
+    LockGuard lock(mMutex);
+    const auto where = mLatest.find(key);
+    if (where != mLatest.end()) {
+      where->second = std::forward<U>(value);
+      ++mConflated;
+      return false;
+    }
+    mLatest.emplace(key, std::forward<U>(value));
+    mOrder.push_back(key);
+    ++mUnfinishedTasks;
+  }
+  mNotEmpty.notify_one();
+  return true;
+}
+
+template <class K, class V, class H, class E>
+bool ConflatingSafeQueue<K, V, H, E>::Push(const key_type &key,
+                                           const mapped_type &value) {
+  return PushImpl(key, value);
+}
+
+template <class K, class V, class H, class E>
+bool ConflatingSafeQueue<K, V, H, E>::Push(const key_type &key,
+                                           mapped_type &&value) {
+  return PushImpl(key, std::move(value));
+}
+
+template <class K, class V, class H, class E>
+typename ConflatingSafeQueue<K, V, H, E>::value_type
+ConflatingSafeQueue<K, V, H, E>::TakeFront() {
+  const auto where = mLatest.find(mOrder.front());
+  value_type entry(std::move(mOrder.front()), std::move(where->second));
+  mLatest.erase(where);
+  mOrder.pop_front();
+  return entry;
+}
+
+template <class K, class V, class H, class E>
+typename ConflatingSafeQueue<K, V, H, E>::value_type
+ConflatingSafeQueue<K, V, H, E>::Pop() {
+  UniqueLock lock(mMutex);
+  mNotEmpty.wait(lock, [this]() { return !mOrder.empty(); });
+  return TakeFront();
+}
+
+template <class K, class V, class H, class E>
+std::pair<typename ConflatingSafeQueue<K, V, H, E>::value_type,
+          typename ConflatingSafeQueue<K, V, H, E>::TaskDoneGuard>
+ConflatingSafeQueue<K, V, H, E>::PopWithGuard() {
+  auto entry = Pop();
+  return std::make_pair(std::move(entry), TaskDoneGuard(this));
+}
+
+template <class K, class V, class H, class E>
+template <class Rep, class Period>
+typename ConflatingSafeQueue<K, V, H, E>::value_type
+ConflatingSafeQueue<K, V, H, E>::Pop(
+    const std::chrono::duration<Rep, Period> &timeout) {
+  UniqueLock lock(mMutex);
+  if (mNotEmpty.wait_for(lock, timeout, [this]() { return !mOrder.empty(); }))
+    return TakeFront();
+  throw TimeoutError();
+}
+
+template <class K, class V, class H, class E>
+template <class Rep, class Period>
+std::pair<typename ConflatingSafeQueue<K, V, H, E>::value_type,
+          typename ConflatingSafeQueue<K, V, H, E>::TaskDoneGuard>
+ConflatingSafeQueue<K, V, H, E>::PopWithGuard(
+    const std::chrono::duration<Rep, Period> &timeout) {
+  auto entry = Pop(timeout);
+  return std::make_pair(std::move(entry), TaskDoneGuard(this));
+}
+
+template <class K, class V, class H, class E>
+void ConflatingSafeQueue<K, V, H, E>::TaskDone() {
+  LockGuard lock(mMutex);
+  assert(mUnfinishedTasks > 0 && "TaskDone() called too many times");
+  --mUnfinishedTasks;
+  if (mUnfinishedTasks == 0)
+    mAllTasksDone.notify_all();
+}
+
+template <class K, class V, class H, class E>
+void ConflatingSafeQueue<K, V, H, E>::Join() {
+  UniqueLock lock(mMutex);
+  mAllTasksDone.wait(lock, [this]() { return mUnfinishedTasks == 0; });
+}
+
+template <class K, class V, class H, class E>
+typename ConflatingSafeQueue<K, V, H, E>::size_type
+ConflatingSafeQueue<K, V, H, E>::Size() {
+  LockGuard lock(mMutex);
+  return mOrder.size();
+}
+
+template <class K, class V, class H, class E>
+std::uint64_t ConflatingSafeQueue<K, V, H, E>::Conflated() {
+  LockGuard lock(mMutex);
+  return mConflated;
+}
+
+} // namespace rwols
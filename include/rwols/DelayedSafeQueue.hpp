@@ -0,0 +1,440 @@
+///\file    DelayedSafeQueue.hpp
+///\brief   Thread-safe queue whose items become available at a given time
+///\author  Raoul Wols
+///\date    October, 2026
+
+#pragma once
+
+#include <rwols/SafeQueue.hpp>
+
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace rwols {
+
+namespace detail {
+
+/// Index of the lowest set bit of a non-zero word.
+inline unsigned LowestBit(std::uint64_t bits) {
+  assert(bits != 0 && "LowestBit() of zero");
+#if defined(__GNUC__) || defined(__clang__)
+  return static_cast<unsigned>(__builtin_ctzll(bits));
+#elif defined(_MSC_VER) && defined(_M_X64)
+  unsigned long index;
+  _BitScanForward64(&index, bits);
+  return static_cast<unsigned>(index);
+#else
+  unsigned index = 0;
+  for (; (bits & 1) == 0; bits >>= 1)
+    ++index;
+  return index;
+#endif
+}
+
+} // namespace detail
+
+/// A thread-safe queue whose items can be held back until a point in time:
+/// \code
+///   rwols::DelayedSafeQueue<Job> q;
+///   q.PushAfter(job, std::chrono::seconds(5)); // retry with backoff
+///   q.Push(other);                              // available right away
+///   auto item = q.PopWithGuard();
+/// \endcode
+/// Pending items live in a hierarchical timer wheel of four levels of 64
+/// slots each, so scheduling an item is O(1) no matter how many are pending.
+/// Time is measured in ticks given to the constructor. An item is never
+/// popped before its time, and at most one tick after it. Items due in the
+/// same tick may come out in any order.
+///
+/// A consumer in Pop() sleeps until the next slot of the wheel is due. That is
+/// the next due item, except for a few extra wake-ups to move items from a
+/// coarse level of the wheel to a finer one.
+template <class T, class Clock = std::chrono::steady_clock>
+class DelayedSafeQueue final {
+public:
+  using value_type = T;
+  using size_type = std::size_t;
+  using const_reference = const value_type &;
+  using clock_type = Clock;
+  using duration = typename Clock::duration;
+  using time_point = typename Clock::time_point;
+
+  struct TaskDoneGuard {
+    TaskDoneGuard(const TaskDoneGuard &) = delete;
+    TaskDoneGuard(TaskDoneGuard &&);
+    TaskDoneGuard &operator=(const TaskDoneGuard &) = delete;
+    TaskDoneGuard &operator=(TaskDoneGuard &&);
+    ~TaskDoneGuard() noexcept(false);
+
+  private:
+    DelayedSafeQueue *mQ = nullptr;
+    TaskDoneGuard(DelayedSafeQueue *);
+    friend class DelayedSafeQueue;
+  };
+
+  explicit DelayedSafeQueue(
+      duration tick = std::chrono::duration_cast<duration>(
+          std::chrono::milliseconds(1)));
+  ~DelayedSafeQueue();
+
+  void Push(const_reference item);
+  void Push(value_type &&item);
+  template <class Rep, class Period>
+  void PushAfter(value_type item,
+                 const std::chrono::duration<Rep, Period> &delay);
+  void PushAt(value_type item, time_point when);
+
+  value_type Pop();
+  std::pair<value_type, TaskDoneGuard> PopWithGuard();
+  template <class Rep, class Period>
+  value_type Pop(const std::chrono::duration<Rep, Period> &timeout);
+  template <class Rep, class Period>
+  std::pair<value_type, TaskDoneGuard>
+  PopWithGuard(const std::chrono::duration<Rep, Period> &timeout);
+
+  void TaskDone();
+
+  void Join();
+
+  /// Items that are due, plus items that are still waiting for their time.
+  size_type Size();
+  /// Items that are still waiting for their time.
+  size_type Pending();
+
+private:
+  using UniqueLock = std::unique_lock<std::mutex>;
+  using LockGuard = std::lock_guard<std::mutex>;
+
+  static constexpr unsigned kLevels = 4;
+  static constexpr unsigned kSlotBits = 6;
+  static constexpr unsigned kSlots = 1u << kSlotBits;
+  static constexpr std::uint64_t kNever =
+      std::numeric_limits<std::uint64_t>::max();
+
+  struct Entry {
+    std::uint64_t due; // In ticks since mStart.
+    value_type item;
+  };
+
+  std::mutex mMutex;
+  std::condition_variable mNotEmpty, mAllTasksDone;
+  duration mTick;
+  time_point mStart;
+  std::uint64_t mNow = 0; // Every tick up to this one has been processed.
+  std::deque<value_type> mReady;
+  std::array<std::array<std::vector<Entry>, kSlots>, kLevels> mWheel;
+  std::array<std::uint64_t, kLevels> mOccupied{}; // Bit per non-empty slot.
+  std::vector<Entry> mOverflow; // Due beyond the reach of the top level.
+  std::size_t mPending = 0;
+  std::size_t mUnfinishedTasks = 0;
+
+  static unsigned Shift(unsigned level) { return level * kSlotBits; }
+  static unsigned SlotOf(std::uint64_t tick, unsigned level) {
+    return static_cast<unsigned>(tick >> Shift(level)) & (kSlots - 1);
+  }
+  std::uint64_t TickOf(time_point when) const;
+  std::uint64_t ElapsedTicks(time_point now) const;
+  time_point TimeOf(std::uint64_t tick) const;
+  void Schedule(Entry &&entry);
+  std::uint64_t NextEvent() const;
+  void Advance(std::uint64_t target);
+  void CatchUp();
+  void Cascade(std::vector<Entry> &slot);
+  template <class U> void PushReady(U &&item);
+  bool WaitReady(UniqueLock &lock, time_point deadline);
+  value_type TakeFront();
+};
+
+// Implementation follows.
+
+template <class T, class C>
+DelayedSafeQueue<T, C>::TaskDoneGuard::TaskDoneGuard(TaskDoneGuard &&other)
+    : mQ(other.mQ) {
+  other.mQ = nullptr;
+}
+
+template <class T, class C>
+typename DelayedSafeQueue<T, C>::TaskDoneGuard &
+DelayedSafeQueue<T, C>::TaskDoneGuard::operator=(TaskDoneGuard &&other) {
+  mQ = other.mQ;
+  other.mQ = nullptr;
+  return *this;
+}
+
+template <class T, class C>
+DelayedSafeQueue<T, C>::TaskDoneGuard::TaskDoneGuard(DelayedSafeQueue *q)
+    : mQ(q) {}
+
+template <class T, class C>
+DelayedSafeQueue<T, C>::TaskDoneGuard::~TaskDoneGuard() noexcept(false) {
+  if (mQ)
+    mQ->TaskDone();
+}
+
+template <class T, class C>
+DelayedSafeQueue<T, C>::DelayedSafeQueue(duration tick)
+    : mTick(tick), mStart(C::now()) {
+  if (mTick <= duration::zero())
+    throw std::invalid_argument("DelayedSafeQueue tick must be positive");
+}
+
+template <class T, class C> DelayedSafeQueue<T, C>::~DelayedSafeQueue() {
+  Join();
+  assert(mUnfinishedTasks == 0 && "Expected all tasks to be finished");
+}
+
+template <class T, class C>
+std::uint64_t DelayedSafeQueue<T, C>::TickOf(time_point when) const {
+  // Round up, so that an item is never due before its time.
+  if (when <= mStart)
+    return 0;
+  return static_cast<std::uint64_t>((when - mStart + mTick - duration(1)) /
+                                    mTick);
+}
+
+template <class T, class C>
+std::uint64_t DelayedSafeQueue<T, C>::ElapsedTicks(time_point now) const {
+  // Round down: a tick is processed only once it has fully passed.
+  if (now <= mStart)
+    return 0;
+  return static_cast<std::uint64_t>((now - mStart) / mTick);
+}
+
+template <class T, class C>
+typename DelayedSafeQueue<T, C>::time_point
+DelayedSafeQueue<T, C>::TimeOf(std::uint64_t tick) const {
+  if (tick == kNever)
+    return time_point::max();
+  return mStart + mTick * static_cast<typename duration::rep>(tick);
+}
+
+template <class T, class C>
+void DelayedSafeQueue<T, C>::Schedule(Entry &&entry) {
+  if (entry.due <= mNow) {
+    mReady.push_back(std::move(entry.item));
+    --mPending;
+    return;
+  }
+  const auto delta = entry.due - mNow;
+  for (unsigned level = 0; level < kLevels; ++level) {
+    if (delta < (std::uint64_t(1) << Shift(level + 1))) {
+      const auto slot = SlotOf(entry.due, level);
+      mWheel[level][slot].push_back(std::move(entry));
+      mOccupied[level] |= std::uint64_t(1) << slot;
+      return;
+    }
+  }
+  mOverflow.push_back(std::move(entry));
+}
+
+template <class T, class C>
+std::uint64_t DelayedSafeQueue<T, C>::NextEvent() const {
+  // A slot of level L is handled when the clock reaches the first tick that
+  // maps to it, which is a multiple of 64^L.
+  auto next = kNever;
+  for (unsigned level = 0; level < kLevels; ++level) {
+    if (mOccupied[level] == 0)
+      continue;
+    const auto current = SlotOf(mNow, level);
+    const auto rotation = Shift(level + 1);
+    const auto base = (mNow >> rotation) << rotation;
+    // Slots after the current one are reached in this rotation, the others
+    // in the next.
+    auto later = std::uint64_t(0);
+    if (current + 1 < kSlots)
+      later = mOccupied[level] & (~std::uint64_t(0) << (current + 1));
+    const auto slots = later != 0 ? later : mOccupied[level];
+    const auto slot = static_cast<std::uint64_t>(detail::LowestBit(slots));
+    auto tick = base + (slot << Shift(level));
+    if (later == 0)
+      tick += std::uint64_t(1) << rotation;
+    next = std::min(next, tick);
+  }
+  if (!mOverflow.empty()) {
+    const auto top = Shift(kLevels);
+    next = std::min(next, ((mNow >> top) + 1) << top);
+  }
+  return next;
+}
+
+template <class T, class C>
+void DelayedSafeQueue<T, C>::Cascade(std::vector<Entry> &slot) {
+  std::vector<Entry> entries;
+  entries.swap(slot);
+  for (auto &entry : entries)
+    Schedule(std::move(entry));
+}
+
+template <class T, class C>
+void DelayedSafeQueue<T, C>::Advance(std::uint64_t target) {
+  while (mNow < target) {
+    const auto next = NextEvent();
+    if (next > target) {
+      mNow = target;
+      return;
+    }
+    mNow = next;
+    if (!mOverflow.empty() && next % (std::uint64_t(1) << Shift(kLevels)) == 0)
+      Cascade(mOverflow);
+    // Coarse levels first: their items may be due at this very tick.
+    for (unsigned level = kLevels; level-- > 0;) {
+      if (next % (std::uint64_t(1) << Shift(level)) != 0)
+        continue;
+      const auto slot = SlotOf(next, level);
+      if ((mOccupied[level] & (std::uint64_t(1) << slot)) == 0)
+        continue;
+      mOccupied[level] &= ~(std::uint64_t(1) << slot);
+      Cascade(mWheel[level][slot]);
+    }
+  }
+}
+
+template <class T, class C> void DelayedSafeQueue<T, C>::CatchUp() {
+  const auto before = mReady.size();
+  Advance(ElapsedTicks(C::now()));
+  // The caller takes one of the items that just became due. Other consumers
+  // may sleep without a deadline, and nothing else wakes them for the rest.
+  if (mReady.size() > before + 1)
+    mNotEmpty.notify_all();
+}
+
+template <class T, class C>
+template <class U>
+void DelayedSafeQueue<T, C>::PushReady(U &&item) {
+  {
+    LockGuard lock(mMutex);
+    mReady.push_back(std::forward<U>(item));
+    ++mUnfinishedTasks;
+  }
+  mNotEmpty.notify_one();
+}
+
+template <class T, class C>
+void DelayedSafeQueue<T, C>::Push(const_reference item) {
+  PushReady(item);
+}
+
+template <class T, class C>
+void DelayedSafeQueue<T, C>::Push(value_type &&item) {
+  PushReady(std::move(item));
+}
+
+template <class T, class C>
+template <class Rep, class Period>
+void DelayedSafeQueue<T, C>::PushAfter(
+    value_type item, const std::chrono::duration<Rep, Period> &delay) {
+  PushAt(std::move(item),
+         C::now() + std::chrono::duration_cast<duration>(delay));
+}
+
+template <class T, class C>
+void DelayedSafeQueue<T, C>::PushAt(value_type item, time_point when) {
+  {
+    LockGuard lock(mMutex);
+    ++mPending;
+    ++mUnfinishedTasks;
+    Schedule(Entry{TickOf(when), std::move(item)});
+  }
+  // The sleeping consumers may be waiting for a later item; one of them has
+  // to recompute its deadline.
+  mNotEmpty.notify_one();
+}
+
+template <class T, class C>
+bool DelayedSafeQueue<T, C>::WaitReady(UniqueLock &lock, time_point deadline) {
+  while (true) {
+    CatchUp();
+    if (!mReady.empty())
+      return true;
+    const auto wake = std::min(deadline, TimeOf(NextEvent()));
+    if (wake == time_point::max()) {
+      mNotEmpty.wait(lock);
+    } else if (mNotEmpty.wait_until(lock, wake) == std::cv_status::timeout &&
+               wake == deadline) {
+      CatchUp();
+      return !mReady.empty();
+    }
+  }
+}
+
+template <class T, class C>
+typename DelayedSafeQueue<T, C>::value_type
+DelayedSafeQueue<T, C>::TakeFront() {
+  auto item = std::move(mReady.front());
+  mReady.pop_front();
+  return item;
+}
+
+template <class T, class C>
+typename DelayedSafeQueue<T, C>::value_type DelayedSafeQueue<T, C>::Pop() {
+  UniqueLock lock(mMutex);
+  WaitReady(lock, time_point::max());
+  return TakeFront();
+}
+
+template <class T, class C>
+std::pair<typename DelayedSafeQueue<T, C>::value_type,
+          typename DelayedSafeQueue<T, C>::TaskDoneGuard>
+DelayedSafeQueue<T, C>::PopWithGuard() {
+  auto item = Pop();
+  return std::make_pair(std::move(item), TaskDoneGuard(this));
+}
+
+template <class T, class C>
+template <class Rep, class Period>
+typename DelayedSafeQueue<T, C>::value_type DelayedSafeQueue<T, C>::Pop(
+    const std::chrono::duration<Rep, Period> &timeout) {
+  const auto deadline =
+      C::now() + std::chrono::duration_cast<duration>(timeout);
+  UniqueLock lock(mMutex);
+  if (WaitReady(lock, deadline))
+    return TakeFront();
+  throw TimeoutError();
+}
+
+template <class T, class C>
+template <class Rep, class Period>
+std::pair<typename DelayedSafeQueue<T, C>::value_type,
+          typename DelayedSafeQueue<T, C>::TaskDoneGuard>
+DelayedSafeQueue<T, C>::PopWithGuard(
+    const std::chrono::duration<Rep, Period> &timeout) {
+  auto item = Pop(timeout);
+  return std::make_pair(std::move(item), TaskDoneGuard(this));
+}
+
+template <class T, class C> void DelayedSafeQueue<T, C>::TaskDone() {
+  LockGuard lock(mMutex);
+  assert(mUnfinishedTasks > 0 && "TaskDone() called too many times");
+  --mUnfinishedTasks;
+  if (mUnfinishedTasks == 0)
+    mAllTasksDone.notify_all();
+}
+
+template <class T, class C> void DelayedSafeQueue<T, C>::Join() {
+  UniqueLock lock(mMutex);
+  mAllTasksDone.wait(lock, [this]() { return mUnfinishedTasks == 0; });
+}
+
+template <class T, class C>
+typename DelayedSafeQueue<T, C>::size_type DelayedSafeQueue<T, C>::Size() {
+  LockGuard lock(mMutex);
+  return mReady.size() + mPending;
+}
+
+template <class T, class C>
+typename DelayedSafeQueue<T, C>::size_type DelayedSafeQueue<T, C>::Pending() {
+  LockGuard lock(mMutex);
+  return mPending;
+}
+
+} // namespace rwols
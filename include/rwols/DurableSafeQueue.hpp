@@ -0,0 +1,598 @@
+///\file    DurableSafeQueue.hpp
+///\brief   SafeQueue backed by a crash-safe write-ahead journal
+///\author  Raoul Wols
+///\date    October, 2026
+
+#pragma once
+
+#include <rwols/SafeQueue.hpp>
+#include <rwols/Serializer.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace rwols {
+
+struct JournalOptions {
+  /// Size of one mmap'd log segment. A record must fit in one segment.
+  std::size_t segmentBytes = std::size_t(64) << 20;
+  /// Longest time a record waits before the group commit syncs it.
+  std::chrono::microseconds commitInterval{1000};
+  /// Sync as soon as this many bytes are waiting, without waiting for the
+  /// commit interval.
+  std::size_t commitBytes = std::size_t(1) << 20;
+  /// When true, Push() returns only once its record is on disk.
+  bool waitForCommit = true;
+};
+
+namespace detail {
+
+/// Append-only log of Push and Ack records, spread over fixed-size mmap'd
+/// segment files named <index>.journal. A background thread makes appended
+/// records durable with one fdatasync per commit window: that is the group
+/// commit. A segment file is deleted once every push in it, and in all the
+/// segments before it, has been acknowledged. If a sync fails, the journal
+/// stops: every waiter whose records were not durable yet, and every later
+/// Append(), gets the error.
+class Journal final {
+public:
+  enum class RecordType : std::uint32_t { Push = 1, Ack = 2 };
+
+  /// Pushes without an Ack found on disk, in sequence order.
+  using Pending = std::map<std::uint64_t, std::string>;
+
+  Journal(std::string directory, JournalOptions options, Pending &pending);
+  Journal(const Journal &) = delete;
+  Journal &operator=(const Journal &) = delete;
+  ~Journal();
+
+  /// Appends a record and returns a position to pass to WaitDurable().
+  std::uint64_t Append(RecordType type, std::uint64_t sequence,
+                       const std::string &payload);
+  /// Throws the sync error if the record did not make it to disk.
+  void WaitDurable(std::uint64_t position);
+
+  std::uint64_t NextSequence() const noexcept { return mNextSequence; }
+
+private:
+  struct RecordHeader {
+    std::uint32_t size; // Of the payload; the record is padded to 8 bytes.
+    std::uint32_t checksum;
+    std::uint64_t sequence;
+    std::uint32_t type;
+    std::uint32_t reserved;
+  };
+
+  struct Segment {
+    std::uint64_t index = 0;
+    int fd = -1;
+    char *data = nullptr;
+    std::size_t size = 0;
+    ~Segment();
+  };
+
+  std::string mDirectory;
+  JournalOptions mOptions;
+  std::mutex mMutex;
+  std::condition_variable mDirty, mDurable;
+  std::shared_ptr<Segment> mCurrent;
+  // Full segments, and whether the directory changed, since the last commit.
+  std::vector<std::shared_ptr<Segment>> mRetired;
+  bool mDirectoryDirty = false;
+  std::exception_ptr mError; // Set once a sync failed.
+  std::size_t mOffset = 0;           // Write offset in mCurrent.
+  std::uint64_t mWritten = 0;        // Position just after the last record.
+  std::uint64_t mDurablePosition = 0;
+  std::chrono::steady_clock::time_point mOldestDirty;
+  bool mStop = false;
+  std::uint64_t mNextSequence = 1;
+  // Which segment holds each unacknowledged push, and how many of those
+  // each segment has.
+  std::unordered_map<std::uint64_t, std::uint64_t> mPushSegment;
+  std::map<std::uint64_t, std::size_t> mLivePushes;
+  std::thread mCommitter;
+
+  static std::uint32_t Checksum(RecordType type, std::uint64_t sequence,
+                                const char *payload, std::size_t size);
+  static std::size_t Padded(std::size_t size) {
+    return (size + 7) & ~std::size_t(7);
+  }
+  static void ThrowErrno(const char *what);
+  std::string PathOf(std::uint64_t index) const;
+  std::uint64_t Position(std::size_t offset) const;
+  std::shared_ptr<Segment> MapSegment(std::uint64_t index, bool create);
+  bool SyncDirectory() const;
+  void Recover(Pending &pending);
+  void Roll();
+  void Collect();
+  void Commit();
+};
+
+} // namespace detail
+
+/// A SafeQueue whose items survive a crash. Every Push is written through a
+/// Serializer into a segmented write-ahead journal before consumers can see
+/// it. Every TaskDone is recorded as an acknowledgement. Constructing a
+/// DurableSafeQueue on an existing journal directory replays the items that
+/// were pushed but never acknowledged, in their original order.
+///
+/// Items are identified by a sequence number, so Pop() returns it along with
+/// the item, and TaskDone() takes it back. Delivery is at least once: an item
+/// whose acknowledgement had not reached the disk yet is replayed after a
+/// crash.
+template <class T, class Serializer = DefaultSerializer<T>>
+class DurableSafeQueue final {
+public:
+  using value_type = T;
+  using const_reference = const value_type &;
+  using id_type = std::uint64_t;
+
+  struct TaskDoneGuard {
+    TaskDoneGuard(const TaskDoneGuard &) = delete;
+    TaskDoneGuard(TaskDoneGuard &&);
+    TaskDoneGuard &operator=(const TaskDoneGuard &) = delete;
+    TaskDoneGuard &operator=(TaskDoneGuard &&);
+    ~TaskDoneGuard() noexcept(false);
+
+  private:
+    DurableSafeQueue *mQ = nullptr;
+    id_type mId = 0;
+    TaskDoneGuard(DurableSafeQueue *, id_type);
+    friend class DurableSafeQueue;
+  };
+
+  explicit DurableSafeQueue(std::string directory,
+                            JournalOptions options = JournalOptions());
+  /// Leaves the items that were not popped in the journal, and waits for the
+  /// acknowledgement of the ones that were.
+  ~DurableSafeQueue();
+
+  void Push(const_reference item);
+
+  std::pair<id_type, value_type> Pop();
+  std::pair<value_type, TaskDoneGuard> PopWithGuard();
+  template <class Rep, class Period>
+  std::pair<id_type, value_type>
+  Pop(const std::chrono::duration<Rep, Period> &timeout);
+  template <class Rep, class Period>
+  std::pair<value_type, TaskDoneGuard>
+  PopWithGuard(const std::chrono::duration<Rep, Period> &timeout);
+
+  void TaskDone(id_type id);
+
+  /// Waits until every item has been acknowledged.
+  void Join();
+
+private:
+  std::mutex mMutex; // Orders journal sequence numbers with queue order.
+  JournalOptions mOptions;
+  detail::Journal::Pending mReplay;
+  detail::Journal mJournal;
+  std::uint64_t mNextSequence;
+  SafeQueue<std::pair<id_type, value_type>> mQ;
+};
+
+// Implementation follows.
+
+namespace detail {
+
+inline Journal::Segment::~Segment() {
+  if (data)
+    ::munmap(data, size);
+  if (fd >= 0)
+    ::close(fd);
+}
+
+inline Journal::Journal(std::string directory, JournalOptions options,
+                        Pending &pending)
+    : mDirectory(std::move(directory)), mOptions(options) {
+  if (mOptions.segmentBytes < sizeof(RecordHeader) * 2)
+    throw std::invalid_argument("JournalOptions::segmentBytes is too small");
+  if (::mkdir(mDirectory.c_str(), 0755) != 0 && errno != EEXIST)
+    ThrowErrno("mkdir");
+  Recover(pending);
+  mCommitter = std::thread([this]() { Commit(); });
+}
+
+inline Journal::~Journal() {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStop = true;
+  }
+  mDirty.notify_all();
+  mCommitter.join();
+}
+
+inline void Journal::ThrowErrno(const char *what) {
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+inline std::uint32_t Journal::Checksum(RecordType type, std::uint64_t sequence,
+                                       const char *payload, std::size_t size) {
+  // FNV-1a over the type, the sequence number and the payload.
+  std::uint32_t hash = 2166136261u;
+  auto mix = [&hash](const void *data, std::size_t length) {
+    const auto *bytes = static_cast<const unsigned char *>(data);
+    for (std::size_t i = 0; i < length; ++i) {
+      hash ^= bytes[i];
+      hash *= 16777619u;
+    }
+  };
+  const auto rawType = static_cast<std::uint32_t>(type);
+  mix(&rawType, sizeof(rawType));
+  mix(&sequence, sizeof(sequence));
+  mix(payload, size);
+  return hash;
+}
+
+inline std::string Journal::PathOf(std::uint64_t index) const {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.journal",
+                static_cast<unsigned long long>(index));
+  return mDirectory + "/" + name;
+}
+
+inline std::uint64_t Journal::Position(std::size_t offset) const {
+  return mCurrent->index * mOptions.segmentBytes + offset;
+}
+
+inline std::shared_ptr<Journal::Segment>
+Journal::MapSegment(std::uint64_t index, bool create) {
+  auto segment = std::make_shared<Segment>();
+  segment->index = index;
+  const auto path = PathOf(index);
+  segment->fd = ::open(path.c_str(), create ? O_RDWR | O_CREAT | O_EXCL
+                                            : O_RDONLY);
+  if (segment->fd < 0)
+    ThrowErrno("open");
+  if (create) {
+    segment->size = mOptions.segmentBytes;
+    if (::ftruncate(segment->fd, static_cast<off_t>(segment->size)) != 0)
+      ThrowErrno("ftruncate");
+  } else {
+    struct stat info;
+    if (::fstat(segment->fd, &info) != 0)
+      ThrowErrno("fstat");
+    segment->size = static_cast<std::size_t>(info.st_size);
+  }
+  if (segment->size == 0)
+    return segment;
+  void *data = ::mmap(nullptr, segment->size,
+                      create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED,
+                      segment->fd, 0);
+  if (data == MAP_FAILED)
+    ThrowErrno("mmap");
+  segment->data = static_cast<char *>(data);
+  return segment;
+}
+
+inline bool Journal::SyncDirectory() const {
+  const int fd = ::open(mDirectory.c_str(), O_RDONLY | O_DIRECTORY);
+  if (fd < 0)
+    return false;
+  const bool synced = ::fsync(fd) == 0;
+  const auto error = errno;
+  ::close(fd);
+  errno = error;
+  return synced;
+}
+
+inline void Journal::Recover(Pending &pending) {
+  std::vector<std::uint64_t> indices;
+  if (auto *dir = ::opendir(mDirectory.c_str())) {
+    while (const auto *entry = ::readdir(dir)) {
+      unsigned long long index = 0;
+      char suffix[16] = {};
+      if (std::sscanf(entry->d_name, "%16llx.%15s", &index, suffix) == 2 &&
+          std::strcmp(suffix, "journal") == 0)
+        indices.push_back(index);
+    }
+    ::closedir(dir);
+  }
+  std::sort(indices.begin(), indices.end());
+  for (const auto index : indices) {
+    const auto segment = MapSegment(index, false);
+    std::size_t offset = 0;
+    // Records are checked one by one; the first torn or unwritten record
+    // ends the segment.
+    while (offset + sizeof(RecordHeader) <= segment->size) {
+      RecordHeader header;
+      std::memcpy(&header, segment->data + offset, sizeof(header));
+      if (header.type == 0)
+        break;
+      const auto payload = offset + sizeof(RecordHeader);
+      if (payload + header.size > segment->size)
+        break;
+      const auto type = static_cast<RecordType>(header.type);
+      if (Checksum(type, header.sequence, segment->data + payload,
+                   header.size) != header.checksum)
+        break;
+      if (type == RecordType::Push) {
+        pending[header.sequence].assign(segment->data + payload, header.size);
+        mPushSegment[header.sequence] = index;
+        ++mLivePushes[index];
+      } else if (type == RecordType::Ack) {
+        pending.erase(header.sequence);
+        const auto where = mPushSegment.find(header.sequence);
+        if (where != mPushSegment.end()) {
+          --mLivePushes[where->second];
+          mPushSegment.erase(where);
+        }
+      }
+      mNextSequence = std::max(mNextSequence, header.sequence + 1);
+      offset = payload + Padded(header.size);
+    }
+    mLivePushes.emplace(index, 0);
+  }
+  // New records always go to a fresh segment; a torn tail is never
+  // overwritten.
+  mCurrent = MapSegment(indices.empty() ? 0 : indices.back() + 1, true);
+  mLivePushes.emplace(mCurrent->index, 0);
+  mWritten = mDurablePosition = Position(0);
+  Collect();
+  if (!SyncDirectory())
+    ThrowErrno("fsync");
+  mDirectoryDirty = false;
+}
+
+inline void Journal::Roll() {
+  auto next = MapSegment(mCurrent->index + 1, true);
+  // The committer syncs the full segment, outside our lock, before it counts
+  // anything in the new one as durable.
+  const bool synced = mWritten == mDurablePosition;
+  if (!synced)
+    mRetired.push_back(mCurrent);
+  mCurrent = std::move(next);
+  mLivePushes.emplace(mCurrent->index, 0);
+  mDirectoryDirty = true;
+  mOffset = 0;
+  mWritten = Position(0);
+  if (synced)
+    mDurablePosition = mWritten;
+  else
+    mDirty.notify_one();
+}
+
+inline void Journal::Collect() {
+  while (mLivePushes.size() > 1) {
+    const auto oldest = mLivePushes.begin();
+    if (oldest->second != 0 || oldest->first == mCurrent->index)
+      break;
+    ::unlink(PathOf(oldest->first).c_str());
+    mLivePushes.erase(oldest);
+    mDirectoryDirty = true;
+  }
+}
+
+inline std::uint64_t Journal::Append(RecordType type, std::uint64_t sequence,
+                                     const std::string &payload) {
+  const auto length = sizeof(RecordHeader) + Padded(payload.size());
+  if (length > mOptions.segmentBytes)
+    throw std::length_error("Journal record does not fit in a segment");
+  std::unique_lock<std::mutex> lock(mMutex);
+  if (mError)
+    std::rethrow_exception(mError);
+  if (mOffset + length > mCurrent->size)
+    Roll();
+  RecordHeader header{static_cast<std::uint32_t>(payload.size()),
+                      Checksum(type, sequence, payload.data(), payload.size()),
+                      sequence, static_cast<std::uint32_t>(type), 0};
+  char *destination = mCurrent->data + mOffset;
+  std::memcpy(destination + sizeof(header), payload.data(), payload.size());
+  // The header goes in last, so that a record without one is never read.
+  std::memcpy(destination, &header, sizeof(header));
+  mOffset += length;
+  if (mWritten == mDurablePosition)
+    mOldestDirty = std::chrono::steady_clock::now();
+  mWritten = Position(mOffset);
+  if (type == RecordType::Push) {
+    mPushSegment[sequence] = mCurrent->index;
+    ++mLivePushes[mCurrent->index];
+  } else {
+    const auto where = mPushSegment.find(sequence);
+    if (where != mPushSegment.end()) {
+      --mLivePushes[where->second];
+      mPushSegment.erase(where);
+      Collect();
+    }
+  }
+  const auto position = mWritten;
+  lock.unlock();
+  mDirty.notify_one();
+  return position;
+}
+
+inline void Journal::WaitDurable(std::uint64_t position) {
+  std::unique_lock<std::mutex> lock(mMutex);
+  mDurable.wait(lock,
+                [&]() { return mDurablePosition >= position || mError; });
+  if (mDurablePosition < position)
+    std::rethrow_exception(mError);
+}
+
+inline void Journal::Commit() {
+  std::unique_lock<std::mutex> lock(mMutex);
+  while (true) {
+    mDirty.wait(lock, [this]() {
+      return mStop || (!mError && mWritten > mDurablePosition);
+    });
+    if (mStop && (mError || mWritten == mDurablePosition))
+      return;
+    // Give other records the rest of the window to join this commit.
+    mDirty.wait_until(lock, mOldestDirty + mOptions.commitInterval, [this]() {
+      return mStop || mWritten - mDurablePosition >= mOptions.commitBytes;
+    });
+    auto segments = std::move(mRetired);
+    mRetired.clear();
+    segments.push_back(mCurrent);
+    const bool directory = mDirectoryDirty;
+    mDirectoryDirty = false;
+    const auto target = mWritten;
+    lock.unlock();
+    // A new segment's records only count once its directory entry is durable.
+    int error = 0;
+    const char *what = "fsync";
+    if (directory && !SyncDirectory())
+      error = errno;
+    for (const auto &segment : segments) {
+      if (error == 0 && ::fdatasync(segment->fd) != 0) {
+        error = errno;
+        what = "fdatasync";
+      }
+    }
+    lock.lock();
+    if (error == 0) {
+      mDurablePosition = std::max(mDurablePosition, target);
+    } else {
+      // The kernel may have dropped the pages it could not write, so a later
+      // sync that succeeds proves nothing about them: stop for good.
+      mError = std::make_exception_ptr(
+          std::system_error(error, std::generic_category(), what));
+    }
+    mDurable.notify_all();
+  }
+}
+
+} // namespace detail
+
+template <class T, class S>
+DurableSafeQueue<T, S>::TaskDoneGuard::TaskDoneGuard(TaskDoneGuard &&other)
+    : mQ(other.mQ), mId(other.mId) {
+  other.mQ = nullptr;
+}
+
+template <class T, class S>
+typename DurableSafeQueue<T, S>::TaskDoneGuard &
+DurableSafeQueue<T, S>::TaskDoneGuard::operator=(TaskDoneGuard &&other) {
+  mQ = other.mQ;
+  mId = other.mId;
+  other.mQ = nullptr;
+  return *this;
+}
+
+template <class T, class S>
+DurableSafeQueue<T, S>::TaskDoneGuard::TaskDoneGuard(DurableSafeQueue *q,
+                                                     id_type id)
+    : mQ(q), mId(id) {}
+
+template <class T, class S>
+DurableSafeQueue<T, S>::TaskDoneGuard::~TaskDoneGuard() noexcept(false) {
+  if (mQ)
+    mQ->TaskDone(mId);
+}
+
+template <class T, class S>
+DurableSafeQueue<T, S>::DurableSafeQueue(std::string directory,
+                                         JournalOptions options)
+    : mOptions(options), mJournal(std::move(directory), options, mReplay),
+      mNextSequence(mJournal.NextSequence()) {
+  for (auto &record : mReplay)
+    mQ.Emplace(record.first,
+               S::Deserialize(record.second.data(), record.second.size()));
+  mReplay.clear();
+}
+
+template <class T, class S> DurableSafeQueue<T, S>::~DurableSafeQueue() {
+  // Items nobody popped stay in the journal for the next run; only the ones
+  // that are being worked on are waited for. Nobody else may pop from a queue
+  // that is being destroyed, so Pop() cannot block here, and unlike TryPop()
+  // it needs no default constructed item to move into.
+  while (!mQ.Empty()) {
+    mQ.Pop();
+    mQ.TaskDone();
+  }
+  Join();
+}
+
+template <class T, class S>
+void DurableSafeQueue<T, S>::Push(const_reference item) {
+  std::string payload;
+  S::Serialize(item, payload);
+  std::uint64_t position;
+  id_type id;
+  {
+    // Sequence numbers must reach the journal in the order they are handed
+    // out, or recovery would replay them in a different order.
+    std::lock_guard<std::mutex> lock(mMutex);
+    id = mNextSequence++;
+    position = mJournal.Append(detail::Journal::RecordType::Push, id, payload);
+    if (!mOptions.waitForCommit)
+      mQ.Emplace(id, item);
+  }
+  if (mOptions.waitForCommit) {
+    mJournal.WaitDurable(position);
+    mQ.Emplace(id, item);
+  }
+}
+
+template <class T, class S>
+std::pair<typename DurableSafeQueue<T, S>::id_type,
+          typename DurableSafeQueue<T, S>::value_type>
+DurableSafeQueue<T, S>::Pop() {
+  return mQ.Pop();
+}
+
+template <class T, class S>
+std::pair<typename DurableSafeQueue<T, S>::value_type,
+          typename DurableSafeQueue<T, S>::TaskDoneGuard>
+DurableSafeQueue<T, S>::PopWithGuard() {
+  auto entry = Pop();
+  return std::make_pair(std::move(entry.second),
+                        TaskDoneGuard(this, entry.first));
+}
+
+template <class T, class S>
+template <class Rep, class Period>
+std::pair<typename DurableSafeQueue<T, S>::id_type,
+          typename DurableSafeQueue<T, S>::value_type>
+DurableSafeQueue<T, S>::Pop(const std::chrono::duration<Rep, Period> &timeout) {
+  return mQ.Pop(timeout);
+}
+
+template <class T, class S>
+template <class Rep, class Period>
+std::pair<typename DurableSafeQueue<T, S>::value_type,
+          typename DurableSafeQueue<T, S>::TaskDoneGuard>
+DurableSafeQueue<T, S>::PopWithGuard(
+    const std::chrono::duration<Rep, Period> &timeout) {
+  auto entry = Pop(timeout);
+  return std::make_pair(std::move(entry.second),
+                        TaskDoneGuard(this, entry.first));
+}
+
+template <class T, class S> void DurableSafeQueue<T, S>::TaskDone(id_type id) {
+  // Acknowledgements are not waited for: losing one only means the item is
+  // delivered again after a crash.
+  try {
+    mJournal.Append(detail::Journal::RecordType::Ack, id, std::string());
+  } catch (...) {
+    mQ.TaskDone(); // Join() must not hang on a broken journal.
+    throw;
+  }
+  mQ.TaskDone();
+}
+
+template <class T, class S> void DurableSafeQueue<T, S>::Join() { mQ.Join(); }
+
+} // namespace rwols
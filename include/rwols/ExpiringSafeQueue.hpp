@@ -0,0 +1,292 @@
+///\file    ExpiringSafeQueue.hpp
+///\brief   Thread-safe queue that discards items past their deadline on pop
+///\author  Raoul Wols
+///\date    October, 2026
+
+#pragma once
+
+#include <rwols/SafeQueue.hpp>
+
+#include <cassert>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <vector>
+
+namespace rwols {
+
+/// A thread-safe queue whose items carry a deadline. Pop() skips items whose
+/// deadline has passed, so consumers spend no time on work nobody waits for
+/// any more:
+/// \code
+///   rwols::ExpiringSafeQueue<Request> q(
+///       std::chrono::milliseconds(200),
+///       [](Request &&r) { r.Reply(Status::Timeout); });
+///   q.Push(request);                                   // 200ms to live
+///   q.PushUntil(urgent, urgent.deadline);              // its own deadline
+///   auto pair = q.PopWithGuard();                      // never expired
+/// \endcode
+/// A discarded item goes to the expiry callback if there is one, and counts
+/// as done once the callback has returned, so Join() also waits for the
+/// callbacks. The callback runs on the popping thread as soon as the item is
+/// discarded, without the lock held. If it throws, the other items discarded
+/// along with it still go to the callback, and then the pop rethrows the
+/// first exception. Items expire only when they reach the
+/// front of the queue; Size() counts expired items that are still waiting.
+template <class T, class Clock = std::chrono::steady_clock>
+class ExpiringSafeQueue final {
+public:
+  using value_type = T;
+  using size_type = std::size_t;
+  using const_reference = const value_type &;
+  using clock_type = Clock;
+  using duration = typename Clock::duration;
+  using time_point = typename Clock::time_point;
+  using Expire = std::function<void(value_type &&)>;
+
+  struct TaskDoneGuard {
+    TaskDoneGuard(const TaskDoneGuard &) = delete;
+    TaskDoneGuard(TaskDoneGuard &&);
+    TaskDoneGuard &operator=(const TaskDoneGuard &) = delete;
+    TaskDoneGuard &operator=(TaskDoneGuard &&);
+    ~TaskDoneGuard() noexcept(false);
+
+  private:
+    ExpiringSafeQueue *mQ = nullptr;
+    TaskDoneGuard(ExpiringSafeQueue *);
+    friend class ExpiringSafeQueue;
+  };
+
+  /// Items pushed without a deadline of their own live for `ttl`; the
+  /// default is forever.
+  explicit ExpiringSafeQueue(duration ttl = duration::max(),
+                             Expire expire = Expire());
+  ~ExpiringSafeQueue();
+
+  void Push(const_reference item);
+  void Push(value_type &&item);
+  template <class Rep, class Period>
+  void PushFor(value_type item, const std::chrono::duration<Rep, Period> &ttl);
+  void PushUntil(value_type item, time_point deadline);
+
+  value_type Pop();
+  std::pair<value_type, TaskDoneGuard> PopWithGuard();
+  template <class Rep, class Period>
+  value_type Pop(const std::chrono::duration<Rep, Period> &timeout);
+  template <class Rep, class Period>
+  std::pair<value_type, TaskDoneGuard>
+  PopWithGuard(const std::chrono::duration<Rep, Period> &timeout);
+
+  void TaskDone();
+
+  void Join();
+
+  size_type Size();
+  /// Items discarded because they expired, since construction.
+  std::uint64_t Dropped();
+
+private:
+  using UniqueLock = std::unique_lock<std::mutex>;
+  using LockGuard = std::lock_guard<std::mutex>;
+
+  std::mutex mMutex;
+  std::condition_variable mNotEmpty, mAllTasksDone;
+  std::deque<std::pair<time_point, value_type>> mQ;
+  duration mTtl;
+  Expire mExpire;
+  std::size_t mUnfinishedTasks = 0;
+  std::uint64_t mDropped = 0;
+
+  time_point DeadlineAfter(duration ttl) const;
+  bool DropExpired(UniqueLock &lock);
+  value_type TakeFront();
+};
+
+// Implementation follows.
+
+template <class T, class C>
+ExpiringSafeQueue<T, C>::TaskDoneGuard::TaskDoneGuard(TaskDoneGuard &&other)
+    : mQ(other.mQ) {
+  other.mQ = nullptr;
+}
+
+template <class T, class C>
+typename ExpiringSafeQueue<T, C>::TaskDoneGuard &
+ExpiringSafeQueue<T, C>::TaskDoneGuard::operator=(TaskDoneGuard &&other) {
+  mQ = other.mQ;
+  other.mQ = nullptr;
+  return *this;
+}
+
+template <class T, class C>
+ExpiringSafeQueue<T, C>::TaskDoneGuard::TaskDoneGuard(ExpiringSafeQueue *q)
+    : mQ(q) {}
+
+template <class T, class C>
+ExpiringSafeQueue<T, C>::TaskDoneGuard::~TaskDoneGuard() noexcept(false) {
+  if (mQ)
+    mQ->TaskDone();
+}
+
+template <class T, class C>
+ExpiringSafeQueue<T, C>::ExpiringSafeQueue(duration ttl, Expire expire)
+    : mTtl(ttl), mExpire(std::move(expire)) {}
+
+template <class T, class C> ExpiringSafeQueue<T, C>::~ExpiringSafeQueue() {
+  Join();
+  assert(mUnfinishedTasks == 0 && "Expected all tasks to be finished");
+}
+
+template <class T, class C>
+typename ExpiringSafeQueue<T, C>::time_point
+ExpiringSafeQueue<T, C>::DeadlineAfter(duration ttl) const {
+  const auto now = C::now();
+  if (ttl >= time_point::max() - now)
+    return time_point::max();
+  return now + ttl;
+}
+
+template <class T, class C>
+void ExpiringSafeQueue<T, C>::Push(const_reference item) {
+  PushUntil(item, DeadlineAfter(mTtl));
+}
+
+template <class T, class C>
+void ExpiringSafeQueue<T, C>::Push(value_type &&item) {
+  PushUntil(std::move(item), DeadlineAfter(mTtl));
+}
+
+template <class T, class C>
+template <class Rep, class Period>
+void ExpiringSafeQueue<T, C>::PushFor(
+    value_type item, const std::chrono::duration<Rep, Period> &ttl) {
+  PushUntil(std::move(item),
+            DeadlineAfter(std::chrono::duration_cast<duration>(ttl)));
+}
+
+template <class T, class C>
+void ExpiringSafeQueue<T, C>::PushUntil(value_type item, time_point deadline) {
+  {
+    LockGuard lock(mMutex);
+    mQ.emplace_back(deadline, std::move(item));
+    ++mUnfinishedTasks;
+  }
+  mNotEmpty.notify_one();
+}
+
+template <class T, class C>
+bool ExpiringSafeQueue<T, C>::DropExpired(UniqueLock &lock) {
+  // The callbacks run without the lock, so look again after every batch.
+  while (!mQ.empty() && mQ.front().first != time_point::max()) {
+    const auto now = C::now();
+    std::vector<value_type> expired;
+    std::size_t count = 0;
+    for (; !mQ.empty() && mQ.front().first <= now; ++count) {
+      if (mExpire)
+        expired.push_back(std::move(mQ.front().second));
+      mQ.pop_front();
+      ++mDropped;
+    }
+    if (count == 0)
+      break;
+    // The tasks are done only once their callbacks have run; until then
+    // Join() must not return, or the queue might be destroyed under them.
+    std::exception_ptr error;
+    if (!expired.empty()) {
+      lock.unlock();
+      for (auto &item : expired) {
+        try {
+          mExpire(std::move(item));
+        } catch (...) {
+          // The other expired items still get their callback.
+          if (!error)
+            error = std::current_exception();
+        }
+      }
+      lock.lock();
+    }
+    mUnfinishedTasks -= count;
+    if (mUnfinishedTasks == 0)
+      mAllTasksDone.notify_all();
+    if (error)
+      std::rethrow_exception(error);
+  }
+  return !mQ.empty();
+}
+
+template <class T, class C>
+typename ExpiringSafeQueue<T, C>::value_type
+ExpiringSafeQueue<T, C>::TakeFront() {
+  auto item = std::move(mQ.front().second);
+  mQ.pop_front();
+  return item;
+}
+
+template <class T, class C>
+typename ExpiringSafeQueue<T, C>::value_type ExpiringSafeQueue<T, C>::Pop() {
+  UniqueLock lock(mMutex);
+  do {
+    mNotEmpty.wait(lock, [this]() { return !mQ.empty(); });
+  } while (!DropExpired(lock));
+  return TakeFront();
+}
+
+template <class T, class C>
+std::pair<typename ExpiringSafeQueue<T, C>::value_type,
+          typename ExpiringSafeQueue<T, C>::TaskDoneGuard>
+ExpiringSafeQueue<T, C>::PopWithGuard() {
+  auto item = Pop();
+  return std::make_pair(std::move(item), TaskDoneGuard(this));
+}
+
+template <class T, class C>
+template <class Rep, class Period>
+typename ExpiringSafeQueue<T, C>::value_type ExpiringSafeQueue<T, C>::Pop(
+    const std::chrono::duration<Rep, Period> &timeout) {
+  const auto deadline =
+      C::now() + std::chrono::duration_cast<duration>(timeout);
+  UniqueLock lock(mMutex);
+  while (true) {
+    if (!mNotEmpty.wait_until(lock, deadline, [this]() { return !mQ.empty(); }))
+      throw TimeoutError();
+    if (DropExpired(lock))
+      return TakeFront();
+  }
+}
+
+template <class T, class C>
+template <class Rep, class Period>
+std::pair<typename ExpiringSafeQueue<T, C>::value_type,
+          typename ExpiringSafeQueue<T, C>::TaskDoneGuard>
+ExpiringSafeQueue<T, C>::PopWithGuard(
+    const std::chrono::duration<Rep, Period> &timeout) {
+  auto item = Pop(timeout);
+  return std::make_pair(std::move(item), TaskDoneGuard(this));
+}
+
+template <class T, class C> void ExpiringSafeQueue<T, C>::TaskDone() {
+  LockGuard lock(mMutex);
+  assert(mUnfinishedTasks > 0 && "TaskDone() called too many times");
+  --mUnfinishedTasks;
+  if (mUnfinishedTasks == 0)
+    mAllTasksDone.notify_all();
+}
+
+template <class T, class C> void ExpiringSafeQueue<T, C>::Join() {
+  UniqueLock lock(mMutex);
+  mAllTasksDone.wait(lock, [this]() { return mUnfinishedTasks == 0; });
+}
+
+template <class T, class C>
+typename ExpiringSafeQueue<T, C>::size_type ExpiringSafeQueue<T, C>::Size() {
+  LockGuard lock(mMutex);
+  return mQ.size();
+}
+
+template <class T, class C> std::uint64_t ExpiringSafeQueue<T, C>::Dropped() {
+  LockGuard lock(mMutex);
+  return mDropped;
+}
+
+} // namespace rwols
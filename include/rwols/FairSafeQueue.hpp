@@ -0,0 +1,281 @@
+///\file    FairSafeQueue.hpp
+///\brief   Thread-safe multi-tenant queue with weighted fair scheduling
+///\author  Raoul Wols
+///\date    October, 2026
+
+#pragma once
+
+#include <rwols/SafeQueue.hpp>
+
+#include <cassert>
+#include <deque>
+#include <functional>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+namespace rwols {
+
+/// A thread-safe queue shared by many tenants, where a tenant that pushes a
+/// burst cannot starve the others. Every Push() names a tenant, and Pop()
+/// serves the tenants with waiting items by deficit round robin:
+/// \code
+///   rwols::FairSafeQueue<TenantId, Job> q;
+///   q.SetWeight(premium, 4);
+///   q.Push(tenant, job);
+///   auto pair = q.PopWithGuard();
+/// \endcode
+/// Each tenant has its own FIFO, and tenants with items wait in a ring. On its
+/// turn a tenant gets as many pops as its weight, then goes to the back of
+/// the ring. So under load tenants get pops in proportion to their weights,
+/// and an idle tenant costs nothing: Pop() is O(1) however many tenants there
+/// are.
+template <class Tenant, class T, class Hash = std::hash<Tenant>,
+          class KeyEqual = std::equal_to<Tenant>>
+class FairSafeQueue final {
+public:
+  using tenant_type = Tenant;
+  using value_type = T;
+  using size_type = std::size_t;
+  using const_reference = const value_type &;
+
+  struct TaskDoneGuard {
+    TaskDoneGuard(const TaskDoneGuard &) = delete;
+    TaskDoneGuard(TaskDoneGuard &&);
+    TaskDoneGuard &operator=(const TaskDoneGuard &) = delete;
+    TaskDoneGuard &operator=(TaskDoneGuard &&);
+    ~TaskDoneGuard() noexcept(false);
+
+  private:
+    FairSafeQueue *mQ = nullptr;
+    TaskDoneGuard(FairSafeQueue *);
+    friend class FairSafeQueue;
+  };
+
+  /// Tenants without a weight of their own get `defaultWeight`.
+  explicit FairSafeQueue(size_type defaultWeight = 1);
+  ~FairSafeQueue();
+
+  /// Sets how many items `tenant` gets per turn. Takes effect from its next
+  /// turn.
+  void SetWeight(const tenant_type &tenant, size_type weight);
+
+  void Push(const tenant_type &tenant, const_reference item);
+  void Push(const tenant_type &tenant, value_type &&item);
+  template <class... Args>
+  void Emplace(const tenant_type &tenant, Args &&... args);
+
+  value_type Pop();
+  std::pair<value_type, TaskDoneGuard> PopWithGuard();
+  template <class Rep, class Period>
+  value_type Pop(const std::chrono::duration<Rep, Period> &timeout);
+  template <class Rep, class Period>
+  std::pair<value_type, TaskDoneGuard>
+  PopWithGuard(const std::chrono::duration<Rep, Period> &timeout);
+
+  void TaskDone();
+
+  void Join();
+
+  /// Items waiting, over all tenants.
+  size_type Size();
+  /// Tenants with items waiting.
+  size_type ActiveTenants();
+
+private:
+  using UniqueLock = std::unique_lock<std::mutex>;
+  using LockGuard = std::lock_guard<std::mutex>;
+
+  struct Lane {
+    std::deque<value_type> items;
+    size_type weight;
+    size_type deficit = 0; // Pops left in the current turn.
+  };
+  using Lanes = std::unordered_map<tenant_type, Lane, Hash, KeyEqual>;
+
+  std::mutex mMutex;
+  std::condition_variable mNotEmpty, mAllTasksDone;
+  size_type mDefaultWeight;
+  std::unordered_map<tenant_type, size_type, Hash, KeyEqual> mWeights;
+  Lanes mLanes; // Only tenants with items waiting.
+  // The ring of tenants with items; the front one has the turn. Elements of
+  // an unordered_map keep their address, so the ring can point into mLanes.
+  std::deque<typename Lanes::value_type *> mActive;
+  size_type mSize = 0;
+  std::size_t mUnfinishedTasks = 0;
+
+  value_type TakeFront();
+};
+
+// Implementation follows.
+
+template <class N, class T, class H, class E>
+FairSafeQueue<N, T, H, E>::TaskDoneGuard::TaskDoneGuard(TaskDoneGuard &&other)
+    : mQ(other.mQ) {
+  other.mQ = nullptr;
+}
+
+template <class N, class T, class H, class E>
+typename FairSafeQueue<N, T, H, E>::TaskDoneGuard &
+FairSafeQueue<N, T, H, E>::TaskDoneGuard::operator=(TaskDoneGuard &&other) {
+  mQ = other.mQ;
+  other.mQ = nullptr;
+  return *this;
+}
+
+template <class N, class T, class H, class E>
+FairSafeQueue<N, T, H, E>::TaskDoneGuard::TaskDoneGuard(FairSafeQueue *q)
+    : mQ(q) {}
+
+template <class N, class T, class H, class E>
+FairSafeQueue<N, T, H, E>::TaskDoneGuard::~TaskDoneGuard() noexcept(false) {
+  if (mQ)
+    mQ->TaskDone();
+}
+
+template <class N, class T, class H, class E>
+FairSafeQueue<N, T, H, E>::FairSafeQueue(size_type defaultWeight)
+    : mDefaultWeight(defaultWeight) {
+  if (defaultWeight == 0)
+    throw std::invalid_argument("FairSafeQueue weight must be positive");
+}
+
+template <class N, class T, class H, class E>
+FairSafeQueue<N, T, H, E>::~FairSafeQueue() {
+  Join();
+  assert(mUnfinishedTasks == 0 && "Expected all tasks to be finished");
+}
+
+template <class N, class T, class H, class E>
+void FairSafeQueue<N, T, H, E>::SetWeight(const tenant_type &tenant,
+                                          size_type weight) {
+  if (weight == 0)
+    throw std::invalid_argument("FairSafeQueue weight must be positive");
+  LockGuard lock(mMutex);
+  mWeights[tenant] = weight;
+  const auto where = mLanes.find(tenant);
+  if (where != mLanes.end())
+    where->second.weight = weight;
+}
+
+template <class N, class T, class H, class E>
+template <class... Args>
+void FairSafeQueue<N, T, H, E>::Emplace(const tenant_type &tenant,
+                                        Args &&... args) {
+  {
+    LockGuard lock(mMutex);
+    auto where = mLanes.find(tenant);
+    if (where == mLanes.end()) {
+      const auto weight = mWeights.find(tenant);
+      where = mLanes.emplace(tenant, Lane()).first;
+      where->second.weight =
+          weight == mWeights.end() ? mDefaultWeight : weight->second;
+      mActive.push_back(&*where);
+    }
+    where->second.items.emplace_back(std::forward<Args>(args)...);
+    ++mSize;
+    ++mUnfinishedTasks;
+  }
+  mNotEmpty.notify_one();
+}
+
+template <class N, class T, class H, class E>
+void FairSafeQueue<N, T, H, E>::Push(const tenant_type &tenant,
+                                     const_reference item) {
+  Emplace(tenant, item);
+}
+
+template <class N, class T, class H, class E>
+void FairSafeQueue<N, T, H, E>::Push(const tenant_type &tenant,
+                                     value_type &&item) {
+  Emplace(tenant, std::move(item));
+}
+
+template <class N, class T, class H, class E>
+typename FairSafeQueue<N, T, H, E>::value_type
+FairSafeQueue<N, T, H, E>::TakeFront() {
+  auto *entry = mActive.front();
+  auto &lane = entry->second;
+  if (lane.deficit == 0)
+    lane.deficit = lane.weight; // A new turn.
+  auto item = std::move(lane.items.front());
+  lane.items.pop_front();
+  --lane.deficit;
+  --mSize;
+  if (lane.items.empty()) {
+    // An idle tenant keeps no credit, and leaves the ring until its next push.
+    mActive.pop_front();
+    mLanes.erase(mLanes.find(entry->first));
+  } else if (lane.deficit == 0) {
+    mActive.pop_front();
+    mActive.push_back(entry);
+  }
+  return item;
+}
+
+template <class N, class T, class H, class E>
+typename FairSafeQueue<N, T, H, E>::value_type
+FairSafeQueue<N, T, H, E>::Pop() {
+  UniqueLock lock(mMutex);
+  mNotEmpty.wait(lock, [this]() { return !mActive.empty(); });
+  return TakeFront();
+}
+
+template <class N, class T, class H, class E>
+std::pair<typename FairSafeQueue<N, T, H, E>::value_type,
+          typename FairSafeQueue<N, T, H, E>::TaskDoneGuard>
+FairSafeQueue<N, T, H, E>::PopWithGuard() {
+  auto item = Pop();
+  return std::make_pair(std::move(item), TaskDoneGuard(this));
+}
+
+template <class N, class T, class H, class E>
+template <class Rep, class Period>
+typename FairSafeQueue<N, T, H, E>::value_type FairSafeQueue<N, T, H, E>::Pop(
+    const std::chrono::duration<Rep, Period> &timeout) {
+  UniqueLock lock(mMutex);
+  if (mNotEmpty.wait_for(lock, timeout, [this]() { return !mActive.empty(); }))
+    return TakeFront();
+  throw TimeoutError();
+}
+
+template <class N, class T, class H, class E>
+template <class Rep, class Period>
+std::pair<typename FairSafeQueue<N, T, H, E>::value_type,
+          typename FairSafeQueue<N, T, H, E>::TaskDoneGuard>
+FairSafeQueue<N, T, H, E>::PopWithGuard(
+    const std::chrono::duration<Rep, Period> &timeout) {
+  auto item = Pop(timeout);
+  return std::make_pair(std::move(item), TaskDoneGuard(this));
+}
+
+template <class N, class T, class H, class E>
+void FairSafeQueue<N, T, H, E>::TaskDone() {
+  LockGuard lock(mMutex);
+  assert(mUnfinishedTasks > 0 && "TaskDone() called too many times");
+  --mUnfinishedTasks;
+  if (mUnfinishedTasks == 0)
+    mAllTasksDone.notify_all();
+}
+
+template <class N, class T, class H, class E>
+void FairSafeQueue<N, T, H, E>::Join() {
+  UniqueLock lock(mMutex);
+  mAllTasksDone.wait(lock, [this]() { return mUnfinishedTasks == 0; });
+}
+
+template <class N, class T, class H, class E>
+typename FairSafeQueue<N, T, H, E>::size_type
+FairSafeQueue<N, T, H, E>::Size() {
+  LockGuard lock(mMutex);
+  return mSize;
+}
+
+template <class N, class T, class H, class E>
+typename FairSafeQueue<N, T, H, E>::size_type
+FairSafeQueue<N, T, H, E>::ActiveTenants() {
+  LockGuard lock(mMutex);
+  return mActive.size();
+}
+
+} // namespace rwols
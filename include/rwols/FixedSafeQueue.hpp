@@ -0,0 +1,419 @@
+///\file    FixedSafeQueue.hpp
+///\brief   Thread-safe bounded queue with compile-time capacity
+///\author  Raoul Wols
+///\date    October, 2026
+
+#pragma once
+
+#include <rwols/SafeQueue.hpp>
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+
+namespace rwols {
+
+/// Default storage for a FixedSafeQueue: the slots are a member array.
+template <class Slot, std::size_t N> class InlineStorage final {
+public:
+  Slot *data() noexcept { return mSlots.data(); }
+
+private:
+  std::array<Slot, N> mSlots;
+};
+
+/// What a FixedSafeQueue does with a push while it is full.
+enum class Overflow {
+  Block,      ///< Wait for a free slot.
+  Reject,     ///< Turn the new item away.
+  DropOldest, ///< Drop the item at the front to make room.
+  DropNewest, ///< Drop the item at the back to make room.
+  Evict,      ///< Drop the oldest item the evict predicate selects; if there
+              ///< is none, turn the new item away.
+};
+
+/// How often each overflow policy kicked in, since construction.
+struct OverflowStats {
+  std::uint64_t blocked = 0;  ///< Pushes that waited for a free slot.
+  std::uint64_t rejected = 0; ///< Items turned away.
+  std::uint64_t droppedOldest = 0;
+  std::uint64_t droppedNewest = 0;
+  std::uint64_t evicted = 0;
+};
+
+/// A bounded SafeQueue with N slots. With the default InlineStorage the slots
+/// live inside the object itself. There is no heap allocation at all, so the
+/// queue can live on the stack or inside another object. Other storage
+/// policies, such as HugePageStorage, provide data() for N slots in some other
+/// way. N must be a power of two so that slot indices are a single mask.
+/// By default Push blocks while the queue is full and TryPush returns false
+/// instead. A producer that must never stall picks another Overflow policy:
+/// \code
+///   rwols::FixedSafeQueue<Sample, 4096> q(rwols::Overflow::DropOldest);
+///   q.Push(sample); // never blocks; may drop the oldest sample
+///   q.Stats().droppedOldest;
+/// \endcode
+/// Push and TryPush return false when the new item was turned away; so does
+/// PushAndJoin, without joining. A dropped item is destroyed without being
+/// popped, and needs no TaskDone(). A TaskDone() does not say which item it
+/// finishes, so under DropOldest, DropNewest and Evict it may only finish a
+/// popped item: a producer that calls TaskDone() for a queued item could have
+/// that item dropped and counted twice. There, a TaskDone() while no popped
+/// item is unfinished throws std::logic_error.
+template <class T, std::size_t N,
+          template <class, std::size_t> class Storage = InlineStorage>
+class FixedSafeQueue final {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "N must be a power of two");
+
+public:
+  using value_type = T;
+  using size_type = std::size_t;
+  using reference = value_type &;
+  using const_reference = const value_type &;
+  using slot_type = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+  using storage_type = Storage<slot_type, N>;
+
+  struct TaskDoneGuard {
+    TaskDoneGuard(const TaskDoneGuard &) = delete;
+    TaskDoneGuard(TaskDoneGuard &&);
+    TaskDoneGuard &operator=(const TaskDoneGuard &) = delete;
+    TaskDoneGuard &operator=(TaskDoneGuard &&);
+    ~TaskDoneGuard() noexcept(false);
+
+  private:
+    FixedSafeQueue *mQ = nullptr;
+    TaskDoneGuard(FixedSafeQueue *);
+    friend class FixedSafeQueue;
+  };
+
+  using Evict = std::function<bool(const_reference)>;
+
+  FixedSafeQueue() = default;
+  /// With Overflow::Evict, `evict` chooses which queued item may go.
+  explicit FixedSafeQueue(Overflow overflow, Evict evict = Evict());
+  FixedSafeQueue(const FixedSafeQueue &) = delete;
+  FixedSafeQueue &operator=(const FixedSafeQueue &) = delete;
+  ~FixedSafeQueue();
+
+  static constexpr size_type capacity() noexcept { return N; }
+  const storage_type &storage() const noexcept { return mStorage; }
+
+  bool Push(const_reference item);
+  bool Push(value_type &&item);
+  bool TryPush(const_reference item);
+  bool TryPush(value_type &&item);
+  bool PushAndJoin(const_reference item);
+  bool PushAndJoin(value_type &&item);
+
+  template <class... Args> bool Emplace(Args &&... args);
+  template <class... Args> bool TryEmplace(Args &&... args);
+  template <class... Args> bool EmplaceAndJoin(Args &&... args);
+
+  value_type Pop();
+  std::pair<value_type, TaskDoneGuard> PopWithGuard();
+  template <class Rep, class Period>
+  value_type Pop(const std::chrono::duration<Rep, Period> &timeout);
+  template <class Rep, class Period>
+  std::pair<value_type, TaskDoneGuard>
+  PopWithGuard(const std::chrono::duration<Rep, Period> &timeout);
+
+  void TaskDone();
+
+  void Join();
+
+  OverflowStats Stats();
+
+private:
+  using UniqueLock = std::unique_lock<std::mutex>;
+  using LockGuard = std::lock_guard<std::mutex>;
+
+  static constexpr size_type kMask = N - 1;
+
+  std::mutex mMutex;
+  std::condition_variable mNotEmpty, mNotFull, mAllTasksDone;
+  size_type mHead = 0; // Next slot to pop; only ever incremented.
+  size_type mTail = 0; // Next slot to push; only ever incremented.
+  std::size_t mUnfinishedTasks = 0;
+  Overflow mOverflow = Overflow::Block;
+  Evict mEvict;
+  OverflowStats mStats;
+  storage_type mStorage;
+
+  value_type *At(size_type index) noexcept;
+  bool Full() const noexcept { return mTail - mHead == N; }
+  bool Empty() const noexcept { return mTail == mHead; }
+  bool Drops() const noexcept {
+    return mOverflow != Overflow::Block && mOverflow != Overflow::Reject;
+  }
+  template <class... Args> void EmplaceBack(Args &&... args);
+  value_type TakeFront();
+  bool MakeRoom(UniqueLock &lock, bool mayBlock);
+  void Drop(size_type index);
+  void DropTask();
+};
+
+// Implementation follows.
+
+template <class T, std::size_t N, template <class, std::size_t> class S>
+FixedSafeQueue<T, N, S>::TaskDoneGuard::TaskDoneGuard(TaskDoneGuard &&other)
+    : mQ(other.mQ) {
+  other.mQ = nullptr;
+}
+
+template <class T, std::size_t N, template <class, std::size_t> class S>
+typename FixedSafeQueue<T, N, S>::TaskDoneGuard &
+FixedSafeQueue<T, N, S>::TaskDoneGuard::operator=(TaskDoneGuard &&other) {
+  mQ = other.mQ;
+  other.mQ = nullptr;
+  return *this;
+}
+
+template <class T, std::size_t N, template <class, std::size_t> class S>
+FixedSafeQueue<T, N, S>::TaskDoneGuard::TaskDoneGuard(FixedSafeQueue *q)
+    : mQ(q) {}
+
+template <class T, std::size_t N, template <class, std::size_t> class S>
+FixedSafeQueue<T, N, S>::TaskDoneGuard::~TaskDoneGuard() noexcept(false) {
+  if (mQ)
+    mQ->TaskDone();
+}
+
+template <class T, std::size_t N, template <class, std::size_t> class S>
+FixedSafeQueue<T, N, S>::FixedSafeQueue(Overflow overflow, Evict evict)
+    : mOverflow(overflow), mEvict(std::move(evict)) {
+  if (overflow == Overflow::Evict && !mEvict)
+    throw std::invalid_argument("Overflow::Evict needs an evict predicate");
+}
+
+template <class T, std::size_t N, template <class, std::size_t> class S>
+FixedSafeQueue<T, N, S>::~FixedSafeQueue() {
+  Join();
+  assert(mUnfinishedTasks == 0 && "Expected all tasks to be finished");
+  // TaskDone() may have been called by a producer for items that were never
+  // popped; those still need to be destroyed.
+  for (; mHead != mTail; ++mHead)
+    At(mHead)->~value_type();
+}
+
+template <class T, std::size_t N, template <class, std::size_t> class S>
+typename FixedSafeQueue<T, N, S>::value_type *
+FixedSafeQueue<T, N, S>::At(size_type index) noexcept {
+  return reinterpret_cast<value_type *>(mStorage.data() + (index & kMask));
+}
+
+template <class T, std::size_t N, template <class, std::size_t> class S>
+template <class... Args>
+void FixedSafeQueue<T, N, S>::EmplaceBack(Args &&... args) {
+  ::new (static_cast<void *>(At(mTail)))
+      value_type(std::forward<Args>(args)...);
+  ++mTail;
+  ++mUnfinishedTasks;
+}
+
+template <class T, std::size_t N, template <class, std::size_t> class S>
+typename FixedSafeQueue<T, N, S>::value_type
+FixedSafeQueue<T, N, S>::TakeFront() {
+  auto *slot = At(mHead);
+  auto item = std::move(*slot);
+  slot->~value_type();
+  ++mHead;
+  return item;
+}
+
+template <class T, std::size_t N, template <class, std::size_t> class S>
+void FixedSafeQueue<T, N, S>::Drop(size_type index) {
+  // Shift the older items up by one slot to close the gap.
+  At(index)->~value_type();
+  for (; index != mHead; --index) {
+    ::new (static_cast<void *>(At(index)))
+        value_type(std::move(*At(index - 1)));
+    At(index - 1)->~value_type();
+  }
+  ++mHead;
+  DropTask();
+}
+
+template <class T, std::size_t N, template <class, std::size_t> class S>
+void FixedSafeQueue<T, N, S>::DropTask() {
+  // TaskDone() only finishes popped items here, so every queued item, the
+  // dropped one included, still holds its own task.
+  assert(mUnfinishedTasks > mTail - mHead && "Dropped an item without a task");
+  if (--mUnfinishedTasks == 0)
+    mAllTasksDone.notify_all();
+}
+
+template <class T, std::size_t N, template <class, std::size_t> class S>
+bool FixedSafeQueue<T, N, S>::MakeRoom(UniqueLock &lock, bool mayBlock) {
+  if (!Full())
+    return true;
+  switch (mOverflow) {
+  case Overflow::Block:
+    if (!mayBlock)
+      break;
+    ++mStats.blocked;
+    mNotFull.wait(lock, [this]() { return !Full(); });
+    return true;
+  case Overflow::Reject:
+    break;
+  case Overflow::DropOldest:
+    Drop(mHead);
+    ++mStats.droppedOldest;
+    return true;
+  case Overflow::DropNewest:
+    At(--mTail)->~value_type();
+    DropTask();
+    ++mStats.droppedNewest;
+    return true;
+  case Overflow::Evict:
+    for (auto index = mHead; index != mTail; ++index) {
+      if (mEvict(*At(index))) {
+        Drop(index);
+        ++mStats.evicted;
+        return true;
+      }
+    }
+    break;
+  }
+  ++mStats.rejected;
+  return false;
+}
+
+template <class T, std::size_t N, template <class, std::size_t> class S>
+bool FixedSafeQueue<T, N, S>::Push(const_reference item) {
+  return Emplace(item);
+}
+
+template <class T, std::size_t N, template <class, std::size_t> class S>
+bool FixedSafeQueue<T, N, S>::Push(value_type &&item) {
+  return Emplace(std::move(item));
+}
+
+template <class T, std::size_t N, template <class, std::size_t> class S>
+bool FixedSafeQueue<T, N, S>::TryPush(const_reference item) {
+  return TryEmplace(item);
+}
+
+template <class T, std::size_t N, template <class, std::size_t> class S>
+bool FixedSafeQueue<T, N, S>::TryPush(value_type &&item) {
+  return TryEmplace(std::move(item));
+}
+
+template <class T, std::size_t N, template <class, std::size_t> class S>
+bool FixedSafeQueue<T, N, S>::PushAndJoin(const_reference item) {
+  return EmplaceAndJoin(item);
+}
+
+template <class T, std::size_t N, template <class, std::size_t> class S>
+bool FixedSafeQueue<T, N, S>::PushAndJoin(value_type &&item) {
+  return EmplaceAndJoin(std::move(item));
+}
+
+template <class T, std::size_t N, template <class, std::size_t> class S>
+template <class... Args>
+bool FixedSafeQueue<T, N, S>::Emplace(Args &&... args) {
+  {
+    UniqueLock lock(mMutex);
+    if (!MakeRoom(lock, true))
+      return false;
+    EmplaceBack(std::forward<Args>(args)...);
+  }
+  mNotEmpty.notify_one();
+  return true;
+}
+
+template <class T, std::size_t N, template <class, std::size_t> class S>
+template <class... Args>
+bool FixedSafeQueue<T, N, S>::TryEmplace(Args &&... args) {
+  {
+    UniqueLock lock(mMutex);
+    if (!MakeRoom(lock, false))
+      return false;
+    EmplaceBack(std::forward<Args>(args)...);
+  }
+  mNotEmpty.notify_one();
+  return true;
+}
+
+template <class T, std::size_t N, template <class, std::size_t> class S>
+template <class... Args>
+bool FixedSafeQueue<T, N, S>::EmplaceAndJoin(Args &&... args) {
+  UniqueLock lock(mMutex);
+  if (!MakeRoom(lock, true))
+    return false;
+  EmplaceBack(std::forward<Args>(args)...);
+  mNotEmpty.notify_one();
+  mAllTasksDone.wait(lock, [this]() { return mUnfinishedTasks == 0; });
+  return true;
+}
+
+template <class T, std::size_t N, template <class, std::size_t> class S>
+typename FixedSafeQueue<T, N, S>::value_type FixedSafeQueue<T, N, S>::Pop() {
+  UniqueLock lock(mMutex);
+  mNotEmpty.wait(lock, [this]() { return !Empty(); });
+  auto item = TakeFront();
+  lock.unlock();
+  mNotFull.notify_one();
+  return item;
+}
+
+template <class T, std::size_t N, template <class, std::size_t> class S>
+std::pair<typename FixedSafeQueue<T, N, S>::value_type,
+          typename FixedSafeQueue<T, N, S>::TaskDoneGuard>
+FixedSafeQueue<T, N, S>::PopWithGuard() {
+  auto item = Pop();
+  return std::make_pair(std::move(item), TaskDoneGuard(this));
+}
+
+template <class T, std::size_t N, template <class, std::size_t> class S>
+template <class Rep, class Period>
+typename FixedSafeQueue<T, N, S>::value_type
+FixedSafeQueue<T, N, S>::Pop(
+    const std::chrono::duration<Rep, Period> &timeout) {
+  UniqueLock lock(mMutex);
+  if (mNotEmpty.wait_for(lock, timeout, [this]() { return !Empty(); })) {
+    auto item = TakeFront();
+    lock.unlock();
+    mNotFull.notify_one();
+    return item;
+  }
+  throw TimeoutError();
+}
+
+template <class T, std::size_t N, template <class, std::size_t> class S>
+template <class Rep, class Period>
+std::pair<typename FixedSafeQueue<T, N, S>::value_type,
+          typename FixedSafeQueue<T, N, S>::TaskDoneGuard>
+FixedSafeQueue<T, N, S>::PopWithGuard(
+    const std::chrono::duration<Rep, Period> &timeout) {
+  auto item = Pop(timeout);
+  return std::make_pair(std::move(item), TaskDoneGuard(this));
+}
+
+template <class T, std::size_t N, template <class, std::size_t> class S>
+void FixedSafeQueue<T, N, S>::TaskDone() {
+  LockGuard lock(mMutex);
+  if (Drops() && mUnfinishedTasks <= mTail - mHead)
+    throw std::logic_error(
+        "TaskDone() for a queued item under a dropping overflow policy");
+  assert(mUnfinishedTasks > 0 && "TaskDone() called too many times");
+  --mUnfinishedTasks;
+  if (mUnfinishedTasks == 0)
+    mAllTasksDone.notify_all();
+}
+
+template <class T, std::size_t N, template <class, std::size_t> class S>
+void FixedSafeQueue<T, N, S>::Join() {
+  UniqueLock lock(mMutex);
+  mAllTasksDone.wait(lock, [this]() { return mUnfinishedTasks == 0; });
+}
+
+template <class T, std::size_t N, template <class, std::size_t> class S>
+OverflowStats FixedSafeQueue<T, N, S>::Stats() {
+  LockGuard lock(mMutex);
+  return mStats;
+}
+
+} // namespace rwols
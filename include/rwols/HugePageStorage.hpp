@@ -0,0 +1,128 @@
+///\file    HugePageStorage.hpp
+///\brief   Huge-page backed slot storage for FixedSafeQueue
+///\author  Raoul Wols
+///\date    October, 2026
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <string>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace rwols {
+
+enum class PageKind {
+  Huge,        ///< Explicit huge pages from the hugetlbfs pool.
+  Transparent, ///< Normal mapping with a transparent huge page hint.
+  Normal       ///< Regular pages; no huge pages were available.
+};
+
+/// Size of a default huge page according to /proc/meminfo, or 2 MiB.
+inline std::size_t HugePageSize() {
+  std::ifstream meminfo("/proc/meminfo");
+  std::string key;
+  std::size_t kilobytes = 0;
+  while (meminfo >> key) {
+    if (key == "Hugepagesize:" && meminfo >> kilobytes)
+      return kilobytes * 1024;
+    meminfo.ignore(256, '\n');
+  }
+  return std::size_t(2) << 20;
+}
+
+/// Storage policy for FixedSafeQueue that maps its slots on huge pages, so
+/// that a large ring needs only a handful of TLB entries:
+/// \code
+///   rwols::FixedSafeQueue<BigThing, 4096, rwols::HugePageStorage> q;
+/// \endcode
+/// It tries MAP_HUGETLB first. When the hugetlbfs pool is empty it makes a
+/// huge-page aligned mapping with madvise(MADV_HUGEPAGE). Where that is not
+/// supported either it uses regular pages. Kind() tells which one it got.
+template <class Slot, std::size_t N> class HugePageStorage final {
+public:
+  HugePageStorage();
+  HugePageStorage(const HugePageStorage &) = delete;
+  HugePageStorage &operator=(const HugePageStorage &) = delete;
+  ~HugePageStorage();
+
+  Slot *data() noexcept { return static_cast<Slot *>(mData); }
+  PageKind Kind() const noexcept { return mKind; }
+
+private:
+  void *mMapping = nullptr;
+  std::size_t mLength = 0;
+  void *mData = nullptr;
+  PageKind mKind = PageKind::Normal;
+};
+
+// Implementation follows.
+
+template <class Slot, std::size_t N>
+HugePageStorage<Slot, N>::HugePageStorage() {
+  constexpr std::size_t bytes = sizeof(Slot) * N;
+#if defined(__linux__)
+  const auto pageSize = HugePageSize();
+  const auto rounded = (bytes + pageSize - 1) / pageSize * pageSize;
+  const int protection = PROT_READ | PROT_WRITE;
+#if defined(MAP_HUGETLB)
+  mMapping = ::mmap(nullptr, rounded, protection,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (mMapping != MAP_FAILED) {
+    mLength = rounded;
+    mData = mMapping;
+    mKind = PageKind::Huge;
+    return;
+  }
+#endif
+  // Over-map by one huge page so that the slots can start on a huge page
+  // boundary; transparent huge pages only back aligned ranges.
+  mLength = rounded + pageSize;
+  mMapping = ::mmap(nullptr, mLength, protection, MAP_PRIVATE | MAP_ANONYMOUS,
+                    -1, 0);
+  if (mMapping == MAP_FAILED) {
+    mMapping = nullptr;
+    throw std::bad_alloc();
+  }
+  const auto address = reinterpret_cast<std::uintptr_t>(mMapping);
+  const auto aligned = (address + pageSize - 1) / pageSize * pageSize;
+  mData = reinterpret_cast<void *>(aligned);
+#if defined(MADV_HUGEPAGE)
+  if (::madvise(mData, rounded, MADV_HUGEPAGE) == 0)
+    mKind = PageKind::Transparent;
+#endif
+#elif defined(__cpp_aligned_new)
+  mMapping = ::operator new(bytes, std::align_val_t(alignof(Slot)));
+  mLength = bytes;
+  mData = mMapping;
+#else
+  // Over-allocate so that the slots can start on a slot boundary, which
+  // plain operator new only guarantees up to alignof(std::max_align_t).
+  mLength = bytes + alignof(Slot) - 1;
+  mMapping = ::operator new(mLength);
+  const auto address = reinterpret_cast<std::uintptr_t>(mMapping);
+  const auto aligned = (address + alignof(Slot) - 1) / alignof(Slot) *
+                       alignof(Slot);
+  mData = reinterpret_cast<void *>(aligned);
+#endif
+}
+
+template <class Slot, std::size_t N>
+HugePageStorage<Slot, N>::~HugePageStorage() {
+#if defined(__linux__)
+  if (mMapping)
+    ::munmap(mMapping, mLength);
+#elif defined(__cpp_aligned_new)
+  ::operator delete(mMapping, std::align_val_t(alignof(Slot)));
+#else
+  ::operator delete(mMapping);
+#endif
+}
+
+} // namespace rwols
@@ -0,0 +1,294 @@
+///\file    IntrusiveSafeQueue.hpp
+///\brief   Thread-safe queues that link caller-owned nodes
+///\author  Raoul Wols
+///\date    October, 2026
+
+#pragma once
+
+#include <rwols/SafeQueue.hpp>
+
+#include <atomic>
+#include <cstddef>
+
+namespace rwols {
+
+/// Embed one of these in your message type to make it linkable into an
+/// IntrusiveSafeQueue. A node can be in at most one queue per hook. The queue
+/// never owns the node: it must stay alive until it has been popped.
+struct IntrusiveHook {
+  void *next = nullptr;
+};
+
+/// The hook for an IntrusiveMpscQueue. Producers link through it with atomic
+/// stores, so it is kept apart from the plain IntrusiveHook. A type may embed
+/// both kinds of hook, or several of one kind, to sit in several queues.
+struct IntrusiveMpscHook {
+  std::atomic<void *> next{nullptr};
+};
+
+/// Multi-producer multi-consumer queue of caller-owned nodes. Push and Pop
+/// relink a single pointer under the mutex and never allocate. Hook names the
+/// IntrusiveHook member that links the nodes.
+template <class T, IntrusiveHook T::*Hook> class IntrusiveSafeQueue final {
+public:
+  using value_type = T;
+
+  ~IntrusiveSafeQueue();
+
+  void Push(value_type &item);
+
+  value_type &Pop();
+  value_type *TryPop();
+  template <class Rep, class Period>
+  value_type &Pop(const std::chrono::duration<Rep, Period> &timeout);
+
+  void TaskDone();
+
+  void Join();
+
+private:
+  std::mutex mMutex;
+  std::condition_variable mNotEmpty, mAllTasksDone;
+  value_type *mFront = nullptr;
+  value_type *mBack = nullptr;
+  std::size_t mUnfinishedTasks = 0;
+
+  value_type &Unlink();
+
+  using UniqueLock = std::unique_lock<std::mutex>;
+  using LockGuard = std::lock_guard<std::mutex>;
+};
+
+/// Many-producers single-consumer queue of caller-owned nodes after Dmitry
+/// Vyukov's intrusive MPSC design. Push is wait-free: one atomic exchange and
+/// one store. Pop, TryPop and the timed Pop must only ever be called from one
+/// consumer thread at a time. The mutex is only touched when the consumer has
+/// to go to sleep, or when a producer must wake it. Hook names the
+/// IntrusiveMpscHook member that links the nodes.
+template <class T, IntrusiveMpscHook T::*Hook> class IntrusiveMpscQueue final {
+public:
+  using value_type = T;
+
+  IntrusiveMpscQueue();
+  ~IntrusiveMpscQueue();
+
+  void Push(value_type &item);
+
+  value_type &Pop();
+  value_type *TryPop();
+  template <class Rep, class Period>
+  value_type &Pop(const std::chrono::duration<Rep, Period> &timeout);
+
+  void TaskDone();
+
+  void Join();
+
+private:
+  // The list links void pointers: each one is either a T * or &mStub.
+  IntrusiveMpscHook mStub;
+  std::atomic<void *> mBack; // Producers exchange here.
+  void *mFront;              // Only the consumer touches this.
+  std::atomic<bool> mSleeping{false};
+  std::atomic<std::size_t> mUnfinishedTasks{0};
+  std::mutex mMutex;
+  std::condition_variable mNotEmpty, mAllTasksDone;
+
+  IntrusiveMpscHook &HookOf(void *node) noexcept;
+  void Link(void *node);
+  void WakeConsumer();
+
+  using UniqueLock = std::unique_lock<std::mutex>;
+  using LockGuard = std::lock_guard<std::mutex>;
+};
+
+// Implementation follows.
+
+template <class T, IntrusiveHook T::*Hook>
+IntrusiveSafeQueue<T, Hook>::~IntrusiveSafeQueue() {
+  Join();
+  assert(mUnfinishedTasks == 0 && "Expected all tasks to be finished");
+}
+
+template <class T, IntrusiveHook T::*Hook>
+void IntrusiveSafeQueue<T, Hook>::Push(value_type &item) {
+  (item.*Hook).next = nullptr;
+  {
+    LockGuard lock(mMutex);
+    if (mBack)
+      (mBack->*Hook).next = &item;
+    else
+      mFront = &item;
+    mBack = &item;
+    ++mUnfinishedTasks;
+  }
+  mNotEmpty.notify_one();
+}
+
+template <class T, IntrusiveHook T::*Hook>
+typename IntrusiveSafeQueue<T, Hook>::value_type &IntrusiveSafeQueue<T, Hook>::Unlink() {
+  auto *item = mFront;
+  mFront = static_cast<value_type *>((item->*Hook).next);
+  if (!mFront)
+    mBack = nullptr;
+  return *item;
+}
+
+template <class T, IntrusiveHook T::*Hook>
+typename IntrusiveSafeQueue<T, Hook>::value_type &IntrusiveSafeQueue<T, Hook>::Pop() {
+  UniqueLock lock(mMutex);
+  mNotEmpty.wait(lock, [this]() { return mFront != nullptr; });
+  return Unlink();
+}
+
+template <class T, IntrusiveHook T::*Hook>
+typename IntrusiveSafeQueue<T, Hook>::value_type *IntrusiveSafeQueue<T, Hook>::TryPop() {
+  LockGuard lock(mMutex);
+  return mFront ? &Unlink() : nullptr;
+}
+
+template <class T, IntrusiveHook T::*Hook>
+template <class Rep, class Period>
+typename IntrusiveSafeQueue<T, Hook>::value_type &
+IntrusiveSafeQueue<T, Hook>::Pop(const std::chrono::duration<Rep, Period> &timeout) {
+  UniqueLock lock(mMutex);
+  if (mNotEmpty.wait_for(lock, timeout, [this]() { return mFront != nullptr; }))
+    return Unlink();
+  throw TimeoutError();
+}
+
+template <class T, IntrusiveHook T::*Hook>
+void IntrusiveSafeQueue<T, Hook>::TaskDone() {
+  LockGuard lock(mMutex);
+  assert(mUnfinishedTasks > 0 && "TaskDone() called too many times");
+  --mUnfinishedTasks;
+  if (mUnfinishedTasks == 0)
+    mAllTasksDone.notify_all();
+}
+
+template <class T, IntrusiveHook T::*Hook>
+void IntrusiveSafeQueue<T, Hook>::Join() {
+  UniqueLock lock(mMutex);
+  mAllTasksDone.wait(lock, [this]() { return mUnfinishedTasks == 0; });
+}
+
+template <class T, IntrusiveMpscHook T::*Hook>
+IntrusiveMpscQueue<T, Hook>::IntrusiveMpscQueue()
+    : mBack(&mStub), mFront(&mStub) {}
+
+template <class T, IntrusiveMpscHook T::*Hook>
+IntrusiveMpscQueue<T, Hook>::~IntrusiveMpscQueue() {
+  Join();
+  assert(mUnfinishedTasks.load(std::memory_order_relaxed) == 0 &&
+         "Expected all tasks to be finished");
+}
+
+template <class T, IntrusiveMpscHook T::*Hook>
+IntrusiveMpscHook &IntrusiveMpscQueue<T, Hook>::HookOf(void *node) noexcept {
+  return node == &mStub ? mStub : static_cast<value_type *>(node)->*Hook;
+}
+
+template <class T, IntrusiveMpscHook T::*Hook>
+void IntrusiveMpscQueue<T, Hook>::Link(void *node) {
+  HookOf(node).next.store(nullptr, std::memory_order_relaxed);
+  auto *prev = mBack.exchange(node, std::memory_order_acq_rel);
+  // Between the exchange and this store the list is briefly disconnected;
+  // TryPop reports "empty" during that window.
+  HookOf(prev).next.store(node, std::memory_order_release);
+}
+
+template <class T, IntrusiveMpscHook T::*Hook>
+void IntrusiveMpscQueue<T, Hook>::WakeConsumer() {
+  // Pairs with the fence in Pop(): either the consumer sees our link, or we
+  // see that it is (about to be) asleep.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (mSleeping.load(std::memory_order_relaxed)) {
+    { LockGuard lock(mMutex); }
+    mNotEmpty.notify_one();
+  }
+}
+
+template <class T, IntrusiveMpscHook T::*Hook>
+void IntrusiveMpscQueue<T, Hook>::Push(value_type &item) {
+  mUnfinishedTasks.fetch_add(1, std::memory_order_relaxed);
+  Link(&item);
+  WakeConsumer();
+}
+
+template <class T, IntrusiveMpscHook T::*Hook>
+typename IntrusiveMpscQueue<T, Hook>::value_type *IntrusiveMpscQueue<T, Hook>::TryPop() {
+  auto *front = mFront;
+  auto *next = HookOf(front).next.load(std::memory_order_acquire);
+  if (front == &mStub) {
+    if (!next)
+      return nullptr;
+    mFront = next;
+    front = next;
+    next = HookOf(next).next.load(std::memory_order_acquire);
+  }
+  if (next) {
+    mFront = next;
+    return static_cast<value_type *>(front);
+  }
+  if (front != mBack.load(std::memory_order_acquire))
+    return nullptr; // A producer is in the middle of Link().
+  Link(&mStub);
+  next = HookOf(front).next.load(std::memory_order_acquire);
+  if (next) {
+    mFront = next;
+    return static_cast<value_type *>(front);
+  }
+  return nullptr;
+}
+
+template <class T, IntrusiveMpscHook T::*Hook>
+typename IntrusiveMpscQueue<T, Hook>::value_type &IntrusiveMpscQueue<T, Hook>::Pop() {
+  if (auto *item = TryPop())
+    return *item;
+  UniqueLock lock(mMutex);
+  value_type *item = nullptr;
+  mSleeping.store(true, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  mNotEmpty.wait(lock, [&]() { return (item = TryPop()) != nullptr; });
+  mSleeping.store(false, std::memory_order_relaxed);
+  return *item;
+}
+
+template <class T, IntrusiveMpscHook T::*Hook>
+template <class Rep, class Period>
+typename IntrusiveMpscQueue<T, Hook>::value_type &
+IntrusiveMpscQueue<T, Hook>::Pop(const std::chrono::duration<Rep, Period> &timeout) {
+  if (auto *item = TryPop())
+    return *item;
+  UniqueLock lock(mMutex);
+  value_type *item = nullptr;
+  mSleeping.store(true, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  mNotEmpty.wait_for(lock, timeout,
+                     [&]() { return (item = TryPop()) != nullptr; });
+  mSleeping.store(false, std::memory_order_relaxed);
+  if (item)
+    return *item;
+  throw TimeoutError();
+}
+
+template <class T, IntrusiveMpscHook T::*Hook>
+void IntrusiveMpscQueue<T, Hook>::TaskDone() {
+  const auto previous =
+      mUnfinishedTasks.fetch_sub(1, std::memory_order_acq_rel);
+  assert(previous > 0 && "TaskDone() called too many times");
+  (void)previous;
+  if (previous == 1) {
+    { LockGuard lock(mMutex); }
+    mAllTasksDone.notify_all();
+  }
+}
+
+template <class T, IntrusiveMpscHook T::*Hook>
+void IntrusiveMpscQueue<T, Hook>::Join() {
+  UniqueLock lock(mMutex);
+  mAllTasksDone.wait(lock, [this]() {
+    return mUnfinishedTasks.load(std::memory_order_acquire) == 0;
+  });
+}
+
+} // namespace rwols
@@ -0,0 +1,250 @@
+///\file    KeyedSafeQueue.hpp
+///\brief   Thread-safe queue with per-key order and parallelism across keys
+///\author  Raoul Wols
+///\date    October, 2026
+
+#pragma once
+
+#include <rwols/SafeQueue.hpp>
+
+#include <cassert>
+#include <deque>
+#include <functional>
+#include <unordered_map>
+#include <utility>
+
+namespace rwols {
+
+/// A thread-safe queue of keyed items where the items of one key are
+/// processed one at a time and in order, while different keys are processed
+/// in parallel:
+/// \code
+///   rwols::KeyedSafeQueue<AccountId, Transaction> q;
+///   q.Push(account, transaction);
+///   // in each of several consumers:
+///   auto pair = q.PopWithGuard(); // pair.first is {account, transaction}
+/// \endcode
+/// A consumer that pops an item holds its key until TaskDone(key). Until then
+/// no other consumer gets an item of that key. Keys with items waiting take
+/// turns: a released key goes to the back of the line, so a hot key gets no
+/// more than its turn and never holds up the other keys. Join() waits for all
+/// items of all keys.
+template <class K, class T, class Hash = std::hash<K>,
+          class KeyEqual = std::equal_to<K>>
+class KeyedSafeQueue final {
+public:
+  using key_type = K;
+  using mapped_type = T;
+  using value_type = std::pair<key_type, mapped_type>;
+  using size_type = std::size_t;
+
+  struct TaskDoneGuard {
+    TaskDoneGuard(const TaskDoneGuard &) = delete;
+    TaskDoneGuard(TaskDoneGuard &&);
+    TaskDoneGuard &operator=(const TaskDoneGuard &) = delete;
+    TaskDoneGuard &operator=(TaskDoneGuard &&);
+    ~TaskDoneGuard() noexcept(false);
+
+  private:
+    KeyedSafeQueue *mQ = nullptr;
+    key_type mKey;
+    TaskDoneGuard(KeyedSafeQueue *, key_type);
+    friend class KeyedSafeQueue;
+  };
+
+  KeyedSafeQueue() = default;
+  ~KeyedSafeQueue();
+
+  void Push(const key_type &key, const mapped_type &item);
+  void Push(const key_type &key, mapped_type &&item);
+
+  /// Pops the oldest item of the next key that nobody holds, and holds that
+  /// key for the caller.
+  value_type Pop();
+  std::pair<value_type, TaskDoneGuard> PopWithGuard();
+  template <class Rep, class Period>
+  value_type Pop(const std::chrono::duration<Rep, Period> &timeout);
+  template <class Rep, class Period>
+  std::pair<value_type, TaskDoneGuard>
+  PopWithGuard(const std::chrono::duration<Rep, Period> &timeout);
+
+  /// Finishes the popped item of `key` and lets others pop that key again.
+  void TaskDone(const key_type &key);
+
+  void Join();
+
+  /// Items waiting, over all keys.
+  size_type Size();
+
+private:
+  using UniqueLock = std::unique_lock<std::mutex>;
+  using LockGuard = std::lock_guard<std::mutex>;
+
+  struct Lane {
+    std::deque<mapped_type> items;
+    bool held = false;
+  };
+
+  std::mutex mMutex;
+  std::condition_variable mNotEmpty, mAllTasksDone;
+  std::unordered_map<key_type, Lane, Hash, KeyEqual> mLanes;
+  std::deque<key_type> mReady; // Keys with items that nobody holds.
+  std::size_t mSize = 0;
+  std::size_t mUnfinishedTasks = 0;
+
+  template <class U> void PushImpl(const key_type &key, U &&item);
+  value_type TakeFront();
+};
+
+// Implementation follows.
+
+template <class K, class T, class H, class E>
+KeyedSafeQueue<K, T, H, E>::TaskDoneGuard::TaskDoneGuard(TaskDoneGuard &&other)
+    : mQ(other.mQ), mKey(std::move(other.mKey)) {
+  other.mQ = nullptr;
+}
+
+template <class K, class T, class H, class E>
+typename KeyedSafeQueue<K, T, H, E>::TaskDoneGuard &
+KeyedSafeQueue<K, T, H, E>::TaskDoneGuard::operator=(TaskDoneGuard &&other) {
+  mQ = other.mQ;
+  mKey = std::move(other.mKey);
+  other.mQ = nullptr;
+  return *this;
+}
+
+template <class K, class T, class H, class E>
+KeyedSafeQueue<K, T, H, E>::TaskDoneGuard::TaskDoneGuard(KeyedSafeQueue *q,
+                                                         key_type key)
+    : mQ(q), mKey(std::move(key)) {}
+
+template <class K, class T, class H, class E>
+KeyedSafeQueue<K, T, H, E>::TaskDoneGuard::~TaskDoneGuard() noexcept(false) {
+  if (mQ)
+    mQ->TaskDone(mKey);
+}
+
+template <class K, class T, class H, class E>
+KeyedSafeQueue<K, T, H, E>::~KeyedSafeQueue() {
+  Join();
+  assert(mUnfinishedTasks == 0 && "Expected all tasks to be finished");
+}
+
+template <class K, class T, class H, class E>
+template <class U>
+void KeyedSafeQueue<K, T, H, E>::PushImpl(const key_type &key, U &&item) {
+  {
+    LockGuard lock(mMutex);
+    auto &lane = mLanes[key];
+    lane.items.push_back(std::forward<U>(item));
+    ++mSize;
+    ++mUnfinishedTasks;
+    if (lane.held || lane.items.size() != 1)
+      return; // The key is in line already, or comes back on TaskDone().
+    mReady.push_back(key);
+  }
+  mNotEmpty.notify_one();
+}
+
+template <class K, class T, class H, class E>
+void KeyedSafeQueue<K, T, H, E>::Push(const key_type &key,
+                                      const mapped_type &item) {
+  PushImpl(key, item);
+}
+
+template <class K, class T, class H, class E>
+void KeyedSafeQueue<K, T, H, E>::Push(const key_type &key,
+                                      mapped_type &&item) {
+  PushImpl(key, std::move(item));
+}
+
+template <class K, class T, class H, class E>
+typename KeyedSafeQueue<K, T, H, E>::value_type
+KeyedSafeQueue<K, T, H, E>::TakeFront() {
+  auto key = std::move(mReady.front());
+  mReady.pop_front();
+  auto &lane = mLanes.find(key)->second;
+  lane.held = true;
+  value_type entry(std::move(key), std::move(lane.items.front()));
+  lane.items.pop_front();
+  --mSize;
+  return entry;
+}
+
+template <class K, class T, class H, class E>
+typename KeyedSafeQueue<K, T, H, E>::value_type
+KeyedSafeQueue<K, T, H, E>::Pop() {
+  UniqueLock lock(mMutex);
+  mNotEmpty.wait(lock, [this]() { return !mReady.empty(); });
+  return TakeFront();
+}
+
+template <class K, class T, class H, class E>
+std::pair<typename KeyedSafeQueue<K, T, H, E>::value_type,
+          typename KeyedSafeQueue<K, T, H, E>::TaskDoneGuard>
+KeyedSafeQueue<K, T, H, E>::PopWithGuard() {
+  auto entry = Pop();
+  TaskDoneGuard guard(this, entry.first);
+  return std::make_pair(std::move(entry), std::move(guard));
+}
+
+template <class K, class T, class H, class E>
+template <class Rep, class Period>
+typename KeyedSafeQueue<K, T, H, E>::value_type
+KeyedSafeQueue<K, T, H, E>::Pop(
+    const std::chrono::duration<Rep, Period> &timeout) {
+  UniqueLock lock(mMutex);
+  if (mNotEmpty.wait_for(lock, timeout, [this]() { return !mReady.empty(); }))
+    return TakeFront();
+  throw TimeoutError();
+}
+
+template <class K, class T, class H, class E>
+template <class Rep, class Period>
+std::pair<typename KeyedSafeQueue<K, T, H, E>::value_type,
+          typename KeyedSafeQueue<K, T, H, E>::TaskDoneGuard>
+KeyedSafeQueue<K, T, H, E>::PopWithGuard(
+    const std::chrono::duration<Rep, Period> &timeout) {
+  auto entry = Pop(timeout);
+  TaskDoneGuard guard(this, entry.first);
+  return std::make_pair(std::move(entry), std::move(guard));
+}
+
+template <class K, class T, class H, class E>
+void KeyedSafeQueue<K, T, H, E>::TaskDone(const key_type &key) {
+  bool ready = false;
+  {
+    LockGuard lock(mMutex);
+    assert(mUnfinishedTasks > 0 && "TaskDone() called too many times");
+    const auto where = mLanes.find(key);
+    assert(where != mLanes.end() && where->second.held &&
+           "TaskDone() for a key that is not held");
+    where->second.held = false;
+    if (where->second.items.empty()) {
+      mLanes.erase(where);
+    } else {
+      mReady.push_back(key);
+      ready = true;
+    }
+    --mUnfinishedTasks;
+    if (mUnfinishedTasks == 0)
+      mAllTasksDone.notify_all();
+  }
+  if (ready)
+    mNotEmpty.notify_one();
+}
+
+template <class K, class T, class H, class E>
+void KeyedSafeQueue<K, T, H, E>::Join() {
+  UniqueLock lock(mMutex);
+  mAllTasksDone.wait(lock, [this]() { return mUnfinishedTasks == 0; });
+}
+
+template <class K, class T, class H, class E>
+typename KeyedSafeQueue<K, T, H, E>::size_type
+KeyedSafeQueue<K, T, H, E>::Size() {
+  LockGuard lock(mMutex);
+  return mSize;
+}
+
+} // namespace rwols
@@ -0,0 +1,198 @@
+///\file    Locks.hpp
+///\brief   Spinning locks for short critical sections
+///\author  Raoul Wols
+///\date    October, 2026
+
+#pragma once
+
+#include <rwols/Sync.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+namespace rwols {
+
+namespace detail {
+
+/// Spins for a while, then gives up the CPU on every call: a lock holder that
+/// was preempted cannot release the lock while we burn its time slice.
+class SpinWait final {
+public:
+  void Once() noexcept {
+    if (mSpins < kYieldAfter) {
+      for (std::uint32_t i = 0; i < mBackoff; ++i)
+        CpuRelax();
+      if (mBackoff < kMaxBackoff)
+        mBackoff *= 2;
+      ++mSpins;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+
+private:
+  static constexpr std::uint32_t kMaxBackoff = 64;
+  static constexpr std::uint32_t kYieldAfter = 16;
+
+  std::uint32_t mBackoff = 1;
+  std::uint32_t mSpins = 0;
+};
+
+} // namespace detail
+
+/// A test-and-test-and-set spinlock. Waiters spin on a plain load, so they
+/// share the cache line until the lock is released, and back off
+/// exponentially after every failed attempt. Cheapest when critical sections
+/// are short and contention is low; not fair.
+class SpinLock final {
+public:
+  SpinLock() = default;
+  SpinLock(const SpinLock &) = delete;
+  SpinLock &operator=(const SpinLock &) = delete;
+
+  void lock() noexcept;
+  bool try_lock() noexcept;
+  void unlock() noexcept;
+
+private:
+  std::atomic<bool> mLocked{false};
+};
+
+/// A ticket lock: every thread draws a ticket and waits until it is served,
+/// so the lock is handed out in FIFO order. All waiters spin on the same
+/// cache line, which gets expensive with many cores.
+class TicketLock final {
+public:
+  TicketLock() = default;
+  TicketLock(const TicketLock &) = delete;
+  TicketLock &operator=(const TicketLock &) = delete;
+
+  void lock() noexcept;
+  bool try_lock() noexcept;
+  void unlock() noexcept;
+
+private:
+  std::atomic<std::uint32_t> mNext{0};
+  std::atomic<std::uint32_t> mServing{0};
+};
+
+/// A CLH queue lock: waiters form an implicit linked list, and each one spins
+/// on the node of the thread ahead of it. So the lock is FIFO, and every
+/// handover touches just one waiter's cache line. Nodes are recycled through
+/// a per-thread spare. There is no try_lock(): once a thread has joined the
+/// list it cannot leave before its turn.
+///
+/// Both FIFO locks hand the lock to the next waiter even when that thread is
+/// not running. With more threads than cores every handover can then cost a
+/// context switch; SpinLock and std::mutex do not have that problem.
+class ClhLock final {
+public:
+  ClhLock();
+  ClhLock(const ClhLock &) = delete;
+  ClhLock &operator=(const ClhLock &) = delete;
+  ~ClhLock();
+
+  void lock();
+  void unlock() noexcept;
+
+private:
+  struct Node {
+    std::atomic<bool> locked{false};
+  };
+  /// Keeps one free node per thread, and frees it when the thread exits.
+  struct Spare {
+    Node *node = nullptr;
+    ~Spare() { delete node; }
+  };
+
+  std::atomic<Node *> mTail;
+  // Only the holder touches these.
+  Node *mHolder = nullptr;
+  Node *mPredecessor = nullptr;
+
+  static Spare &ThreadSpare();
+};
+
+using SpinSync = BasicSync<SpinLock, FutexCondition>;
+using TicketSync = BasicSync<TicketLock, FutexCondition>;
+using ClhSync = BasicSync<ClhLock, FutexCondition>;
+
+// Implementation follows.
+
+inline void SpinLock::lock() noexcept {
+  detail::SpinWait wait;
+  while (true) {
+    if (!mLocked.exchange(true, std::memory_order_acquire))
+      return;
+    while (mLocked.load(std::memory_order_relaxed))
+      wait.Once();
+  }
+}
+
+inline bool SpinLock::try_lock() noexcept {
+  return !mLocked.load(std::memory_order_relaxed) &&
+         !mLocked.exchange(true, std::memory_order_acquire);
+}
+
+inline void SpinLock::unlock() noexcept {
+  mLocked.store(false, std::memory_order_release);
+}
+
+inline void TicketLock::lock() noexcept {
+  const auto ticket = mNext.fetch_add(1, std::memory_order_relaxed);
+  detail::SpinWait wait;
+  while (true) {
+    if (mServing.load(std::memory_order_acquire) == ticket)
+      return;
+    wait.Once();
+  }
+}
+
+inline bool TicketLock::try_lock() noexcept {
+  auto ticket = mServing.load(std::memory_order_acquire);
+  return mNext.compare_exchange_strong(ticket, ticket + 1,
+                                       std::memory_order_acquire,
+                                       std::memory_order_relaxed);
+}
+
+inline void TicketLock::unlock() noexcept {
+  mServing.store(mServing.load(std::memory_order_relaxed) + 1,
+                 std::memory_order_release);
+}
+
+inline ClhLock::ClhLock() : mTail(new Node) {}
+
+inline ClhLock::~ClhLock() { delete mTail.load(); }
+
+inline ClhLock::Spare &ClhLock::ThreadSpare() {
+  static thread_local Spare spare;
+  return spare;
+}
+
+inline void ClhLock::lock() {
+  auto &spare = ThreadSpare();
+  auto *node = spare.node ? spare.node : new Node;
+  spare.node = nullptr;
+  node->locked.store(true, std::memory_order_relaxed);
+  auto *predecessor = mTail.exchange(node, std::memory_order_acq_rel);
+  detail::SpinWait wait;
+  while (predecessor->locked.load(std::memory_order_acquire))
+    wait.Once();
+  mHolder = node;
+  mPredecessor = predecessor;
+}
+
+inline void ClhLock::unlock() noexcept {
+  auto *predecessor = mPredecessor;
+  // Our successor spins on our node from now on; the predecessor's node is
+  // nobody's business any more, so it becomes this thread's spare.
+  mHolder->locked.store(false, std::memory_order_release);
+  auto &spare = ThreadSpare();
+  if (spare.node)
+    delete predecessor; // Happens only when a thread holds several locks.
+  else
+    spare.node = predecessor;
+}
+
+} // namespace rwols
@@ -0,0 +1,361 @@
+///\file    NumaSafeQueue.hpp
+///\brief   Thread-safe queue with one lane per NUMA node
+///\author  Raoul Wols
+///\date    October, 2026
+
+#pragma once
+
+#include <rwols/SafeQueue.hpp>
+#include <rwols/detail/Maybe.hpp>
+
+#include <atomic>
+#include <cassert>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace rwols {
+
+/// Number of NUMA nodes in the system, or 1 when that cannot be determined.
+inline std::size_t NumaNodeCount() {
+  std::size_t count = 0;
+#if defined(__linux__)
+  if (auto *dir = ::opendir("/sys/devices/system/node")) {
+    while (auto *entry = ::readdir(dir)) {
+      const std::string name = entry->d_name;
+      if (name.size() > 4 && name.compare(0, 4, "node") == 0 &&
+          name.find_first_not_of("0123456789", 4) == std::string::npos)
+        ++count;
+    }
+    ::closedir(dir);
+  }
+#endif
+  return count ? count : 1;
+}
+
+/// NUMA node the calling thread currently runs on, or 0 when unknown.
+inline std::size_t CurrentNumaNode() {
+#if defined(__linux__) && defined(SYS_getcpu)
+  unsigned cpu = 0, node = 0;
+  if (::syscall(SYS_getcpu, &cpu, &node, nullptr) == 0)
+    return node;
+#endif
+  return 0;
+}
+
+namespace detail {
+
+/// Runs f on a thread pinned to the CPUs of a NUMA node, so that the memory
+/// it first touches is placed on that node. Runs f on the calling thread when
+/// the node's CPUs cannot be determined.
+template <class F> void RunOnNumaNode(std::size_t node, F &&f) {
+#if defined(__linux__) && defined(CPU_SET)
+  std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) +
+                     "/cpulist");
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  bool any = false;
+  // The list looks like "0-3,8-11".
+  unsigned first = 0, last = 0;
+  while (file >> first) {
+    last = first;
+    if (file.peek() == '-')
+      file.ignore() >> last;
+    for (unsigned cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu) {
+      CPU_SET(cpu, &cpus);
+      any = true;
+    }
+    if (file.peek() == ',')
+      file.ignore();
+  }
+  if (any) {
+    std::exception_ptr error;
+    std::thread pinned([&]() {
+      try {
+        ::sched_setaffinity(0, sizeof(cpus), &cpus);
+        f();
+      } catch (...) {
+        error = std::current_exception();
+      }
+    });
+    pinned.join();
+    if (error)
+      std::rethrow_exception(error);
+    return;
+  }
+#endif
+  (void)node;
+  f();
+}
+
+} // namespace detail
+
+/// A SafeQueue split into one lane per NUMA node. Producers push into the
+/// lane of the node they run on. So a lane's container blocks are allocated,
+/// and first touched, by threads on that node. Each lane itself is
+/// constructed on a thread pinned to its node. Consumers drain their own
+/// node's lane first and fall back to the other lanes when it is empty.
+/// Task accounting is global: Join() waits for the tasks of every lane.
+///
+/// No memory policy is applied beyond first touch. A Container with a
+/// node-bound allocator (for example one that uses mbind(2)) can be supplied
+/// for stricter placement.
+template <class T, class Container = std::deque<T>> class NumaSafeQueue final {
+public:
+  using container_type = Container;
+  using value_type = typename container_type::value_type;
+  using size_type = typename container_type::size_type;
+  using reference = typename container_type::reference;
+  using const_reference = typename container_type::const_reference;
+
+  struct TaskDoneGuard {
+    TaskDoneGuard(const TaskDoneGuard &) = delete;
+    TaskDoneGuard(TaskDoneGuard &&);
+    TaskDoneGuard &operator=(const TaskDoneGuard &) = delete;
+    TaskDoneGuard &operator=(TaskDoneGuard &&);
+    ~TaskDoneGuard() noexcept(false);
+
+  private:
+    NumaSafeQueue *mQ = nullptr;
+    TaskDoneGuard(NumaSafeQueue *);
+    friend class NumaSafeQueue;
+  };
+
+  explicit NumaSafeQueue(std::size_t nodes = NumaNodeCount());
+  NumaSafeQueue(const NumaSafeQueue &) = delete;
+  NumaSafeQueue &operator=(const NumaSafeQueue &) = delete;
+  ~NumaSafeQueue();
+
+  std::size_t Nodes() const noexcept { return mNodes; }
+
+  void Push(const_reference item);
+  void Push(value_type &&item);
+  template <class... Args> void Emplace(Args &&... args);
+  template <class... Args> void EmplaceOnNode(std::size_t node, Args &&... args);
+
+  value_type Pop();
+  std::pair<value_type, TaskDoneGuard> PopWithGuard();
+  template <class Rep, class Period>
+  value_type Pop(const std::chrono::duration<Rep, Period> &timeout);
+  template <class Rep, class Period>
+  std::pair<value_type, TaskDoneGuard>
+  PopWithGuard(const std::chrono::duration<Rep, Period> &timeout);
+  value_type PopOnNode(std::size_t node);
+  bool TryPopOnNode(std::size_t node, reference item);
+
+  void TaskDone();
+
+  void Join();
+
+private:
+  struct alignas(64) Lane {
+    std::mutex mutex;
+    std::queue<value_type, container_type> q;
+  };
+
+  std::size_t mNodes;
+  std::vector<std::unique_ptr<Lane>> mLanes;
+  std::atomic<std::size_t> mSize{0};
+  std::atomic<std::size_t> mSleepers{0};
+  std::atomic<std::size_t> mUnfinishedTasks{0};
+  std::mutex mMutex; // Only for sleeping consumers and joiners.
+  std::condition_variable mNotEmpty, mAllTasksDone;
+
+  std::size_t LocalNode() const { return CurrentNumaNode() % mNodes; }
+  void Pushed();
+  detail::Maybe<value_type> TakeFromNode(std::size_t node);
+
+  using UniqueLock = std::unique_lock<std::mutex>;
+  using LockGuard = std::lock_guard<std::mutex>;
+};
+
+// Implementation follows.
+
+template <class T, class C>
+NumaSafeQueue<T, C>::TaskDoneGuard::TaskDoneGuard(TaskDoneGuard &&other)
+    : mQ(other.mQ) {
+  other.mQ = nullptr;
+}
+
+template <class T, class C>
+typename NumaSafeQueue<T, C>::TaskDoneGuard &
+NumaSafeQueue<T, C>::TaskDoneGuard::operator=(TaskDoneGuard &&other) {
+  mQ = other.mQ;
+  other.mQ = nullptr;
+  return *this;
+}
+
+template <class T, class C>
+NumaSafeQueue<T, C>::TaskDoneGuard::TaskDoneGuard(NumaSafeQueue *q) : mQ(q) {}
+
+template <class T, class C>
+NumaSafeQueue<T, C>::TaskDoneGuard::~TaskDoneGuard() noexcept(false) {
+  if (mQ)
+    mQ->TaskDone();
+}
+
+template <class T, class C>
+NumaSafeQueue<T, C>::NumaSafeQueue(std::size_t nodes)
+    : mNodes(nodes ? nodes : 1), mLanes(mNodes) {
+  for (std::size_t node = 0; node < mNodes; ++node)
+    detail::RunOnNumaNode(node,
+                          [this, node]() { mLanes[node].reset(new Lane); });
+}
+
+template <class T, class C> NumaSafeQueue<T, C>::~NumaSafeQueue() {
+  Join();
+  assert(mUnfinishedTasks == 0 && "Expected all tasks to be finished");
+}
+
+template <class T, class C>
+void NumaSafeQueue<T, C>::Push(const_reference item) {
+  EmplaceOnNode(LocalNode(), item);
+}
+
+template <class T, class C> void NumaSafeQueue<T, C>::Push(value_type &&item) {
+  EmplaceOnNode(LocalNode(), std::move(item));
+}
+
+template <class T, class C>
+template <class... Args>
+void NumaSafeQueue<T, C>::Emplace(Args &&... args) {
+  EmplaceOnNode(LocalNode(), std::forward<Args>(args)...);
+}
+
+template <class T, class C>
+template <class... Args>
+void NumaSafeQueue<T, C>::EmplaceOnNode(std::size_t node, Args &&... args) {
+  auto &lane = *mLanes[node % mNodes];
+  {
+    LockGuard lock(lane.mutex);
+    lane.q.emplace(std::forward<Args>(args)...);
+    // Counted only once the item is in, but before the lane is unlocked, so
+    // that a throwing emplace leaves both counters alone and no consumer can
+    // take the item before it is counted.
+    mUnfinishedTasks.fetch_add(1, std::memory_order_relaxed);
+    mSize.fetch_add(1);
+  }
+  Pushed();
+}
+
+template <class T, class C> void NumaSafeQueue<T, C>::Pushed() {
+  // Either a sleeping consumer sees the new size in its wait predicate, or we
+  // see it counted as a sleeper here.
+  if (mSleepers.load() > 0) {
+    { LockGuard lock(mMutex); }
+    mNotEmpty.notify_one();
+  }
+}
+
+template <class T, class C>
+detail::Maybe<typename NumaSafeQueue<T, C>::value_type>
+NumaSafeQueue<T, C>::TakeFromNode(std::size_t node) {
+  for (std::size_t i = 0; i < mNodes; ++i) {
+    auto &lane = *mLanes[(node + i) % mNodes];
+    LockGuard lock(lane.mutex);
+    if (!lane.q.empty()) {
+      detail::Maybe<value_type> item(std::move(lane.q.front()));
+      lane.q.pop();
+      mSize.fetch_sub(1);
+      return item;
+    }
+  }
+  return detail::Maybe<value_type>();
+}
+
+template <class T, class C>
+bool NumaSafeQueue<T, C>::TryPopOnNode(std::size_t node, reference item) {
+  auto taken = TakeFromNode(node);
+  if (!taken)
+    return false;
+  item = std::move(*taken);
+  return true;
+}
+
+template <class T, class C>
+typename NumaSafeQueue<T, C>::value_type
+NumaSafeQueue<T, C>::PopOnNode(std::size_t node) {
+  auto item = TakeFromNode(node);
+  while (!item) {
+    {
+      UniqueLock lock(mMutex);
+      mSleepers.fetch_add(1);
+      mNotEmpty.wait(lock, [this]() { return mSize.load() > 0; });
+      mSleepers.fetch_sub(1);
+    }
+    item = TakeFromNode(node);
+  }
+  return std::move(*item);
+}
+
+template <class T, class C>
+typename NumaSafeQueue<T, C>::value_type NumaSafeQueue<T, C>::Pop() {
+  return PopOnNode(LocalNode());
+}
+
+template <class T, class C>
+std::pair<typename NumaSafeQueue<T, C>::value_type,
+          typename NumaSafeQueue<T, C>::TaskDoneGuard>
+NumaSafeQueue<T, C>::PopWithGuard() {
+  auto item = Pop();
+  return std::make_pair(std::move(item), TaskDoneGuard(this));
+}
+
+template <class T, class C>
+template <class Rep, class Period>
+typename NumaSafeQueue<T, C>::value_type NumaSafeQueue<T, C>::Pop(
+    const std::chrono::duration<Rep, Period> &timeout) {
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  const auto node = LocalNode();
+  auto item = TakeFromNode(node);
+  while (!item) {
+    {
+      UniqueLock lock(mMutex);
+      mSleepers.fetch_add(1);
+      const bool ready = mNotEmpty.wait_until(
+          lock, deadline, [this]() { return mSize.load() > 0; });
+      mSleepers.fetch_sub(1);
+      if (!ready)
+        throw TimeoutError();
+    }
+    item = TakeFromNode(node);
+  }
+  return std::move(*item);
+}
+
+template <class T, class C>
+template <class Rep, class Period>
+std::pair<typename NumaSafeQueue<T, C>::value_type,
+          typename NumaSafeQueue<T, C>::TaskDoneGuard>
+NumaSafeQueue<T, C>::PopWithGuard(
+    const std::chrono::duration<Rep, Period> &timeout) {
+  auto item = Pop(timeout);
+  return std::make_pair(std::move(item), TaskDoneGuard(this));
+}
+
+template <class T, class C> void NumaSafeQueue<T, C>::TaskDone() {
+  const auto previous = mUnfinishedTasks.fetch_sub(1);
+  assert(previous > 0 && "TaskDone() called too many times");
+  (void)previous;
+  if (previous == 1) {
+    { LockGuard lock(mMutex); }
+    mAllTasksDone.notify_all();
+  }
+}
+
+template <class T, class C> void NumaSafeQueue<T, C>::Join() {
+  UniqueLock lock(mMutex);
+  mAllTasksDone.wait(lock, [this]() { return mUnfinishedTasks.load() == 0; });
+}
+
+} // namespace rwols
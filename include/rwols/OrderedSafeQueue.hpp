@@ -0,0 +1,213 @@
+///\file    OrderedSafeQueue.hpp
+///\brief   Thread-safe queue for parallel processing with in-order results
+///\author  Raoul Wols
+///\date    October, 2026
+
+#pragma once
+
+#include <rwols/SafeQueue.hpp>
+#include <rwols/detail/Maybe.hpp>
+
+#include <cassert>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+namespace rwols {
+
+/// A thread-safe queue for workers that process items in parallel but whose
+/// results must come out in input order. Push() stamps every item with a
+/// sequence number, and workers hand their result back under that number:
+/// \code
+///   rwols::OrderedSafeQueue<Request, Response> q(
+///       256, [&](Response &&r) { out.Push(std::move(r)); });
+///   // in each worker:
+///   auto item = q.Pop();
+///   q.Complete(item.first, Handle(item.second));
+/// \endcode
+/// Results wait in a reorder buffer until all earlier ones are in, and are
+/// then passed to the release callback strictly in sequence, by one thread at
+/// a time. The window bounds how far Push() may run ahead of the oldest
+/// result that has not been released, so one slow item cannot make the
+/// buffer grow without limit.
+template <class T, class R = T> class OrderedSafeQueue final {
+public:
+  using value_type = T;
+  using result_type = R;
+  using size_type = std::size_t;
+  using const_reference = const value_type &;
+  using sequence_type = std::uint64_t;
+  using Release = std::function<void(result_type &&)>;
+
+  OrderedSafeQueue(size_type window, Release release);
+  ~OrderedSafeQueue();
+
+  /// Blocks while `window` items are between Push() and release.
+  void Push(const_reference item);
+  void Push(value_type &&item);
+
+  std::pair<sequence_type, value_type> Pop();
+  template <class Rep, class Period>
+  std::pair<sequence_type, value_type>
+  Pop(const std::chrono::duration<Rep, Period> &timeout);
+
+  /// Hands in the result for a popped item. The calling thread may end up
+  /// running the release callback for this and later results. If the callback
+  /// throws, that result is lost, the later ones are still released, and the
+  /// first exception is rethrown here.
+  void Complete(sequence_type sequence, result_type &&result);
+  /// Finishes a popped item without a result.
+  void Skip(sequence_type sequence);
+
+  /// Waits until every pushed item has been released or skipped.
+  void Join();
+
+private:
+  using UniqueLock = std::unique_lock<std::mutex>;
+  using LockGuard = std::lock_guard<std::mutex>;
+
+  struct Slot {
+    detail::Maybe<result_type> result;
+    bool done = false;
+  };
+
+  std::mutex mMutex;
+  std::condition_variable mNotEmpty, mNotFull, mAllTasksDone;
+  std::deque<std::pair<sequence_type, value_type>> mQ;
+  std::vector<Slot> mSlots; // The reorder buffer, indexed modulo the window.
+  Release mRelease;
+  sequence_type mNextSequence = 0;
+  sequence_type mNextRelease = 0;
+  bool mReleasing = false;
+
+  template <class U> void PushImpl(U &&item);
+  void Finish(sequence_type sequence, detail::Maybe<result_type> result);
+};
+
+// Implementation follows.
+
+template <class T, class R>
+OrderedSafeQueue<T, R>::OrderedSafeQueue(size_type window, Release release)
+    : mSlots(window), mRelease(std::move(release)) {
+  if (window == 0)
+    throw std::invalid_argument("OrderedSafeQueue window must be positive");
+}
+
+template <class T, class R> OrderedSafeQueue<T, R>::~OrderedSafeQueue() {
+  Join();
+}
+
+template <class T, class R>
+template <class U>
+void OrderedSafeQueue<T, R>::PushImpl(U &&item) {
+  {
+    UniqueLock lock(mMutex);
+    mNotFull.wait(lock, [this]() {
+      return mNextSequence - mNextRelease < mSlots.size();
+    });
+    mQ.emplace_back(mNextSequence++, std::forward<U>(item));
+  }
+  mNotEmpty.notify_one();
+}
+
+template <class T, class R>
+void OrderedSafeQueue<T, R>::Push(const_reference item) {
+  PushImpl(item);
+}
+
+template <class T, class R>
+void OrderedSafeQueue<T, R>::Push(value_type &&item) {
+  PushImpl(std::move(item));
+}
+
+template <class T, class R>
+std::pair<typename OrderedSafeQueue<T, R>::sequence_type,
+          typename OrderedSafeQueue<T, R>::value_type>
+OrderedSafeQueue<T, R>::Pop() {
+  UniqueLock lock(mMutex);
+  mNotEmpty.wait(lock, [this]() { return !mQ.empty(); });
+  auto item = std::move(mQ.front());
+  mQ.pop_front();
+  return item;
+}
+
+template <class T, class R>
+template <class Rep, class Period>
+std::pair<typename OrderedSafeQueue<T, R>::sequence_type,
+          typename OrderedSafeQueue<T, R>::value_type>
+OrderedSafeQueue<T, R>::Pop(const std::chrono::duration<Rep, Period> &timeout) {
+  UniqueLock lock(mMutex);
+  if (mNotEmpty.wait_for(lock, timeout, [this]() { return !mQ.empty(); })) {
+    auto item = std::move(mQ.front());
+    mQ.pop_front();
+    return item;
+  }
+  throw TimeoutError();
+}
+
+template <class T, class R>
+void OrderedSafeQueue<T, R>::Complete(sequence_type sequence,
+                                      result_type &&result) {
+  Finish(sequence, detail::Maybe<result_type>(std::move(result)));
+}
+
+template <class T, class R>
+void OrderedSafeQueue<T, R>::Skip(sequence_type sequence) {
+  Finish(sequence, detail::Maybe<result_type>());
+}
+
+template <class T, class R>
+void OrderedSafeQueue<T, R>::Finish(sequence_type sequence,
+                                    detail::Maybe<result_type> result) {
+  UniqueLock lock(mMutex);
+  assert(sequence >= mNextRelease && sequence < mNextSequence &&
+         "Complete() or Skip() for an unknown sequence number");
+  auto &slot = mSlots[sequence % mSlots.size()];
+  assert(!slot.done && "Complete() or Skip() called twice");
+  slot.result = std::move(result);
+  slot.done = true;
+  // Only one thread releases at a time, so that the callback sees results in
+  // order. Whoever is releasing already will pick this result up.
+  if (mReleasing)
+    return;
+  mReleasing = true;
+  std::exception_ptr error;
+  while (true) {
+    auto &next = mSlots[mNextRelease % mSlots.size()];
+    if (!next.done)
+      break;
+    auto ready = std::move(next.result);
+    next.result = detail::Maybe<result_type>();
+    next.done = false;
+    if (ready) {
+      lock.unlock();
+      try {
+        mRelease(std::move(*ready));
+      } catch (...) {
+        // The result is lost, but its slot is released so the queue moves on.
+        if (!error)
+          error = std::current_exception();
+      }
+      lock.lock();
+    }
+    ++mNextRelease;
+    mNotFull.notify_one();
+  }
+  mReleasing = false;
+  if (mNextRelease == mNextSequence)
+    mAllTasksDone.notify_all();
+  if (error) {
+    lock.unlock();
+    std::rethrow_exception(error);
+  }
+}
+
+template <class T, class R> void OrderedSafeQueue<T, R>::Join() {
+  UniqueLock lock(mMutex);
+  mAllTasksDone.wait(lock, [this]() { return mNextRelease == mNextSequence; });
+}
+
+} // namespace rwols
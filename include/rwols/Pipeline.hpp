@@ -0,0 +1,513 @@
+///\file    Pipeline.hpp
+///\brief   Multi-stage pipelines with queues and worker threads between stages
+///\author  Raoul Wols
+///\date    October, 2026
+
+#pragma once
+
+#include <rwols/FixedSafeQueue.hpp>
+#include <rwols/Locks.hpp>
+#include <rwols/SafeQueue.hpp>
+#include <rwols/detail/Maybe.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace rwols {
+
+/// Queue kinds for the input of a pipeline stage.
+struct Unbounded {};
+template <std::size_t N> struct Bounded {};
+/// A lock-free ring of N slots for exactly one producer and one consumer. The
+/// stage must run on one thread, and so must the stage before it; for the
+/// first stage, only one thread may Push() into the pipeline. Then() checks
+/// the thread counts, and Push() throws std::logic_error when a second
+/// thread pushes into a pipeline that starts with this kind.
+template <std::size_t N> struct SingleProducer {};
+/// Runs a stage on the threads of the previous stage when both have the same
+/// number of threads, and gives it an Unbounded queue otherwise.
+struct Fusable {};
+
+template <class In> class Pipeline;
+template <class In, class Out> class PipelineBuilder;
+template <class In> PipelineBuilder<In, In> MakePipeline();
+
+namespace detail {
+
+/// The first exception thrown by any stage; Join() rethrows it.
+class PipelineError final {
+public:
+  void Set(std::exception_ptr error) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mError)
+      mError = error;
+  }
+  void Rethrow() {
+    std::exception_ptr error;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      std::swap(error, mError);
+    }
+    if (error)
+      std::rethrow_exception(error);
+  }
+
+private:
+  std::mutex mMutex;
+  std::exception_ptr mError;
+};
+
+class StageBase {
+public:
+  virtual ~StageBase() = default;
+  /// Waits until every item pushed so far has passed this stage.
+  virtual void Join() = 0;
+  /// Lets the threads finish the queued items, then stops them.
+  virtual void Stop() = 0;
+};
+
+/// A bounded ring for one producer thread and one consumer thread. Neither
+/// side takes a lock while the ring is neither empty nor full. A side that
+/// has to wait spins briefly, then sleeps on a condition variable, which the
+/// other side only notifies when somebody sleeps.
+template <class T, std::size_t N> class SpscQueue final {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "N must be a power of two");
+
+public:
+  using value_type = T;
+
+  struct TaskDoneGuard {
+    TaskDoneGuard(const TaskDoneGuard &) = delete;
+    TaskDoneGuard(TaskDoneGuard &&);
+    TaskDoneGuard &operator=(const TaskDoneGuard &) = delete;
+    TaskDoneGuard &operator=(TaskDoneGuard &&);
+    ~TaskDoneGuard() noexcept(false);
+
+  private:
+    SpscQueue *mQ = nullptr;
+    TaskDoneGuard(SpscQueue *);
+    friend class SpscQueue;
+  };
+
+  SpscQueue() = default;
+  SpscQueue(const SpscQueue &) = delete;
+  SpscQueue &operator=(const SpscQueue &) = delete;
+  ~SpscQueue();
+
+  template <class... Args> void Emplace(Args &&... args);
+  std::pair<value_type, TaskDoneGuard> PopWithGuard();
+  void TaskDone();
+  void Join();
+
+private:
+  using Slot = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+  static constexpr int kSpins = 64;
+
+  std::atomic<std::size_t> mHead{0}; // Written by the consumer only.
+  std::atomic<std::size_t> mTail{0}; // Written by the producer only.
+  std::atomic<std::size_t> mUnfinishedTasks{0};
+  std::atomic<unsigned> mSleepers{0};
+  std::mutex mMutex;
+  std::condition_variable mChanged, mAllTasksDone;
+  std::array<Slot, N> mSlots;
+
+  value_type *At(std::size_t index) noexcept {
+    return reinterpret_cast<value_type *>(&mSlots[index & (N - 1)]);
+  }
+  template <class Ready> void WaitFor(Ready ready);
+  void Wake();
+};
+
+template <class X, class Kind> struct StageQueue {
+  using type = SafeQueue<Maybe<X>>;
+};
+template <class X, std::size_t N> struct StageQueue<X, Bounded<N>> {
+  using type = FixedSafeQueue<Maybe<X>, N>;
+};
+template <class X, std::size_t N> struct StageQueue<X, SingleProducer<N>> {
+  using type = SpscQueue<Maybe<X>, N>;
+};
+
+/// A queue with its own worker threads that feed each item to the body. An
+/// empty Maybe tells a thread to stop.
+template <class X, class Kind> class Stage final : public StageBase {
+public:
+  Stage(std::function<void(X &&)> body, unsigned threads,
+        std::shared_ptr<PipelineError> error)
+      : mBody(std::move(body)), mError(std::move(error)) {
+    try {
+      for (unsigned i = 0; i < threads; ++i)
+        mThreads.emplace_back([this]() { Run(); });
+    } catch (...) {
+      // No destructor runs for us, so the threads started so far are stopped
+      // here; joinable threads would terminate the program.
+      Stop();
+      throw;
+    }
+  }
+  ~Stage() override { Stop(); }
+
+  void Push(X &&item) { mQ->Emplace(std::move(item)); }
+  void Join() override { mQ->Join(); }
+  void Stop() override {
+    for (std::size_t i = 0; i < mThreads.size(); ++i)
+      mQ->Emplace();
+    for (auto &thread : mThreads)
+      thread.join();
+    mThreads.clear();
+  }
+
+private:
+  // FixedSafeQueue can be large, so it always lives on the heap.
+  std::unique_ptr<typename StageQueue<X, Kind>::type> mQ{
+      new typename StageQueue<X, Kind>::type()};
+  std::function<void(X &&)> mBody;
+  std::shared_ptr<PipelineError> mError;
+  std::vector<std::thread> mThreads;
+
+  void Run() {
+    while (true) {
+      auto pair = mQ->PopWithGuard();
+      if (!pair.first)
+        return;
+      try {
+        mBody(std::move(*pair.first));
+      } catch (...) {
+        mError->Set(std::current_exception());
+      }
+    }
+  }
+};
+
+/// Lets only the first thread that calls it through; the entry of a pipeline
+/// that starts with a SingleProducer stage.
+class SingleThreadCheck final {
+public:
+  void operator()() {
+    const auto self = std::this_thread::get_id();
+    auto owner = mOwner.load(std::memory_order_relaxed);
+    if (owner == std::thread::id() &&
+        mOwner.compare_exchange_strong(owner, self))
+      return;
+    if (owner != self)
+      throw std::logic_error("Only one thread may push into a pipeline that "
+                             "starts with a SingleProducer stage");
+  }
+
+private:
+  std::atomic<std::thread::id> mOwner{std::thread::id()};
+};
+
+/// What the build functions of a PipelineBuilder fill in.
+struct PipelineParts {
+  std::vector<std::unique_ptr<StageBase>> stages; // Downstream first.
+  std::shared_ptr<PipelineError> error = std::make_shared<PipelineError>();
+};
+
+/// What a stage returns for an item of type X.
+template <class F, class X> struct StageResult {
+  using type = decltype(std::declval<F &>()(std::declval<X &&>()));
+};
+
+template <class Kind> struct IsSingleProducer : std::false_type {};
+template <std::size_t N>
+struct IsSingleProducer<SingleProducer<N>> : std::true_type {};
+
+/// Where a stage hands its results: the next stage, or nothing.
+template <class Y> struct StageSink {
+  using type = std::function<void(Y &&)>;
+};
+template <> struct StageSink<void> {
+  using type = std::function<void(void)>;
+};
+
+template <class X, class Y> struct StageBody {
+  template <class F>
+  static std::function<void(X &&)> Make(F f, std::function<void(Y &&)> next) {
+    return [f, next](X &&item) mutable { next(f(std::move(item))); };
+  }
+};
+template <class X> struct StageBody<X, void> {
+  template <class F>
+  static std::function<void(X &&)> Make(F f, std::function<void(void)>) {
+    return [f](X &&item) mutable { f(std::move(item)); };
+  }
+};
+
+} // namespace detail
+
+/// A running pipeline of stages, made by a PipelineBuilder:
+/// \code
+///   auto pipeline = rwols::MakePipeline<std::string>()
+///                       .Then(Parse, 4)                  // string -> Record
+///                       .Then(Enrich, 4)                 // fused with Parse
+///                       .Then<rwols::Bounded<256>>(Score, 2)
+///                       .Then(Write, 1)                  // Record -> void
+///                       .Build();
+///   for (auto &line : lines)
+///     pipeline.Push(line);
+///   pipeline.Join();
+/// \endcode
+/// Every stage has its own worker threads and its own input queue. Join()
+/// waits until every pushed item has passed every stage, and rethrows the
+/// first exception a stage threw. Destruction drains the queues and stops
+/// the threads.
+template <class In> class Pipeline final {
+public:
+  Pipeline(Pipeline &&) = default;
+  Pipeline &operator=(Pipeline &&) = default;
+  ~Pipeline();
+
+  void Push(const In &item);
+  void Push(In &&item);
+
+  void Join();
+
+  /// Stages that got their own queue and threads after fusion.
+  std::size_t Stages() const noexcept { return mParts.stages.size(); }
+
+private:
+  detail::PipelineParts mParts; // Upstream first.
+  std::function<void(In &&)> mEntry;
+
+  Pipeline(detail::PipelineParts parts, std::function<void(In &&)> entry);
+  template <class, class> friend class PipelineBuilder;
+};
+
+/// Builds a Pipeline stage by stage. Out is the type the last stage produces.
+template <class In, class Out> class PipelineBuilder final {
+public:
+  /// Appends a stage that runs f on `threads` threads. Kind chooses the
+  /// stage's input queue: Unbounded, Bounded<N>, SingleProducer<N>, or
+  /// Fusable (the default).
+  template <class Kind = Fusable, class F>
+  PipelineBuilder<In, typename detail::StageResult<F, Out>::type>
+  Then(F f, unsigned threads = 1);
+
+  /// Starts the threads. Only a pipeline whose last stage returns void can be
+  /// built.
+  Pipeline<In> Build();
+
+private:
+  using Entry = std::function<void(In &&)>;
+  using Next = typename detail::StageSink<Out>::type;
+  using BuildFn = std::function<Entry(Next, detail::PipelineParts &)>;
+
+  BuildFn mBuild;
+  unsigned mLastThreads = 0; // Zero before the first stage.
+
+  PipelineBuilder(BuildFn build, unsigned lastThreads);
+  template <class, class> friend class PipelineBuilder;
+  friend PipelineBuilder<In, In> MakePipeline<In>();
+};
+
+/// Starts building a pipeline whose items enter as In.
+template <class In> PipelineBuilder<In, In> MakePipeline();
+
+// Implementation follows.
+
+namespace detail {
+
+template <class T, std::size_t N>
+SpscQueue<T, N>::TaskDoneGuard::TaskDoneGuard(TaskDoneGuard &&other)
+    : mQ(other.mQ) {
+  other.mQ = nullptr;
+}
+
+template <class T, std::size_t N>
+typename SpscQueue<T, N>::TaskDoneGuard &
+SpscQueue<T, N>::TaskDoneGuard::operator=(TaskDoneGuard &&other) {
+  mQ = other.mQ;
+  other.mQ = nullptr;
+  return *this;
+}
+
+template <class T, std::size_t N>
+SpscQueue<T, N>::TaskDoneGuard::TaskDoneGuard(SpscQueue *q) : mQ(q) {}
+
+template <class T, std::size_t N>
+SpscQueue<T, N>::TaskDoneGuard::~TaskDoneGuard() noexcept(false) {
+  if (mQ)
+    mQ->TaskDone();
+}
+
+template <class T, std::size_t N> SpscQueue<T, N>::~SpscQueue() {
+  Join();
+  for (auto head = mHead.load(); head != mTail.load(); ++head)
+    At(head)->~value_type();
+}
+
+template <class T, std::size_t N>
+template <class Ready>
+void SpscQueue<T, N>::WaitFor(Ready ready) {
+  SpinWait wait;
+  for (int i = 0; i < kSpins; ++i) {
+    if (ready())
+      return;
+    wait.Once();
+  }
+  // Announce ourselves before the last check: the other side either sees us
+  // and notifies, or made its change before that check.
+  mSleepers.fetch_add(1);
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mChanged.wait(lock, ready);
+  }
+  mSleepers.fetch_sub(1);
+}
+
+template <class T, std::size_t N> void SpscQueue<T, N>::Wake() {
+  if (mSleepers.load() == 0)
+    return;
+  { std::lock_guard<std::mutex> lock(mMutex); }
+  mChanged.notify_all();
+}
+
+template <class T, std::size_t N>
+template <class... Args>
+void SpscQueue<T, N>::Emplace(Args &&... args) {
+  const auto tail = mTail.load(std::memory_order_relaxed);
+  WaitFor([this, tail]() { return tail - mHead.load() < N; });
+  ::new (static_cast<void *>(At(tail)))
+      value_type(std::forward<Args>(args)...);
+  mUnfinishedTasks.fetch_add(1);
+  mTail.store(tail + 1);
+  Wake();
+}
+
+template <class T, std::size_t N>
+std::pair<typename SpscQueue<T, N>::value_type,
+          typename SpscQueue<T, N>::TaskDoneGuard>
+SpscQueue<T, N>::PopWithGuard() {
+  const auto head = mHead.load(std::memory_order_relaxed);
+  WaitFor([this, head]() { return mTail.load() != head; });
+  auto *slot = At(head);
+  auto item = std::move(*slot);
+  slot->~value_type();
+  mHead.store(head + 1);
+  Wake();
+  return std::make_pair(std::move(item), TaskDoneGuard(this));
+}
+
+template <class T, std::size_t N> void SpscQueue<T, N>::TaskDone() {
+  if (mUnfinishedTasks.fetch_sub(1) != 1)
+    return;
+  { std::lock_guard<std::mutex> lock(mMutex); }
+  mAllTasksDone.notify_all();
+}
+
+template <class T, std::size_t N> void SpscQueue<T, N>::Join() {
+  std::unique_lock<std::mutex> lock(mMutex);
+  mAllTasksDone.wait(lock, [this]() { return mUnfinishedTasks.load() == 0; });
+}
+
+} // namespace detail
+
+template <class In>
+Pipeline<In>::Pipeline(detail::PipelineParts parts,
+                       std::function<void(In &&)> entry)
+    : mParts(std::move(parts)), mEntry(std::move(entry)) {}
+
+template <class In> Pipeline<In>::~Pipeline() {
+  // Upstream first, so that no stage gets items after it stopped.
+  for (auto &stage : mParts.stages)
+    stage->Stop();
+}
+
+template <class In> void Pipeline<In>::Push(const In &item) {
+  In copy(item);
+  mEntry(std::move(copy));
+}
+
+template <class In> void Pipeline<In>::Push(In &&item) {
+  mEntry(std::move(item));
+}
+
+template <class In> void Pipeline<In>::Join() {
+  // A stage finishes an item only after handing its result downstream, so
+  // joining the stages in order waits for everything.
+  for (auto &stage : mParts.stages)
+    stage->Join();
+  mParts.error->Rethrow();
+}
+
+template <class In, class Out>
+PipelineBuilder<In, Out>::PipelineBuilder(BuildFn build, unsigned lastThreads)
+    : mBuild(std::move(build)), mLastThreads(lastThreads) {}
+
+template <class In> PipelineBuilder<In, In> MakePipeline() {
+  return PipelineBuilder<In, In>(
+      [](std::function<void(In &&)> next, detail::PipelineParts &) {
+        return next;
+      },
+      0);
+}
+
+template <class In, class Out>
+template <class Kind, class F>
+PipelineBuilder<In, typename detail::StageResult<F, Out>::type>
+PipelineBuilder<In, Out>::Then(F f, unsigned threads) {
+  using Result = typename detail::StageResult<F, Out>::type;
+  using Sink = typename detail::StageSink<Result>::type;
+  using Queue = typename std::conditional<std::is_same<Kind, Fusable>::value,
+                                          Unbounded, Kind>::type;
+  if (threads == 0)
+    throw std::invalid_argument("A pipeline stage needs at least one thread");
+  if (detail::IsSingleProducer<Kind>::value &&
+      (threads != 1 || mLastThreads > 1))
+    throw std::invalid_argument(
+        "A SingleProducer stage and the stage before it need one thread each");
+  const bool fuse =
+      std::is_same<Kind, Fusable>::value && threads == mLastThreads;
+  // Only the pipeline's entry can have several producers.
+  const bool checkProducer =
+      detail::IsSingleProducer<Kind>::value && mLastThreads == 0;
+  auto previous = mBuild;
+  return PipelineBuilder<In, Result>(
+      [previous, f, threads, fuse, checkProducer](
+          Sink next, detail::PipelineParts &parts) {
+        auto body = detail::StageBody<Out, Result>::Make(f, std::move(next));
+        if (fuse)
+          return previous(std::move(body), parts);
+        // Owned from the start: the threads are already running.
+        std::unique_ptr<detail::Stage<Out, Queue>> owned(
+            new detail::Stage<Out, Queue>(std::move(body), threads,
+                                          parts.error));
+        auto *stage = owned.get();
+        parts.stages.push_back(std::move(owned));
+        if (checkProducer) {
+          auto check = std::make_shared<detail::SingleThreadCheck>();
+          return previous(
+              [stage, check](Out &&item) {
+                (*check)();
+                stage->Push(std::move(item));
+              },
+              parts);
+        }
+        return previous([stage](Out &&item) { stage->Push(std::move(item)); },
+                        parts);
+      },
+      threads);
+}
+
+template <class In, class Out> Pipeline<In> PipelineBuilder<In, Out>::Build() {
+  static_assert(std::is_void<Out>::value,
+                "The last stage of a pipeline must return void");
+  detail::PipelineParts parts;
+  auto entry = mBuild(Next(), parts);
+  std::reverse(parts.stages.begin(), parts.stages.end());
+  return Pipeline<In>(std::move(parts), std::move(entry));
+}
+
+} // namespace rwols
@@ -5,10 +5,20 @@
 
 #pragma once
 
+#include <rwols/Sync.hpp>
+
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <condition_variable>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <memory>
 #include <mutex>
 #include <queue>
+#include <thread>
+#include <vector>
 
 namespace rwols {
 
@@ -16,9 +26,79 @@ class TimeoutError final : public std::exception {
   const char *what() const noexcept override { return "timeout"; }
 };
 
-template <class T, class Container = std::deque<T>> class SafeQueue final {
+/// Wakes up whoever waits on several queues at once; see Select.hpp. Queues
+/// call Notify() while holding their own mutex, so a waiter must never lock a
+/// queue while holding this notifier's mutex.
+class SelectNotifier final {
+public:
+  void Notify();
+  std::uint64_t Sequence();
+  void WaitForChange(std::uint64_t sequence);
+  template <class Clock, class Duration>
+  bool WaitForChangeUntil(std::uint64_t sequence,
+                          const std::chrono::time_point<Clock, Duration> &t);
+
+private:
+  std::mutex mMutex;
+  std::condition_variable mChanged;
+  std::uint64_t mSequence = 0;
+};
+
+/// An item that was popped from a queue and is waiting for its TaskDone().
+struct InFlightTask {
+  std::uint64_t ticket;
+  std::thread::id consumer;
+  std::chrono::steady_clock::time_point popped;
+};
+
+namespace detail {
+
+/// Remembers who popped what and when, for queues that track their tasks in
+/// flight. Tickets are handed out in pop order, so the oldest task comes
+/// first. Not thread-safe: the queue calls it under its own mutex.
+class InFlightTracker final {
+public:
+  /// Records a pop by the calling thread. A guarded task is only ever
+  /// finished by its ticket; any other task by a ticketless Done().
+  std::uint64_t Popped(bool guarded);
+  /// Forgets the task with this ticket. Ticket 0 forgets the calling thread's
+  /// oldest unguarded task, or else the oldest unguarded task of any thread.
+  void Done(std::uint64_t ticket);
+  std::vector<InFlightTask>
+  OlderThan(std::chrono::steady_clock::time_point cutoff) const;
+  std::size_t Size() const noexcept { return mTasks.size(); }
+
+private:
+  struct Entry {
+    InFlightTask task;
+    bool guarded;
+  };
+
+  std::uint64_t mNextTicket = 1;
+  std::map<std::uint64_t, Entry> mTasks;
+  std::size_t mUnguarded = 0;
+};
+
+/// A std::queue that can put items back at its front, for consumers that hand
+/// back items they took but did not use.
+template <class T, class Container>
+class FrontQueue final : public std::queue<T, Container> {
+public:
+  template <class Iterator> void PushFront(Iterator first, Iterator last) {
+    this->c.insert(this->c.begin(), first, last);
+  }
+};
+
+} // namespace detail
+
+/// A thread-safe FIFO queue with task accounting. Sync chooses the mutex and
+/// the condition that threads wait on; see Sync.hpp. FutexSync wakes waiting
+/// consumers without a round trip through the mutex.
+template <class T, class Container = std::deque<T>, class Sync = StdSync>
+class SafeQueue final {
 public:
   using container_type = Container;
+  using sync_type = Sync;
   using value_type = typename container_type::value_type;
   using size_type = typename container_type::size_type;
   using reference = typename container_type::reference;
@@ -33,7 +113,92 @@ public:
 
   private:
     SafeQueue *mQ = nullptr;
-    TaskDoneGuard(SafeQueue *);
+    std::uint64_t mTicket = 0;
+    TaskDoneGuard(SafeQueue *, std::uint64_t ticket = 0);
+    friend class SafeQueue;
+  };
+
+  /// Buffers the pushes of one producer thread and hands them to the queue as
+  /// a single batch: one lock acquisition per batch instead of per item. The
+  /// batch is flushed when it reaches its size limit, when a Push() finds the
+  /// oldest buffered item older than the delay limit, on Flush(), and on
+  /// destruction. A handle made with a delay limit also never keeps items from
+  /// an idle consumer: a Pop() that is about to wait on an empty queue flushes
+  /// it, and while a Pop() waits, its pushes are not buffered. A handle made
+  /// without one only flushes on the other occasions, so an idle producer
+  /// must call Flush(). Buffered items become tasks when they are flushed.
+  /// Join() flushes every handle's partial batch, and while a Join() waits,
+  /// pushes are not buffered at all.
+  class ProducerHandle {
+  public:
+    ProducerHandle(const ProducerHandle &) = delete;
+    ProducerHandle(ProducerHandle &&);
+    ProducerHandle &operator=(const ProducerHandle &) = delete;
+    ProducerHandle &operator=(ProducerHandle &&);
+    ~ProducerHandle();
+
+    void Push(const_reference item);
+    void Push(value_type &&item);
+    template <class... Args> void Emplace(Args &&... args);
+
+    void Flush();
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    // Lives on the heap so that the queue can find it while the handle moves.
+    // The mutex is only contended when a Join() flushes the batch.
+    struct Batch {
+      std::mutex mutex;
+      std::vector<value_type> items;
+      size_type size;
+      Clock::duration maxDelay;
+      Clock::time_point oldest;
+    };
+
+    SafeQueue *mQ = nullptr;
+    std::unique_ptr<Batch> mBatch;
+
+    ProducerHandle(SafeQueue *, size_type, Clock::duration);
+    void Release();
+    friend class SafeQueue;
+  };
+
+  /// Takes up to a batch of items from the queue under one lock acquisition
+  /// and serves later pops from a local buffer without locking. The batch size
+  /// adapts to the queue depth: a consumer takes at most its fair share of
+  /// the items, counting consumers that are already waiting. So at low load
+  /// it takes one item at a time and nothing is hoarded from idle consumers.
+  /// Items still buffered when the handle is destroyed go back to the front of
+  /// the queue, in order, ahead of anything pushed since.
+  class ConsumerHandle {
+  public:
+    ConsumerHandle(const ConsumerHandle &) = delete;
+    ConsumerHandle(ConsumerHandle &&);
+    ConsumerHandle &operator=(const ConsumerHandle &) = delete;
+    ConsumerHandle &operator=(ConsumerHandle &&);
+    ~ConsumerHandle();
+
+    value_type Pop();
+    std::pair<value_type, TaskDoneGuard> PopWithGuard();
+    template <class Rep, class Period>
+    value_type Pop(const std::chrono::duration<Rep, Period> &timeout);
+    template <class Rep, class Period>
+    std::pair<value_type, TaskDoneGuard>
+    PopWithGuard(const std::chrono::duration<Rep, Period> &timeout);
+
+  private:
+    SafeQueue *mQ = nullptr;
+    std::deque<value_type> mBuffer;
+    size_type mMaxBatch;
+    bool mTracked = false; // The queue tracked in-flight items at our batch.
+
+    ConsumerHandle(SafeQueue *, size_type);
+    value_type Next();
+    template <class Rep, class Period>
+    value_type Next(const std::chrono::duration<Rep, Period> &timeout);
+    value_type TakeFront();
+    void Release();
     friend class SafeQueue;
   };
 
@@ -47,6 +212,13 @@ public:
   template <class... Args> void Emplace(Args &&... args);
   template <class... Args> void EmplaceAndJoin(Args &&... args);
 
+  ProducerHandle MakeProducer(size_type batchSize);
+  template <class Rep, class Period>
+  ProducerHandle
+  MakeProducer(size_type batchSize,
+               const std::chrono::duration<Rep, Period> &maxDelay);
+  ConsumerHandle MakeConsumer(size_type maxBatch);
+
   value_type Pop();
   std::pair<value_type, TaskDoneGuard> PopWithGuard();
   template <class Rep, class Period>
@@ -55,158 +227,771 @@ public:
   std::pair<value_type, TaskDoneGuard>
   PopWithGuard(const std::chrono::duration<Rep, Period> &timeout);
 
+  bool TryPop(reference item);
+
   void TaskDone();
 
   void Join();
 
+  bool Empty();
+  size_type Size();
+
+  void Subscribe(SelectNotifier &notifier);
+  void Unsubscribe(SelectNotifier &notifier);
+
+  /// Starts recording, for every popped item, when and by which thread it was
+  /// popped, until its TaskDone(). Off by default; once on, every pop and
+  /// TaskDone() pay for a map insertion and removal. A guard finishes exactly
+  /// its own item. A plain TaskDone() does not say which item it finishes, so
+  /// it finishes the calling thread's oldest item from a plain pop, or else
+  /// the oldest such item of any thread. Items popped before tracking
+  /// started are not known, and neither are items a ConsumerHandle still
+  /// buffers; UntrackedCount() counts those.
+  void TrackInFlight();
+  /// The tracked items that were popped at least `age` ago, oldest first.
+  template <class Rep, class Period>
+  std::vector<InFlightTask>
+  InFlight(const std::chrono::duration<Rep, Period> &age);
+  /// Tracked items in flight.
+  size_type InFlightCount();
+  /// Unfinished tasks that are neither queued nor tracked: items popped
+  /// before tracking started, and items buffered in a producer or consumer
+  /// handle.
+  size_type UntrackedCount();
+
 private:
-  std::mutex mMutex;
-  std::condition_variable mNotEmpty, mAllTasksDone;
-  std::queue<value_type, container_type> mQ;
+  using Mutex = typename sync_type::mutex_type;
+  using Condition = typename sync_type::condition_type;
+  using UniqueLock = std::unique_lock<Mutex>;
+  using LockGuard = std::lock_guard<Mutex>;
+
+  Mutex mMutex;
+  Condition mNotEmpty, mAllTasksDone;
+  detail::FrontQueue<value_type, container_type> mQ;
   std::size_t mUnfinishedTasks = 0;
+  std::vector<SelectNotifier *> mSubscribers;
+  std::size_t mWaitingConsumers = 0;
+  std::unique_ptr<detail::InFlightTracker> mTracker; // Null: not tracking.
+  // Lock order: mProducersMutex, then a Batch mutex, then mMutex.
+  std::mutex mProducersMutex;
+  std::vector<typename ProducerHandle::Batch *> mProducers;
+  std::atomic<std::size_t> mJoiners{0};
+  std::atomic<std::size_t> mTimedProducers{0};
+  std::atomic<std::size_t> mSleepers{0};
+
+  /// Counts a joining thread for as long as it lives, after flushing every
+  /// producer's partial batch.
+  struct Joining {
+    explicit Joining(SafeQueue *);
+    ~Joining();
+    SafeQueue *mQ;
+  };
+
+  /// Counts a consumer that waits on an empty queue for as long as it lives,
+  /// after flushing the partial batch of every producer with a delay limit.
+  /// Unlocks the lock in the meantime.
+  struct Sleeping {
+    Sleeping(SafeQueue *, UniqueLock &lock);
+    ~Sleeping();
+    SafeQueue *mQ;
+  };
 
-  using UniqueLock = std::unique_lock<std::mutex>;
-  using LockGuard = std::lock_guard<std::mutex>;
+  void NotifySubscribers();
+  value_type TakeFront(std::uint64_t *ticket);
+  value_type PopTicket(std::uint64_t *ticket);
+  template <class Rep, class Period>
+  value_type PopTicket(std::uint64_t *ticket,
+                       const std::chrono::duration<Rep, Period> &timeout);
+  std::uint64_t Track(bool guarded);
+  void Finish(std::uint64_t ticket);
+  void PushBatch(std::vector<value_type> &items);
+  void FlushProducers(bool timedOnly = false);
+  void WaitNotEmpty(UniqueLock &lock);
+  template <class Rep, class Period>
+  bool WaitNotEmpty(UniqueLock &lock,
+                    const std::chrono::duration<Rep, Period> &timeout);
+  void TakeBatch(std::deque<value_type> &out, size_type maxBatch);
+  void ReturnBatch(std::deque<value_type> &items);
 };
 
 // Implementation follows.
 
-template <class T, class C>
-SafeQueue<T, C>::TaskDoneGuard::TaskDoneGuard(TaskDoneGuard &&other)
-    : mQ(other.mQ) {
+inline void SelectNotifier::Notify() {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    ++mSequence;
+  }
+  mChanged.notify_all();
+}
+
+inline std::uint64_t SelectNotifier::Sequence() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mSequence;
+}
+
+inline void SelectNotifier::WaitForChange(std::uint64_t sequence) {
+  std::unique_lock<std::mutex> lock(mMutex);
+  mChanged.wait(lock, [&]() { return mSequence != sequence; });
+}
+
+template <class Clock, class Duration>
+bool SelectNotifier::WaitForChangeUntil(
+    std::uint64_t sequence, const std::chrono::time_point<Clock, Duration> &t) {
+  std::unique_lock<std::mutex> lock(mMutex);
+  return mChanged.wait_until(lock, t, [&]() { return mSequence != sequence; });
+}
+
+namespace detail {
+
+inline std::uint64_t InFlightTracker::Popped(bool guarded) {
+  const auto ticket = mNextTicket++;
+  mTasks.emplace(ticket, Entry{InFlightTask{ticket, std::this_thread::get_id(),
+                                            std::chrono::steady_clock::now()},
+                               guarded});
+  if (!guarded)
+    ++mUnguarded;
+  return ticket;
+}
+
+inline void InFlightTracker::Done(std::uint64_t ticket) {
+  if (ticket != 0) {
+    mTasks.erase(ticket);
+    return;
+  }
+  if (mUnguarded == 0)
+    return; // A TaskDone() for an item that was never popped.
+  const auto self = std::this_thread::get_id();
+  auto victim = mTasks.end();
+  for (auto i = mTasks.begin(); i != mTasks.end(); ++i) {
+    if (i->second.guarded)
+      continue;
+    if (i->second.task.consumer == self) {
+      victim = i;
+      break;
+    }
+    if (victim == mTasks.end())
+      victim = i; // Another thread finishes this one, unless we have our own.
+  }
+  mTasks.erase(victim);
+  --mUnguarded;
+}
+
+inline std::vector<InFlightTask>
+InFlightTracker::OlderThan(std::chrono::steady_clock::time_point cutoff) const {
+  std::vector<InFlightTask> result;
+  // Pop times grow with the tickets, so the old tasks are all up front.
+  for (const auto &task : mTasks) {
+    if (task.second.task.popped > cutoff)
+      break;
+    result.push_back(task.second.task);
+  }
+  return result;
+}
+
+} // namespace detail
+
+template <class T, class C, class S>
+SafeQueue<T, C, S>::TaskDoneGuard::TaskDoneGuard(TaskDoneGuard &&other)
+    : mQ(other.mQ), mTicket(other.mTicket) {
   other.mQ = nullptr;
 }
 
-template <class T, class C>
-typename SafeQueue<T, C>::TaskDoneGuard &SafeQueue<T, C>::TaskDoneGuard::
+template <class T, class C, class S>
+typename SafeQueue<T, C, S>::TaskDoneGuard &SafeQueue<T, C, S>::TaskDoneGuard::
 operator=(TaskDoneGuard &&other) {
   mQ = other.mQ;
+  mTicket = other.mTicket;
   other.mQ = nullptr;
   return *this;
 }
 
-template <class T, class C>
-SafeQueue<T, C>::TaskDoneGuard::TaskDoneGuard(SafeQueue *q) : mQ(q) {}
+template <class T, class C, class S>
+SafeQueue<T, C, S>::TaskDoneGuard::TaskDoneGuard(SafeQueue *q,
+                                                 std::uint64_t ticket)
+    : mQ(q), mTicket(ticket) {}
 
-template <class T, class C>
-SafeQueue<T, C>::TaskDoneGuard::~TaskDoneGuard() noexcept(false) {
+template <class T, class C, class S>
+SafeQueue<T, C, S>::TaskDoneGuard::~TaskDoneGuard() noexcept(false) {
   if (mQ)
-    mQ->TaskDone();
+    mQ->Finish(mTicket);
+}
+
+template <class T, class C, class S>
+SafeQueue<T, C, S>::ProducerHandle::ProducerHandle(SafeQueue *q,
+                                                size_type batchSize,
+                                                Clock::duration maxDelay)
+    : mQ(q), mBatch(new Batch) {
+  mBatch->size = std::max<size_type>(batchSize, 1);
+  mBatch->maxDelay = maxDelay;
+  mBatch->items.reserve(mBatch->size);
+  std::lock_guard<std::mutex> lock(mQ->mProducersMutex);
+  mQ->mProducers.push_back(mBatch.get());
+  if (maxDelay != Clock::duration::max())
+    mQ->mTimedProducers.fetch_add(1, std::memory_order_seq_cst);
+}
+
+template <class T, class C, class S>
+SafeQueue<T, C, S>::ProducerHandle::ProducerHandle(ProducerHandle &&other)
+    : mQ(other.mQ), mBatch(std::move(other.mBatch)) {
+  other.mQ = nullptr;
+}
+
+template <class T, class C, class S>
+typename SafeQueue<T, C, S>::ProducerHandle &
+SafeQueue<T, C, S>::ProducerHandle::operator=(ProducerHandle &&other) {
+  Release();
+  mQ = other.mQ;
+  mBatch = std::move(other.mBatch);
+  other.mQ = nullptr;
+  return *this;
+}
+
+template <class T, class C, class S>
+SafeQueue<T, C, S>::ProducerHandle::~ProducerHandle() {
+  Release();
 }
 
-template <class T, class C> SafeQueue<T, C>::~SafeQueue() {
+template <class T, class C, class S>
+void SafeQueue<T, C, S>::ProducerHandle::Release() {
+  if (!mQ || !mBatch)
+    return;
+  {
+    std::lock_guard<std::mutex> lock(mQ->mProducersMutex);
+    auto &producers = mQ->mProducers;
+    producers.erase(
+        std::remove(producers.begin(), producers.end(), mBatch.get()),
+        producers.end());
+    if (mBatch->maxDelay != Clock::duration::max())
+      mQ->mTimedProducers.fetch_sub(1, std::memory_order_seq_cst);
+  }
+  Flush();
+}
+
+template <class T, class C, class S>
+void SafeQueue<T, C, S>::ProducerHandle::Push(const_reference item) {
+  Emplace(item);
+}
+
+template <class T, class C, class S>
+void SafeQueue<T, C, S>::ProducerHandle::Push(value_type &&item) {
+  Emplace(std::move(item));
+}
+
+template <class T, class C, class S>
+template <class... Args>
+void SafeQueue<T, C, S>::ProducerHandle::Emplace(Args &&... args) {
+  assert(mQ && "Push() on a moved-from ProducerHandle");
+  auto &batch = *mBatch;
+  std::lock_guard<std::mutex> lock(batch.mutex);
+  const bool first = batch.items.empty();
+  batch.items.emplace_back(std::forward<Args>(args)...);
+  const bool timed = batch.maxDelay != Clock::duration::max();
+  if (first && timed)
+    batch.oldest = Clock::now();
+  if (batch.items.size() >= batch.size ||
+      mQ->mJoiners.load(std::memory_order_seq_cst) != 0 ||
+      (timed && (mQ->mSleepers.load(std::memory_order_seq_cst) != 0 ||
+                 Clock::now() - batch.oldest >= batch.maxDelay)))
+    mQ->PushBatch(batch.items);
+}
+
+template <class T, class C, class S>
+void SafeQueue<T, C, S>::ProducerHandle::Flush() {
+  if (!mQ)
+    return;
+  std::lock_guard<std::mutex> lock(mBatch->mutex);
+  if (!mBatch->items.empty())
+    mQ->PushBatch(mBatch->items);
+}
+
+template <class T, class C, class S>
+SafeQueue<T, C, S>::ConsumerHandle::ConsumerHandle(SafeQueue *q,
+                                                size_type maxBatch)
+    : mQ(q), mMaxBatch(std::max<size_type>(maxBatch, 1)) {}
+
+template <class T, class C, class S>
+SafeQueue<T, C, S>::ConsumerHandle::ConsumerHandle(ConsumerHandle &&other)
+    : mQ(other.mQ), mBuffer(std::move(other.mBuffer)),
+      mMaxBatch(other.mMaxBatch), mTracked(other.mTracked) {
+  other.mQ = nullptr;
+}
+
+template <class T, class C, class S>
+typename SafeQueue<T, C, S>::ConsumerHandle &
+SafeQueue<T, C, S>::ConsumerHandle::operator=(ConsumerHandle &&other) {
+  Release();
+  mQ = other.mQ;
+  mBuffer = std::move(other.mBuffer);
+  mMaxBatch = other.mMaxBatch;
+  mTracked = other.mTracked;
+  other.mQ = nullptr;
+  return *this;
+}
+
+template <class T, class C, class S>
+SafeQueue<T, C, S>::ConsumerHandle::~ConsumerHandle() {
+  Release();
+}
+
+template <class T, class C, class S>
+void SafeQueue<T, C, S>::ConsumerHandle::Release() {
+  if (mQ && !mBuffer.empty())
+    mQ->ReturnBatch(mBuffer);
+}
+
+template <class T, class C, class S>
+typename SafeQueue<T, C, S>::value_type
+SafeQueue<T, C, S>::ConsumerHandle::TakeFront() {
+  auto item = std::move(mBuffer.front());
+  mBuffer.pop_front();
+  return item;
+}
+
+template <class T, class C, class S>
+typename SafeQueue<T, C, S>::value_type
+SafeQueue<T, C, S>::ConsumerHandle::Next() {
+  assert(mQ && "Pop() on a moved-from ConsumerHandle");
+  if (mBuffer.empty()) {
+    UniqueLock lock(mQ->mMutex);
+    mQ->WaitNotEmpty(lock);
+    mQ->TakeBatch(mBuffer, mMaxBatch);
+    mTracked = mQ->mTracker != nullptr;
+  }
+  return TakeFront();
+}
+
+template <class T, class C, class S>
+typename SafeQueue<T, C, S>::value_type
+SafeQueue<T, C, S>::ConsumerHandle::Pop() {
+  auto item = Next();
+  // Buffered items are not in flight yet; this one is from now on.
+  if (mTracked)
+    mQ->Track(false);
+  return item;
+}
+
+template <class T, class C, class S>
+std::pair<typename SafeQueue<T, C, S>::value_type,
+          typename SafeQueue<T, C, S>::TaskDoneGuard>
+SafeQueue<T, C, S>::ConsumerHandle::PopWithGuard() {
+  auto item = Next();
+  const auto ticket = mTracked ? mQ->Track(true) : 0;
+  return std::make_pair(std::move(item), TaskDoneGuard(mQ, ticket));
+}
+
+template <class T, class C, class S>
+template <class Rep, class Period>
+typename SafeQueue<T, C, S>::value_type SafeQueue<T, C, S>::ConsumerHandle::Next(
+    const std::chrono::duration<Rep, Period> &timeout) {
+  assert(mQ && "Pop() on a moved-from ConsumerHandle");
+  if (mBuffer.empty()) {
+    UniqueLock lock(mQ->mMutex);
+    if (!mQ->WaitNotEmpty(lock, timeout))
+      throw TimeoutError();
+    mQ->TakeBatch(mBuffer, mMaxBatch);
+    mTracked = mQ->mTracker != nullptr;
+  }
+  return TakeFront();
+}
+
+template <class T, class C, class S>
+template <class Rep, class Period>
+typename SafeQueue<T, C, S>::value_type SafeQueue<T, C, S>::ConsumerHandle::Pop(
+    const std::chrono::duration<Rep, Period> &timeout) {
+  auto item = Next(timeout);
+  if (mTracked)
+    mQ->Track(false);
+  return item;
+}
+
+template <class T, class C, class S>
+template <class Rep, class Period>
+std::pair<typename SafeQueue<T, C, S>::value_type,
+          typename SafeQueue<T, C, S>::TaskDoneGuard>
+SafeQueue<T, C, S>::ConsumerHandle::PopWithGuard(
+    const std::chrono::duration<Rep, Period> &timeout) {
+  auto item = Next(timeout);
+  const auto ticket = mTracked ? mQ->Track(true) : 0;
+  return std::make_pair(std::move(item), TaskDoneGuard(mQ, ticket));
+}
+
+template <class T, class C, class S> SafeQueue<T, C, S>::~SafeQueue() {
   Join();
   assert(mUnfinishedTasks == 0 && "Expected all tasks to be finished");
 }
 
-template <class T, class C> void SafeQueue<T, C>::Push(const_reference item) {
+template <class T, class C, class S>
+void SafeQueue<T, C, S>::Push(const_reference item) {
   {
     LockGuard lock(mMutex);
     mQ.push(item);
     ++mUnfinishedTasks;
+    NotifySubscribers();
   }
   mNotEmpty.notify_one();
 }
 
-template <class T, class C> void SafeQueue<T, C>::Push(value_type &&item) {
+template <class T, class C, class S>
+void SafeQueue<T, C, S>::Push(value_type &&item) {
   {
     LockGuard lock(mMutex);
     mQ.push(std::move(item));
     ++mUnfinishedTasks;
+    NotifySubscribers();
   }
   mNotEmpty.notify_one();
 }
 
-template <class T, class C>
-void SafeQueue<T, C>::PushAndJoin(const_reference item) {
+template <class T, class C, class S>
+void SafeQueue<T, C, S>::PushAndJoin(const_reference item) {
+  Joining joining(this);
   UniqueLock lock(mMutex);
   mQ.push(item);
   ++mUnfinishedTasks;
+  NotifySubscribers();
   mNotEmpty.notify_one();
   mAllTasksDone.wait(lock, [this]() { return mUnfinishedTasks == 0; });
 }
 
-template <class T, class C>
-void SafeQueue<T, C>::PushAndJoin(value_type &&item) {
+template <class T, class C, class S>
+void SafeQueue<T, C, S>::PushAndJoin(value_type &&item) {
+  Joining joining(this);
   UniqueLock lock(mMutex);
   mQ.push(std::move(item));
   ++mUnfinishedTasks;
+  NotifySubscribers();
   mNotEmpty.notify_one();
   mAllTasksDone.wait(lock, [this]() { return mUnfinishedTasks == 0; });
 }
 
-template <class T, class C>
+template <class T, class C, class S>
 template <class... Args>
-void SafeQueue<T, C>::Emplace(Args &&... args) {
+void SafeQueue<T, C, S>::Emplace(Args &&... args) {
   {
     LockGuard lock(mMutex);
     mQ.emplace(std::forward<Args>(args)...);
     ++mUnfinishedTasks;
+    NotifySubscribers();
   }
   mNotEmpty.notify_one();
 }
 
-template <class T, class C>
+template <class T, class C, class S>
 template <class... Args>
-void SafeQueue<T, C>::EmplaceAndJoin(Args &&... args) {
+void SafeQueue<T, C, S>::EmplaceAndJoin(Args &&... args) {
+  Joining joining(this);
   UniqueLock lock(mMutex);
   mQ.emplace(std::forward<Args>(args)...);
   ++mUnfinishedTasks;
+  NotifySubscribers();
   mNotEmpty.notify_one();
   mAllTasksDone.wait(lock, [this]() { return mUnfinishedTasks == 0; });
 }
 
-template <class T, class C>
-typename SafeQueue<T, C>::value_type SafeQueue<T, C>::Pop() {
-  UniqueLock lock(mMutex);
+template <class T, class C, class S>
+typename SafeQueue<T, C, S>::ProducerHandle
+SafeQueue<T, C, S>::MakeProducer(size_type batchSize) {
+  return ProducerHandle(this, batchSize,
+                        ProducerHandle::Clock::duration::max());
+}
+
+template <class T, class C, class S>
+template <class Rep, class Period>
+typename SafeQueue<T, C, S>::ProducerHandle SafeQueue<T, C, S>::MakeProducer(
+    size_type batchSize, const std::chrono::duration<Rep, Period> &maxDelay) {
+  return ProducerHandle(
+      this, batchSize,
+      std::chrono::duration_cast<typename ProducerHandle::Clock::duration>(
+          maxDelay));
+}
+
+template <class T, class C, class S>
+void SafeQueue<T, C, S>::PushBatch(std::vector<value_type> &items) {
+  const auto count = items.size();
+  {
+    LockGuard lock(mMutex);
+    for (auto &&item : items)
+      mQ.push(std::move(item));
+    mUnfinishedTasks += count;
+    NotifySubscribers();
+  }
+  items.clear();
+  if (count == 1)
+    mNotEmpty.notify_one();
+  else
+    mNotEmpty.notify_all();
+}
+
+template <class T, class C, class S>
+void SafeQueue<T, C, S>::FlushProducers(bool timedOnly) {
+  using Clock = typename ProducerHandle::Clock;
+  std::lock_guard<std::mutex> lock(mProducersMutex);
+  for (auto *batch : mProducers) {
+    if (timedOnly && batch->maxDelay == Clock::duration::max())
+      continue;
+    std::lock_guard<std::mutex> batchLock(batch->mutex);
+    if (!batch->items.empty())
+      PushBatch(batch->items);
+  }
+}
+
+template <class T, class C, class S>
+SafeQueue<T, C, S>::Joining::Joining(SafeQueue *q) : mQ(q) {
+  // Count first: a producer that buffers after our flush sees the count and
+  // flushes by itself.
+  mQ->mJoiners.fetch_add(1, std::memory_order_seq_cst);
+  mQ->FlushProducers();
+}
+
+template <class T, class C, class S> SafeQueue<T, C, S>::Joining::~Joining() {
+  mQ->mJoiners.fetch_sub(1, std::memory_order_seq_cst);
+}
+
+template <class T, class C, class S>
+SafeQueue<T, C, S>::Sleeping::Sleeping(SafeQueue *q, UniqueLock &lock)
+    : mQ(q) {
+  // Count first: a timed producer that buffers after our flush sees the count
+  // and flushes by itself, and one that registers after our check sees it too.
+  mQ->mSleepers.fetch_add(1, std::memory_order_seq_cst);
+  if (mQ->mTimedProducers.load(std::memory_order_seq_cst) != 0) {
+    lock.unlock();
+    mQ->FlushProducers(true);
+    lock.lock();
+  }
+}
+
+template <class T, class C, class S>
+SafeQueue<T, C, S>::Sleeping::~Sleeping() {
+  mQ->mSleepers.fetch_sub(1, std::memory_order_seq_cst);
+}
+
+template <class T, class C, class S>
+typename SafeQueue<T, C, S>::ConsumerHandle
+SafeQueue<T, C, S>::MakeConsumer(size_type maxBatch) {
+  return ConsumerHandle(this, maxBatch);
+}
+
+template <class T, class C, class S>
+void SafeQueue<T, C, S>::WaitNotEmpty(UniqueLock &lock) {
+  if (!mQ.empty())
+    return;
+  Sleeping sleeping(this, lock);
+  ++mWaitingConsumers;
   mNotEmpty.wait(lock, [this]() { return !mQ.empty(); });
+  --mWaitingConsumers;
+}
+
+template <class T, class C, class S>
+template <class Rep, class Period>
+bool SafeQueue<T, C, S>::WaitNotEmpty(
+    UniqueLock &lock, const std::chrono::duration<Rep, Period> &timeout) {
+  if (!mQ.empty())
+    return true;
+  Sleeping sleeping(this, lock);
+  ++mWaitingConsumers;
+  const bool ready =
+      mNotEmpty.wait_for(lock, timeout, [this]() { return !mQ.empty(); });
+  --mWaitingConsumers;
+  return ready;
+}
+
+template <class T, class C, class S>
+void SafeQueue<T, C, S>::TakeBatch(std::deque<value_type> &out,
+                                size_type maxBatch) {
+  const size_type share = mQ.size() / (mWaitingConsumers + 1);
+  auto count = std::min(std::max<size_type>(share, 1), maxBatch);
+  for (; count > 0; --count) {
+    out.push_back(std::move(mQ.front()));
+    mQ.pop();
+  }
+}
+
+template <class T, class C, class S>
+void SafeQueue<T, C, S>::ReturnBatch(std::deque<value_type> &items) {
+  const auto count = items.size();
+  {
+    LockGuard lock(mMutex);
+    // These are still counted as unfinished tasks. They were taken from the
+    // front, so that is where they go back.
+    mQ.PushFront(std::make_move_iterator(items.begin()),
+                 std::make_move_iterator(items.end()));
+    NotifySubscribers();
+  }
+  items.clear();
+  if (count == 1)
+    mNotEmpty.notify_one();
+  else
+    mNotEmpty.notify_all();
+}
+
+template <class T, class C, class S>
+typename SafeQueue<T, C, S>::value_type
+SafeQueue<T, C, S>::TakeFront(std::uint64_t *ticket) {
   auto item = std::move(mQ.front());
   mQ.pop();
-  lock.unlock();
+  if (mTracker) {
+    const auto popped = mTracker->Popped(ticket != nullptr);
+    if (ticket)
+      *ticket = popped;
+  } else if (ticket) {
+    *ticket = 0;
+  }
   return item;
 }
 
-template <class T, class C>
-std::pair<typename SafeQueue<T, C>::value_type,
-          typename SafeQueue<T, C>::TaskDoneGuard>
-SafeQueue<T, C>::PopWithGuard() {
-  return std::make_pair(Pop(), TaskDoneGuard(this));
+template <class T, class C, class S>
+std::uint64_t SafeQueue<T, C, S>::Track(bool guarded) {
+  LockGuard lock(mMutex);
+  return mTracker ? mTracker->Popped(guarded) : 0;
+}
+
+template <class T, class C, class S>
+typename SafeQueue<T, C, S>::value_type
+SafeQueue<T, C, S>::PopTicket(std::uint64_t *ticket) {
+  UniqueLock lock(mMutex);
+  WaitNotEmpty(lock);
+  auto item = TakeFront(ticket);
+  lock.unlock();
+  return item;
 }
 
-template <class T, class C>
+template <class T, class C, class S>
 template <class Rep, class Period>
-typename SafeQueue<T, C>::value_type
-SafeQueue<T, C>::Pop(const std::chrono::duration<Rep, Period> &timeout) {
+typename SafeQueue<T, C, S>::value_type SafeQueue<T, C, S>::PopTicket(
+    std::uint64_t *ticket, const std::chrono::duration<Rep, Period> &timeout) {
   UniqueLock lock(mMutex);
-  if (mNotEmpty.wait_for(lock, timeout, [this]() { return !mQ.empty(); })) {
-    auto item = std::move(mQ.front());
-    mQ.pop();
+  if (WaitNotEmpty(lock, timeout)) {
+    auto item = TakeFront(ticket);
     lock.unlock();
     return item;
   }
   throw TimeoutError();
 }
 
-template <class T, class C>
+template <class T, class C, class S>
+typename SafeQueue<T, C, S>::value_type SafeQueue<T, C, S>::Pop() {
+  return PopTicket(nullptr);
+}
+
+template <class T, class C, class S>
+std::pair<typename SafeQueue<T, C, S>::value_type,
+          typename SafeQueue<T, C, S>::TaskDoneGuard>
+SafeQueue<T, C, S>::PopWithGuard() {
+  std::uint64_t ticket;
+  auto item = PopTicket(&ticket);
+  return std::make_pair(std::move(item), TaskDoneGuard(this, ticket));
+}
+
+template <class T, class C, class S>
 template <class Rep, class Period>
-std::pair<typename SafeQueue<T, C>::value_type,
-          typename SafeQueue<T, C>::TaskDoneGuard>
-SafeQueue<T, C>::PopWithGuard(
+typename SafeQueue<T, C, S>::value_type
+SafeQueue<T, C, S>::Pop(const std::chrono::duration<Rep, Period> &timeout) {
+  return PopTicket(nullptr, timeout);
+}
+
+template <class T, class C, class S>
+template <class Rep, class Period>
+std::pair<typename SafeQueue<T, C, S>::value_type,
+          typename SafeQueue<T, C, S>::TaskDoneGuard>
+SafeQueue<T, C, S>::PopWithGuard(
     const std::chrono::duration<Rep, Period> &timeout) {
-  return std::make_pair(Pop(timeout), TaskDoneGuard(this));
+  // Pop first: if it throws, no guard may exist to call TaskDone().
+  std::uint64_t ticket;
+  auto item = PopTicket(&ticket, timeout);
+  return std::make_pair(std::move(item), TaskDoneGuard(this, ticket));
+}
+
+template <class T, class C, class S>
+bool SafeQueue<T, C, S>::TryPop(reference item) {
+  LockGuard lock(mMutex);
+  if (mQ.empty())
+    return false;
+  item = TakeFront(nullptr);
+  return true;
+}
+
+template <class T, class C, class S> void SafeQueue<T, C, S>::TaskDone() {
+  Finish(0);
 }
 
-template <class T, class C> void SafeQueue<T, C>::TaskDone() {
+template <class T, class C, class S>
+void SafeQueue<T, C, S>::Finish(std::uint64_t ticket) {
   LockGuard lock(mMutex);
+  if (mTracker)
+    mTracker->Done(ticket);
   assert(mUnfinishedTasks > 0 && "TaskDone() called too many times");
   --mUnfinishedTasks;
   if (mUnfinishedTasks == 0)
     mAllTasksDone.notify_all();
 }
 
-template <class T, class C> void SafeQueue<T, C>::Join() {
+template <class T, class C, class S> void SafeQueue<T, C, S>::Join() {
+  Joining joining(this);
   UniqueLock lock(mMutex);
   mAllTasksDone.wait(lock, [this]() { return mUnfinishedTasks == 0; });
 }
 
+template <class T, class C, class S> bool SafeQueue<T, C, S>::Empty() {
+  LockGuard lock(mMutex);
+  return mQ.empty();
+}
+
+template <class T, class C, class S>
+typename SafeQueue<T, C, S>::size_type SafeQueue<T, C, S>::Size() {
+  LockGuard lock(mMutex);
+  return mQ.size();
+}
+
+template <class T, class C, class S>
+void SafeQueue<T, C, S>::Subscribe(SelectNotifier &notifier) {
+  LockGuard lock(mMutex);
+  mSubscribers.push_back(&notifier);
+}
+
+template <class T, class C, class S>
+void SafeQueue<T, C, S>::Unsubscribe(SelectNotifier &notifier) {
+  LockGuard lock(mMutex);
+  mSubscribers.erase(
+      std::remove(mSubscribers.begin(), mSubscribers.end(), &notifier),
+      mSubscribers.end());
+}
+
+template <class T, class C, class S> void SafeQueue<T, C, S>::TrackInFlight() {
+  LockGuard lock(mMutex);
+  if (!mTracker)
+    mTracker.reset(new detail::InFlightTracker);
+}
+
+template <class T, class C, class S>
+template <class Rep, class Period>
+std::vector<InFlightTask>
+SafeQueue<T, C, S>::InFlight(const std::chrono::duration<Rep, Period> &age) {
+  const auto cutoff = std::chrono::steady_clock::now() -
+                      std::chrono::duration_cast<
+                          std::chrono::steady_clock::duration>(age);
+  LockGuard lock(mMutex);
+  if (!mTracker)
+    return {};
+  return mTracker->OlderThan(cutoff);
+}
+
+template <class T, class C, class S>
+typename SafeQueue<T, C, S>::size_type SafeQueue<T, C, S>::InFlightCount() {
+  LockGuard lock(mMutex);
+  return mTracker ? mTracker->Size() : 0;
+}
+
+template <class T, class C, class S>
+typename SafeQueue<T, C, S>::size_type SafeQueue<T, C, S>::UntrackedCount() {
+  LockGuard lock(mMutex);
+  const std::size_t known = mQ.size() + (mTracker ? mTracker->Size() : 0);
+  return mUnfinishedTasks > known ? mUnfinishedTasks - known : 0;
+}
+
+template <class T, class C, class S>
+void SafeQueue<T, C, S>::NotifySubscribers() {
+  for (auto *notifier : mSubscribers)
+    notifier->Notify();
+}
+
 } // namespace rwols
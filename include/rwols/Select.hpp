@@ -0,0 +1,138 @@
+///\file    Select.hpp
+///\brief   Wait until any one of several queues has an item
+///\author  Raoul Wols
+///\date    October, 2026
+
+#pragma once
+
+#include <rwols/SafeQueue.hpp>
+
+#include <tuple>
+#include <utility>
+
+namespace rwols {
+
+/// Blocks on a single notifier shared by several queues until one of them is
+/// non-empty. Queues are listed in priority order: when more than one queue
+/// has items, Wait() returns the index of the first. Every queue type that has
+/// Empty(), Subscribe(SelectNotifier &) and Unsubscribe(SelectNotifier &)
+/// can take part.
+///
+/// Wait() only reports readiness. If several threads consume from the same
+/// queues, another thread may take the item first. Pop with TryPop() and call
+/// Wait() again when it fails.
+template <class... Queues> class Selector final {
+  static_assert(sizeof...(Queues) > 0, "Select from at least one queue");
+
+public:
+  explicit Selector(Queues &... queues);
+  Selector(const Selector &) = delete;
+  Selector &operator=(const Selector &) = delete;
+  ~Selector();
+
+  std::size_t Wait();
+  template <class Rep, class Period>
+  std::size_t Wait(const std::chrono::duration<Rep, Period> &timeout);
+
+private:
+  static constexpr std::size_t kNone = sizeof...(Queues);
+
+  std::tuple<Queues *...> mQueues;
+  SelectNotifier mNotifier;
+
+  template <std::size_t I>
+  std::size_t FirstReady(std::integral_constant<std::size_t, I>);
+  std::size_t FirstReady(std::integral_constant<std::size_t, kNone>);
+  template <std::size_t... I> void Subscribe(std::index_sequence<I...>);
+  template <std::size_t... I> void Unsubscribe(std::index_sequence<I...>);
+};
+
+/// Blocks until one of the queues is non-empty and returns its index.
+/// Earlier arguments have priority over later ones.
+template <class... Queues> std::size_t WaitAny(Queues &... queues);
+
+/// Same as above, but throws a TimeoutError when nothing arrives in time.
+template <class Rep, class Period, class... Queues>
+std::size_t WaitAny(const std::chrono::duration<Rep, Period> &timeout,
+                    Queues &... queues);
+
+// Implementation follows.
+
+template <class... Qs>
+Selector<Qs...>::Selector(Qs &... queues) : mQueues(&queues...) {
+  Subscribe(std::index_sequence_for<Qs...>());
+}
+
+template <class... Qs> Selector<Qs...>::~Selector() {
+  Unsubscribe(std::index_sequence_for<Qs...>());
+}
+
+template <class... Qs>
+template <std::size_t... I>
+void Selector<Qs...>::Subscribe(std::index_sequence<I...>) {
+  int unused[] = {(std::get<I>(mQueues)->Subscribe(mNotifier), 0)...};
+  (void)unused;
+}
+
+template <class... Qs>
+template <std::size_t... I>
+void Selector<Qs...>::Unsubscribe(std::index_sequence<I...>) {
+  int unused[] = {(std::get<I>(mQueues)->Unsubscribe(mNotifier), 0)...};
+  (void)unused;
+}
+
+template <class... Qs>
+template <std::size_t I>
+std::size_t
+Selector<Qs...>::FirstReady(std::integral_constant<std::size_t, I>) {
+  if (!std::get<I>(mQueues)->Empty())
+    return I;
+  return FirstReady(std::integral_constant<std::size_t, I + 1>());
+}
+
+template <class... Qs>
+std::size_t
+Selector<Qs...>::FirstReady(std::integral_constant<std::size_t, kNone>) {
+  return kNone;
+}
+
+template <class... Qs> std::size_t Selector<Qs...>::Wait() {
+  while (true) {
+    // Read the sequence before looking at the queues: a push that we miss
+    // below has bumped it, so WaitForChange() returns immediately.
+    const auto sequence = mNotifier.Sequence();
+    const auto ready = FirstReady(std::integral_constant<std::size_t, 0>());
+    if (ready != kNone)
+      return ready;
+    mNotifier.WaitForChange(sequence);
+  }
+}
+
+template <class... Qs>
+template <class Rep, class Period>
+std::size_t
+Selector<Qs...>::Wait(const std::chrono::duration<Rep, Period> &timeout) {
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (true) {
+    const auto sequence = mNotifier.Sequence();
+    const auto ready = FirstReady(std::integral_constant<std::size_t, 0>());
+    if (ready != kNone)
+      return ready;
+    if (!mNotifier.WaitForChangeUntil(sequence, deadline))
+      throw TimeoutError();
+  }
+}
+
+template <class... Queues> std::size_t WaitAny(Queues &... queues) {
+  Selector<Queues...> selector(queues...);
+  return selector.Wait();
+}
+
+template <class Rep, class Period, class... Queues>
+std::size_t WaitAny(const std::chrono::duration<Rep, Period> &timeout,
+                    Queues &... queues) {
+  Selector<Queues...> selector(queues...);
+  return selector.Wait(timeout);
+}
+
+} // namespace rwols
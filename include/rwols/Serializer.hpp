@@ -0,0 +1,53 @@
+///\file    Serializer.hpp
+///\brief   Default serializer for queues that persist their items
+///\author  Raoul Wols
+///\date    October, 2026
+
+#pragma once
+
+#include <cassert>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+namespace rwols {
+
+/// Queues that write items to disk take a Serializer type parameter with two
+/// static functions:
+/// \code
+///   static void Serialize(const T &item, std::string &out); // appends
+///   static T Deserialize(const char *data, std::size_t size);
+/// \endcode
+/// DefaultSerializer copies the object representation of trivially copyable
+/// types, and the bytes of std::string.
+template <class T> struct DefaultSerializer {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "Provide a Serializer for types that are not trivially "
+                "copyable");
+
+  static void Serialize(const T &item, std::string &out) {
+    out.append(reinterpret_cast<const char *>(&item), sizeof(T));
+  }
+
+  static T Deserialize(const char *data, std::size_t size) {
+    assert(size == sizeof(T) && "Record size does not match the item type");
+    (void)size;
+    // T is trivially copyable but need not be default constructible.
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type item;
+    std::memcpy(&item, data, sizeof(T));
+    return *reinterpret_cast<T *>(&item);
+  }
+};
+
+/// Serializer for std::string items; the bytes are stored as they are.
+template <> struct DefaultSerializer<std::string> {
+  static void Serialize(const std::string &item, std::string &out) {
+    out.append(item);
+  }
+
+  static std::string Deserialize(const char *data, std::size_t size) {
+    return std::string(data, size);
+  }
+};
+
+} // namespace rwols
@@ -0,0 +1,480 @@
+///\file    SharedMemorySafeQueue.hpp
+///\brief   Bounded queue shared between processes
+///\author  Raoul Wols
+///\date    October, 2026
+
+#pragma once
+
+#include <rwols/SafeQueue.hpp>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace rwols {
+
+/// A bounded queue that lives in a shared memory region. Every process that
+/// maps the region sees the same queue, and items cross over with a single
+/// memcpy. The region holds process-shared robust pthread primitives. On
+/// Linux these are futex based, so an uncontended Push or Pop makes no system
+/// call. If a process dies while it holds the lock, the next locker takes
+/// over.
+///
+/// Create() makes a named region (shm_open) and Open() attaches to it.
+/// Anonymous() makes an unnamed memfd region that child processes inherit
+/// through fork(). Destroying a SharedMemorySafeQueue only unmaps the region;
+/// it does not Join(), since the remaining tasks may belong to other
+/// processes.
+template <class T> class SharedMemorySafeQueue final {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "Items must be trivially copyable to cross processes");
+
+public:
+  using value_type = T;
+  using size_type = std::size_t;
+  using reference = value_type &;
+  using const_reference = const value_type &;
+
+  struct TaskDoneGuard {
+    TaskDoneGuard(const TaskDoneGuard &) = delete;
+    TaskDoneGuard(TaskDoneGuard &&);
+    TaskDoneGuard &operator=(const TaskDoneGuard &) = delete;
+    TaskDoneGuard &operator=(TaskDoneGuard &&);
+    ~TaskDoneGuard() noexcept(false);
+
+  private:
+    SharedMemorySafeQueue *mQ = nullptr;
+    TaskDoneGuard(SharedMemorySafeQueue *);
+    friend class SharedMemorySafeQueue;
+  };
+
+  static SharedMemorySafeQueue Create(const std::string &name,
+                                      size_type capacity);
+  static SharedMemorySafeQueue Open(const std::string &name);
+  static SharedMemorySafeQueue Anonymous(size_type capacity);
+  static void Unlink(const std::string &name);
+
+  SharedMemorySafeQueue(SharedMemorySafeQueue &&);
+  SharedMemorySafeQueue &operator=(SharedMemorySafeQueue &&);
+  SharedMemorySafeQueue(const SharedMemorySafeQueue &) = delete;
+  SharedMemorySafeQueue &operator=(const SharedMemorySafeQueue &) = delete;
+  ~SharedMemorySafeQueue();
+
+  size_type capacity() const noexcept { return mHeader->capacity; }
+
+  void Push(const_reference item);
+  bool TryPush(const_reference item);
+  void PushAndJoin(const_reference item);
+
+  value_type Pop();
+  std::pair<value_type, TaskDoneGuard> PopWithGuard();
+  template <class Rep, class Period>
+  value_type Pop(const std::chrono::duration<Rep, Period> &timeout);
+  template <class Rep, class Period>
+  std::pair<value_type, TaskDoneGuard>
+  PopWithGuard(const std::chrono::duration<Rep, Period> &timeout);
+  bool TryPop(reference item);
+
+  void TaskDone();
+
+  void Join();
+
+private:
+  static constexpr std::uint64_t kMagic = 0x7277'6f6c'7353'514dull;
+
+  struct Header {
+    std::uint64_t magic;
+    std::uint64_t capacity;
+    std::uint64_t itemSize;
+    pthread_mutex_t mutex;
+    pthread_cond_t notEmpty, notFull, allTasksDone;
+    std::uint64_t head; // Next slot to pop; only ever incremented.
+    std::uint64_t tail; // Next slot to push; only ever incremented.
+    std::uint64_t unfinishedTasks;
+  };
+
+  class Lock {
+  public:
+    explicit Lock(Header *header);
+    Lock(const Lock &) = delete;
+    Lock &operator=(const Lock &) = delete;
+    ~Lock();
+    void Wait(pthread_cond_t *condition);
+    bool WaitUntil(pthread_cond_t *condition, const timespec &deadline);
+
+  private:
+    Header *mHeader;
+  };
+
+  int mFd = -1;
+  std::size_t mLength = 0;
+  Header *mHeader = nullptr;
+  unsigned char *mSlots = nullptr;
+
+  SharedMemorySafeQueue(int fd, std::size_t length, bool initialize,
+                        size_type capacity);
+
+  static std::size_t SlotsOffset();
+  static std::size_t RegionSize(size_type capacity);
+  static void ThrowErrno(const char *what);
+  static void Check(int error, const char *what);
+  static void CheckCapacity(size_type capacity);
+
+  bool Full() const noexcept;
+  bool Empty() const noexcept;
+  void PushLocked(const_reference item);
+  value_type PopLocked();
+};
+
+// Implementation follows.
+
+template <class T>
+SharedMemorySafeQueue<T>::TaskDoneGuard::TaskDoneGuard(TaskDoneGuard &&other)
+    : mQ(other.mQ) {
+  other.mQ = nullptr;
+}
+
+template <class T>
+typename SharedMemorySafeQueue<T>::TaskDoneGuard &
+SharedMemorySafeQueue<T>::TaskDoneGuard::operator=(TaskDoneGuard &&other) {
+  mQ = other.mQ;
+  other.mQ = nullptr;
+  return *this;
+}
+
+template <class T>
+SharedMemorySafeQueue<T>::TaskDoneGuard::TaskDoneGuard(
+    SharedMemorySafeQueue *q)
+    : mQ(q) {}
+
+template <class T>
+SharedMemorySafeQueue<T>::TaskDoneGuard::~TaskDoneGuard() noexcept(false) {
+  if (mQ)
+    mQ->TaskDone();
+}
+
+template <class T>
+SharedMemorySafeQueue<T>::Lock::Lock(Header *header) : mHeader(header) {
+  const int error = ::pthread_mutex_lock(&mHeader->mutex);
+  if (error == EOWNERDEAD)
+    ::pthread_mutex_consistent(&mHeader->mutex);
+  else
+    Check(error, "pthread_mutex_lock");
+}
+
+template <class T> SharedMemorySafeQueue<T>::Lock::~Lock() {
+  ::pthread_mutex_unlock(&mHeader->mutex);
+}
+
+template <class T>
+void SharedMemorySafeQueue<T>::Lock::Wait(pthread_cond_t *condition) {
+  const int error = ::pthread_cond_wait(condition, &mHeader->mutex);
+  if (error == EOWNERDEAD)
+    ::pthread_mutex_consistent(&mHeader->mutex);
+  else
+    Check(error, "pthread_cond_wait");
+}
+
+template <class T>
+bool SharedMemorySafeQueue<T>::Lock::WaitUntil(pthread_cond_t *condition,
+                                               const timespec &deadline) {
+  const int error =
+      ::pthread_cond_timedwait(condition, &mHeader->mutex, &deadline);
+  if (error == ETIMEDOUT)
+    return false;
+  if (error == EOWNERDEAD)
+    ::pthread_mutex_consistent(&mHeader->mutex);
+  else
+    Check(error, "pthread_cond_timedwait");
+  return true;
+}
+
+template <class T> void SharedMemorySafeQueue<T>::ThrowErrno(const char *what) {
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+template <class T>
+void SharedMemorySafeQueue<T>::Check(int error, const char *what) {
+  if (error != 0)
+    throw std::system_error(error, std::generic_category(), what);
+}
+
+template <class T>
+void SharedMemorySafeQueue<T>::CheckCapacity(size_type capacity) {
+  if (capacity == 0)
+    throw std::invalid_argument("SharedMemorySafeQueue needs a capacity");
+}
+
+template <class T> std::size_t SharedMemorySafeQueue<T>::SlotsOffset() {
+  constexpr std::size_t align = alignof(T) > 64 ? alignof(T) : 64;
+  return (sizeof(Header) + align - 1) / align * align;
+}
+
+template <class T>
+std::size_t SharedMemorySafeQueue<T>::RegionSize(size_type capacity) {
+  return SlotsOffset() + capacity * sizeof(T);
+}
+
+template <class T>
+SharedMemorySafeQueue<T>
+SharedMemorySafeQueue<T>::Create(const std::string &name, size_type capacity) {
+  CheckCapacity(capacity);
+  const int fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0)
+    ThrowErrno("shm_open");
+  try {
+    return SharedMemorySafeQueue(fd, RegionSize(capacity), true, capacity);
+  } catch (...) {
+    ::shm_unlink(name.c_str());
+    throw;
+  }
+}
+
+template <class T>
+SharedMemorySafeQueue<T>
+SharedMemorySafeQueue<T>::Open(const std::string &name) {
+  const int fd = ::shm_open(name.c_str(), O_RDWR, 0);
+  if (fd < 0)
+    ThrowErrno("shm_open");
+  struct stat info;
+  if (::fstat(fd, &info) != 0) {
+    ::close(fd);
+    ThrowErrno("fstat");
+  }
+  return SharedMemorySafeQueue(fd, static_cast<std::size_t>(info.st_size),
+                               false, 0);
+}
+
+template <class T>
+SharedMemorySafeQueue<T>
+SharedMemorySafeQueue<T>::Anonymous(size_type capacity) {
+  CheckCapacity(capacity);
+#if defined(__linux__)
+  const int fd = ::memfd_create("rwols::SharedMemorySafeQueue", MFD_CLOEXEC);
+  if (fd < 0)
+    ThrowErrno("memfd_create");
+  return SharedMemorySafeQueue(fd, RegionSize(capacity), true, capacity);
+#else
+  (void)capacity;
+  throw std::system_error(ENOSYS, std::generic_category(), "memfd_create");
+#endif
+}
+
+template <class T>
+void SharedMemorySafeQueue<T>::Unlink(const std::string &name) {
+  if (::shm_unlink(name.c_str()) != 0)
+    ThrowErrno("shm_unlink");
+}
+
+template <class T>
+SharedMemorySafeQueue<T>::SharedMemorySafeQueue(int fd, std::size_t length,
+                                                bool initialize,
+                                                size_type capacity)
+    : mFd(fd), mLength(length) {
+  if (initialize && ::ftruncate(mFd, static_cast<off_t>(mLength)) != 0) {
+    ::close(mFd);
+    ThrowErrno("ftruncate");
+  }
+  void *region =
+      ::mmap(nullptr, mLength, PROT_READ | PROT_WRITE, MAP_SHARED, mFd, 0);
+  if (region == MAP_FAILED) {
+    ::close(mFd);
+    ThrowErrno("mmap");
+  }
+  mHeader = static_cast<Header *>(region);
+  mSlots = static_cast<unsigned char *>(region) + SlotsOffset();
+  if (initialize) {
+    new (mHeader) Header();
+    mHeader->capacity = capacity;
+    mHeader->itemSize = sizeof(T);
+    pthread_mutexattr_t mutexAttributes;
+    ::pthread_mutexattr_init(&mutexAttributes);
+    ::pthread_mutexattr_setpshared(&mutexAttributes, PTHREAD_PROCESS_SHARED);
+    ::pthread_mutexattr_setrobust(&mutexAttributes, PTHREAD_MUTEX_ROBUST);
+    ::pthread_mutex_init(&mHeader->mutex, &mutexAttributes);
+    ::pthread_mutexattr_destroy(&mutexAttributes);
+    pthread_condattr_t conditionAttributes;
+    ::pthread_condattr_init(&conditionAttributes);
+    ::pthread_condattr_setpshared(&conditionAttributes, PTHREAD_PROCESS_SHARED);
+    ::pthread_condattr_setclock(&conditionAttributes, CLOCK_MONOTONIC);
+    ::pthread_cond_init(&mHeader->notEmpty, &conditionAttributes);
+    ::pthread_cond_init(&mHeader->notFull, &conditionAttributes);
+    ::pthread_cond_init(&mHeader->allTasksDone, &conditionAttributes);
+    ::pthread_condattr_destroy(&conditionAttributes);
+    // Publish last: Open() refuses a region without the magic number.
+    __atomic_store_n(&mHeader->magic, kMagic, __ATOMIC_RELEASE);
+  } else if (mLength < sizeof(Header) ||
+             __atomic_load_n(&mHeader->magic, __ATOMIC_ACQUIRE) != kMagic ||
+             mHeader->itemSize != sizeof(T) ||
+             mLength < RegionSize(mHeader->capacity)) {
+    ::munmap(region, mLength);
+    ::close(mFd);
+    throw std::system_error(EINVAL, std::generic_category(),
+                            "not a SharedMemorySafeQueue of this type");
+  }
+}
+
+template <class T>
+SharedMemorySafeQueue<T>::SharedMemorySafeQueue(SharedMemorySafeQueue &&other)
+    : mFd(other.mFd), mLength(other.mLength), mHeader(other.mHeader),
+      mSlots(other.mSlots) {
+  other.mFd = -1;
+  other.mHeader = nullptr;
+  other.mSlots = nullptr;
+}
+
+template <class T>
+SharedMemorySafeQueue<T> &
+SharedMemorySafeQueue<T>::operator=(SharedMemorySafeQueue &&other) {
+  // other's destructor releases what used to be ours.
+  std::swap(mFd, other.mFd);
+  std::swap(mLength, other.mLength);
+  std::swap(mHeader, other.mHeader);
+  std::swap(mSlots, other.mSlots);
+  return *this;
+}
+
+template <class T> SharedMemorySafeQueue<T>::~SharedMemorySafeQueue() {
+  if (mHeader)
+    ::munmap(mHeader, mLength);
+  if (mFd >= 0)
+    ::close(mFd);
+}
+
+template <class T> bool SharedMemorySafeQueue<T>::Full() const noexcept {
+  return mHeader->tail - mHeader->head == mHeader->capacity;
+}
+
+template <class T> bool SharedMemorySafeQueue<T>::Empty() const noexcept {
+  return mHeader->tail == mHeader->head;
+}
+
+template <class T>
+void SharedMemorySafeQueue<T>::PushLocked(const_reference item) {
+  const auto slot = mHeader->tail % mHeader->capacity;
+  std::memcpy(mSlots + slot * sizeof(T), &item, sizeof(T));
+  ++mHeader->tail;
+  ++mHeader->unfinishedTasks;
+  ::pthread_cond_signal(&mHeader->notEmpty);
+}
+
+template <class T>
+typename SharedMemorySafeQueue<T>::value_type
+SharedMemorySafeQueue<T>::PopLocked() {
+  const auto slot = mHeader->head % mHeader->capacity;
+  // T is trivially copyable but need not be default constructible.
+  typename std::aligned_storage<sizeof(T), alignof(T)>::type item;
+  std::memcpy(&item, mSlots + slot * sizeof(T), sizeof(T));
+  ++mHeader->head;
+  ::pthread_cond_signal(&mHeader->notFull);
+  return *reinterpret_cast<value_type *>(&item);
+}
+
+template <class T>
+void SharedMemorySafeQueue<T>::Push(const_reference item) {
+  Lock lock(mHeader);
+  while (Full())
+    lock.Wait(&mHeader->notFull);
+  PushLocked(item);
+}
+
+template <class T>
+bool SharedMemorySafeQueue<T>::TryPush(const_reference item) {
+  Lock lock(mHeader);
+  if (Full())
+    return false;
+  PushLocked(item);
+  return true;
+}
+
+template <class T>
+void SharedMemorySafeQueue<T>::PushAndJoin(const_reference item) {
+  Lock lock(mHeader);
+  while (Full())
+    lock.Wait(&mHeader->notFull);
+  PushLocked(item);
+  while (mHeader->unfinishedTasks != 0)
+    lock.Wait(&mHeader->allTasksDone);
+}
+
+template <class T>
+typename SharedMemorySafeQueue<T>::value_type SharedMemorySafeQueue<T>::Pop() {
+  Lock lock(mHeader);
+  while (Empty())
+    lock.Wait(&mHeader->notEmpty);
+  return PopLocked();
+}
+
+template <class T>
+std::pair<typename SharedMemorySafeQueue<T>::value_type,
+          typename SharedMemorySafeQueue<T>::TaskDoneGuard>
+SharedMemorySafeQueue<T>::PopWithGuard() {
+  auto item = Pop();
+  return std::make_pair(item, TaskDoneGuard(this));
+}
+
+template <class T>
+template <class Rep, class Period>
+typename SharedMemorySafeQueue<T>::value_type SharedMemorySafeQueue<T>::Pop(
+    const std::chrono::duration<Rep, Period> &timeout) {
+  timespec deadline;
+  ::clock_gettime(CLOCK_MONOTONIC, &deadline);
+  const auto nanoseconds =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(timeout).count() +
+      deadline.tv_nsec;
+  deadline.tv_sec += static_cast<time_t>(nanoseconds / 1000000000);
+  deadline.tv_nsec = static_cast<long>(nanoseconds % 1000000000);
+  Lock lock(mHeader);
+  while (Empty()) {
+    if (!lock.WaitUntil(&mHeader->notEmpty, deadline) && Empty())
+      throw TimeoutError();
+  }
+  return PopLocked();
+}
+
+template <class T>
+template <class Rep, class Period>
+std::pair<typename SharedMemorySafeQueue<T>::value_type,
+          typename SharedMemorySafeQueue<T>::TaskDoneGuard>
+SharedMemorySafeQueue<T>::PopWithGuard(
+    const std::chrono::duration<Rep, Period> &timeout) {
+  auto item = Pop(timeout);
+  return std::make_pair(item, TaskDoneGuard(this));
+}
+
+template <class T> bool SharedMemorySafeQueue<T>::TryPop(reference item) {
+  Lock lock(mHeader);
+  if (Empty())
+    return false;
+  item = PopLocked();
+  return true;
+}
+
+template <class T> void SharedMemorySafeQueue<T>::TaskDone() {
+  Lock lock(mHeader);
+  assert(mHeader->unfinishedTasks > 0 && "TaskDone() called too many times");
+  --mHeader->unfinishedTasks;
+  if (mHeader->unfinishedTasks == 0)
+    ::pthread_cond_broadcast(&mHeader->allTasksDone);
+}
+
+template <class T> void SharedMemorySafeQueue<T>::Join() {
+  Lock lock(mHeader);
+  while (mHeader->unfinishedTasks != 0)
+    lock.Wait(&mHeader->allTasksDone);
+}
+
+} // namespace rwols
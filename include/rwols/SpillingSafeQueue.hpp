@@ -0,0 +1,509 @@
+///\file    SpillingSafeQueue.hpp
+///\brief   Thread-safe queue that overflows to disk
+///\author  Raoul Wols
+///\date    October, 2026
+
+#pragma once
+
+#include <rwols/SafeQueue.hpp>
+#include <rwols/Serializer.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+namespace rwols {
+
+struct SpillOptions {
+  /// Where the spill files go. They are unlinked as soon as they are created,
+  /// so nothing is left behind when the process dies.
+  std::string directory = "/tmp";
+  /// Most items kept in memory; later items go to disk.
+  std::size_t maxItems = 1 << 16;
+  /// Most bytes kept in memory, as measured by the queue's byte size function.
+  std::size_t maxBytes = std::size_t(64) << 20;
+  /// A new spill file is started once the current one holds this many bytes,
+  /// so that disk space is given back as consumers drain.
+  std::size_t fileBytes = std::size_t(64) << 20;
+  /// Spilled writes are buffered up to this many bytes.
+  std::size_t writeBufferBytes = std::size_t(1) << 16;
+};
+
+namespace detail {
+
+/// Anonymous append-only file of length-prefixed records, read back in bulk
+/// from the front. The owner guards it with its mutex, except for WriteAt()
+/// and Read(): those do the disk I/O, so the owner calls them unlocked, on a
+/// range it reserved beforehand. One write and one read at a time.
+class SpillFile final {
+public:
+  explicit SpillFile(const std::string &directory);
+  SpillFile(const SpillFile &) = delete;
+  SpillFile &operator=(const SpillFile &) = delete;
+  ~SpillFile();
+
+  /// Buffers a record. Returns true when the buffer is due to be written.
+  bool Append(const std::string &payload, std::size_t writeBufferBytes);
+
+  /// Moves the buffered records into `chunk` and returns their file offset.
+  std::uint64_t BeginWrite(std::string &chunk);
+  void WriteAt(const std::string &chunk, std::uint64_t offset) const;
+  void EndWrite() { mFlushed = mReserved; mWriting = false; }
+  /// Takes back a chunk that could not be written, for a later retry.
+  void AbortWrite(std::string &chunk);
+
+  /// Calls f(data, size) for up to maxRecords records in [offset, end), as
+  /// long as f returns true. Returns the offset after the last record read.
+  template <class F>
+  std::uint64_t Read(std::uint64_t offset, std::uint64_t end,
+                     std::size_t maxRecords, F f);
+  /// Marks everything before `offset` as consumed.
+  void Consume(std::uint64_t offset) { mReadOffset = offset; }
+
+  std::uint64_t ReadOffset() const { return mReadOffset; }
+  std::uint64_t Flushed() const { return mFlushed; }
+  bool Writing() const { return mWriting; }
+  bool Buffered() const { return !mWriteBuffer.empty(); }
+  std::uint64_t Written() const { return mReserved + mWriteBuffer.size(); }
+  bool Drained() const { return mReadOffset == Written(); }
+
+private:
+  int mFd = -1;
+  std::uint64_t mFlushed = 0;  // On disk.
+  std::uint64_t mReserved = 0; // On disk or being written.
+  std::uint64_t mReadOffset = 0;
+  bool mWriting = false;
+  std::string mWriteBuffer;
+  std::string mReadBuffer;
+
+  static void ThrowErrno(const char *what) {
+    throw std::system_error(errno, std::generic_category(), what);
+  }
+};
+
+} // namespace detail
+
+/// A thread-safe queue with the same interface as SafeQueue that keeps at
+/// most SpillOptions::maxItems items, or maxBytes bytes, in memory. Items that
+/// arrive beyond that budget are serialized into sequential spill files. Once
+/// the in-memory items are consumed, spilled items are paged back in bulk.
+/// While anything is on disk new items are spilled too, so FIFO order holds
+/// across both tiers. Every item counts as an unfinished task from Push until
+/// TaskDone, wherever it is stored. The disk is never read or written under
+/// the queue's mutex: one consumer at a time pages in while the others wait,
+/// and producers keep spilling meanwhile. If a Push() has to write the spill
+/// buffer out and that write fails, it throws std::system_error, but the item
+/// is queued all the same and the write is retried later.
+template <class T, class Serializer = DefaultSerializer<T>>
+class SpillingSafeQueue final {
+public:
+  using value_type = T;
+  using size_type = std::size_t;
+  using const_reference = const value_type &;
+  using ByteSize = std::function<std::size_t(const value_type &)>;
+
+  struct TaskDoneGuard {
+    TaskDoneGuard(const TaskDoneGuard &) = delete;
+    TaskDoneGuard(TaskDoneGuard &&);
+    TaskDoneGuard &operator=(const TaskDoneGuard &) = delete;
+    TaskDoneGuard &operator=(TaskDoneGuard &&);
+    ~TaskDoneGuard() noexcept(false);
+
+  private:
+    SpillingSafeQueue *mQ = nullptr;
+    TaskDoneGuard(SpillingSafeQueue *);
+    friend class SpillingSafeQueue;
+  };
+
+  /// byteSize measures an item for the maxBytes budget; by default every
+  /// item counts as sizeof(T).
+  explicit SpillingSafeQueue(SpillOptions options = SpillOptions(),
+                             ByteSize byteSize = ByteSize());
+  ~SpillingSafeQueue();
+
+  void Push(const_reference item);
+  void Push(value_type &&item);
+
+  value_type Pop();
+  std::pair<value_type, TaskDoneGuard> PopWithGuard();
+  template <class Rep, class Period>
+  value_type Pop(const std::chrono::duration<Rep, Period> &timeout);
+  template <class Rep, class Period>
+  std::pair<value_type, TaskDoneGuard>
+  PopWithGuard(const std::chrono::duration<Rep, Period> &timeout);
+
+  void TaskDone();
+
+  void Join();
+
+  /// Items waiting in memory and on disk.
+  size_type Size();
+  /// Items waiting on disk.
+  size_type Spilled();
+
+private:
+  using UniqueLock = std::unique_lock<std::mutex>;
+  using LockGuard = std::lock_guard<std::mutex>;
+
+  SpillOptions mOptions;
+  ByteSize mByteSize;
+  std::mutex mMutex;
+  std::condition_variable mNotEmpty, mAllTasksDone, mWritten;
+  std::deque<value_type> mMemory;
+  std::size_t mMemoryBytes = 0;
+  std::deque<std::unique_ptr<detail::SpillFile>> mFiles;
+  std::size_t mSpilled = 0;
+  std::size_t mUnfinishedTasks = 0;
+  bool mPaging = false; // A consumer reads from disk with the mutex released.
+  std::string mScratch;
+
+  template <class U> void PushImpl(U &&item);
+  bool Ready() const { return !mMemory.empty() || (mSpilled != 0 && !mPaging); }
+  value_type TakeFront(UniqueLock &lock);
+  void PageIn(UniqueLock &lock);
+  void WriteOut(UniqueLock &lock, detail::SpillFile &file);
+};
+
+// Implementation follows.
+
+namespace detail {
+
+inline SpillFile::SpillFile(const std::string &directory) {
+  auto path = directory + "/rwols-spill-XXXXXX";
+  mFd = ::mkstemp(&path[0]);
+  if (mFd < 0)
+    ThrowErrno("mkstemp");
+  ::unlink(path.c_str());
+}
+
+inline SpillFile::~SpillFile() { ::close(mFd); }
+
+inline bool SpillFile::Append(const std::string &payload,
+                              std::size_t writeBufferBytes) {
+  const auto size = static_cast<std::uint32_t>(payload.size());
+  mWriteBuffer.append(reinterpret_cast<const char *>(&size), sizeof(size));
+  mWriteBuffer.append(payload);
+  return !mWriting && mWriteBuffer.size() >= writeBufferBytes;
+}
+
+inline std::uint64_t SpillFile::BeginWrite(std::string &chunk) {
+  assert(!mWriting && "Only one write at a time");
+  chunk.swap(mWriteBuffer);
+  mWriteBuffer.clear();
+  const auto offset = mReserved;
+  mReserved += chunk.size();
+  mWriting = true;
+  return offset;
+}
+
+inline void SpillFile::WriteAt(const std::string &chunk,
+                               std::uint64_t offset) const {
+  std::size_t done = 0;
+  while (done < chunk.size()) {
+    const auto written = ::pwrite(mFd, chunk.data() + done, chunk.size() - done,
+                                  static_cast<off_t>(offset + done));
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      ThrowErrno("pwrite");
+    }
+    done += static_cast<std::size_t>(written);
+  }
+}
+
+inline void SpillFile::AbortWrite(std::string &chunk) {
+  // Records appended during the write go after the ones that failed.
+  chunk.append(mWriteBuffer);
+  mWriteBuffer.swap(chunk);
+  mReserved = mFlushed;
+  mWriting = false;
+}
+
+template <class F>
+std::uint64_t SpillFile::Read(std::uint64_t offset, std::uint64_t end,
+                              std::size_t maxRecords, F f) {
+  std::size_t records = 0;
+  std::size_t want = std::size_t(1) << 20;
+  while (records < maxRecords && offset < end) {
+    const auto available =
+        static_cast<std::size_t>(std::min<std::uint64_t>(want, end - offset));
+    mReadBuffer.resize(available);
+    std::size_t got = 0;
+    while (got < available) {
+      const auto n = ::pread(mFd, &mReadBuffer[got], available - got,
+                             static_cast<off_t>(offset + got));
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        ThrowErrno("pread");
+      got += static_cast<std::size_t>(n);
+    }
+    std::size_t parsed = 0;
+    while (records < maxRecords &&
+           parsed + sizeof(std::uint32_t) <= available) {
+      std::uint32_t size;
+      std::memcpy(&size, mReadBuffer.data() + parsed, sizeof(size));
+      if (parsed + sizeof(size) + size > available) {
+        // The record continues past this chunk; make sure the next one
+        // holds it completely.
+        want = std::max(want, sizeof(size) + size);
+        break;
+      }
+      ++records;
+      const bool more =
+          f(mReadBuffer.data() + parsed + sizeof(size), std::size_t(size));
+      parsed += sizeof(size) + size;
+      if (!more)
+        return offset + parsed;
+    }
+    offset += parsed;
+  }
+  return offset;
+}
+
+} // namespace detail
+
+template <class T, class S>
+SpillingSafeQueue<T, S>::TaskDoneGuard::TaskDoneGuard(TaskDoneGuard &&other)
+    : mQ(other.mQ) {
+  other.mQ = nullptr;
+}
+
+template <class T, class S>
+typename SpillingSafeQueue<T, S>::TaskDoneGuard &
+SpillingSafeQueue<T, S>::TaskDoneGuard::operator=(TaskDoneGuard &&other) {
+  mQ = other.mQ;
+  other.mQ = nullptr;
+  return *this;
+}
+
+template <class T, class S>
+SpillingSafeQueue<T, S>::TaskDoneGuard::TaskDoneGuard(SpillingSafeQueue *q)
+    : mQ(q) {}
+
+template <class T, class S>
+SpillingSafeQueue<T, S>::TaskDoneGuard::~TaskDoneGuard() noexcept(false) {
+  if (mQ)
+    mQ->TaskDone();
+}
+
+template <class T, class S>
+SpillingSafeQueue<T, S>::SpillingSafeQueue(SpillOptions options,
+                                           ByteSize byteSize)
+    : mOptions(std::move(options)), mByteSize(std::move(byteSize)) {
+  if (!mByteSize)
+    mByteSize = [](const value_type &) { return sizeof(value_type); };
+}
+
+template <class T, class S> SpillingSafeQueue<T, S>::~SpillingSafeQueue() {
+  Join();
+  assert(mUnfinishedTasks == 0 && "Expected all tasks to be finished");
+}
+
+template <class T, class S>
+template <class U>
+void SpillingSafeQueue<T, S>::PushImpl(U &&item) {
+  UniqueLock lock(mMutex);
+  const auto bytes = mByteSize(item);
+  detail::SpillFile *due = nullptr;
+  if (mSpilled == 0 && mMemory.size() < mOptions.maxItems &&
+      (mMemory.empty() || mMemoryBytes + bytes <= mOptions.maxBytes)) {
+    mMemory.emplace_back(std::forward<U>(item));
+    mMemoryBytes += bytes;
+  } else {
+    if (mFiles.empty() || mFiles.back()->Written() >= mOptions.fileBytes)
+      mFiles.emplace_back(new detail::SpillFile(mOptions.directory));
+    mScratch.clear();
+    S::Serialize(item, mScratch);
+    if (mFiles.back()->Append(mScratch, mOptions.writeBufferBytes))
+      due = mFiles.back().get();
+    ++mSpilled;
+  }
+  ++mUnfinishedTasks;
+  mNotEmpty.notify_one();
+  if (due)
+    WriteOut(lock, *due);
+}
+
+template <class T, class S>
+void SpillingSafeQueue<T, S>::WriteOut(UniqueLock &lock,
+                                       detail::SpillFile &file) {
+  // The file stays alive meanwhile: PageIn() only drops drained files, and a
+  // file that is being written is not drained.
+  std::string chunk;
+  const auto offset = file.BeginWrite(chunk);
+  lock.unlock();
+  try {
+    file.WriteAt(chunk, offset);
+  } catch (...) {
+    lock.lock();
+    file.AbortWrite(chunk);
+    mWritten.notify_all();
+    throw;
+  }
+  lock.lock();
+  file.EndWrite();
+  mWritten.notify_all();
+}
+
+template <class T, class S>
+void SpillingSafeQueue<T, S>::Push(const_reference item) {
+  PushImpl(item);
+}
+
+template <class T, class S>
+void SpillingSafeQueue<T, S>::Push(value_type &&item) {
+  PushImpl(std::move(item));
+}
+
+template <class T, class S>
+void SpillingSafeQueue<T, S>::PageIn(UniqueLock &lock) {
+  // Fill the memory tier up to its budget in one go, so that the disk is
+  // read in large sequential chunks. Only this consumer touches the memory
+  // tier and the read offsets meanwhile: the others wait for mPaging to
+  // clear, and producers spill because mSpilled is not zero. The batch is
+  // built aside and only committed once all of it was read: if a read or
+  // the serializer throws, the queue is left as it was.
+  mPaging = true;
+  std::deque<value_type> batch;
+  std::size_t bytes = mMemoryBytes;
+  std::vector<std::pair<detail::SpillFile *, std::uint64_t>> offsets;
+  std::size_t index = 0;
+  bool full = false;
+  try {
+    while (!full && batch.size() < mSpilled && index < mFiles.size() &&
+           mMemory.size() + batch.size() < mOptions.maxItems) {
+      auto *file = mFiles[index].get();
+      if (offsets.empty() || offsets.back().first != file)
+        offsets.emplace_back(file, file->ReadOffset());
+      const auto offset = offsets.back().second;
+      const auto end = file->Flushed();
+      if (offset == end) {
+        // Whatever is left of this file is not on disk yet.
+        if (file->Writing())
+          mWritten.wait(lock, [file]() { return !file->Writing(); });
+        else if (file->Buffered())
+          WriteOut(lock, *file);
+        else
+          ++index;
+        continue;
+      }
+      const auto room = mOptions.maxItems - mMemory.size() - batch.size();
+      lock.unlock();
+      const auto next =
+          file->Read(offset, end, room, [&](const char *data, std::size_t size) {
+            batch.emplace_back(S::Deserialize(data, size));
+            bytes += mByteSize(batch.back());
+            return bytes < mOptions.maxBytes;
+          });
+      lock.lock();
+      offsets.back().second = next;
+      full = bytes >= mOptions.maxBytes;
+    }
+  } catch (...) {
+    if (!lock.owns_lock())
+      lock.lock();
+    mPaging = false;
+    mNotEmpty.notify_all();
+    throw;
+  }
+  for (const auto &offset : offsets)
+    offset.first->Consume(offset.second);
+  while (!mFiles.empty() && mFiles.front()->Drained())
+    mFiles.pop_front();
+  mSpilled -= batch.size();
+  mMemoryBytes = bytes;
+  std::move(batch.begin(), batch.end(), std::back_inserter(mMemory));
+  mPaging = false;
+  mNotEmpty.notify_all();
+}
+
+template <class T, class S>
+typename SpillingSafeQueue<T, S>::value_type
+SpillingSafeQueue<T, S>::TakeFront(UniqueLock &lock) {
+  if (mMemory.empty())
+    PageIn(lock);
+  if (mMemory.empty())
+    throw std::logic_error("Spill files hold fewer items than were spilled");
+  auto item = std::move(mMemory.front());
+  mMemoryBytes -= mByteSize(item);
+  mMemory.pop_front();
+  return item;
+}
+
+template <class T, class S>
+typename SpillingSafeQueue<T, S>::value_type SpillingSafeQueue<T, S>::Pop() {
+  UniqueLock lock(mMutex);
+  mNotEmpty.wait(lock, [this]() { return Ready(); });
+  return TakeFront(lock);
+}
+
+template <class T, class S>
+std::pair<typename SpillingSafeQueue<T, S>::value_type,
+          typename SpillingSafeQueue<T, S>::TaskDoneGuard>
+SpillingSafeQueue<T, S>::PopWithGuard() {
+  auto item = Pop();
+  return std::make_pair(std::move(item), TaskDoneGuard(this));
+}
+
+template <class T, class S>
+template <class Rep, class Period>
+typename SpillingSafeQueue<T, S>::value_type SpillingSafeQueue<T, S>::Pop(
+    const std::chrono::duration<Rep, Period> &timeout) {
+  UniqueLock lock(mMutex);
+  if (mNotEmpty.wait_for(lock, timeout, [this]() { return Ready(); }))
+    return TakeFront(lock);
+  throw TimeoutError();
+}
+
+template <class T, class S>
+template <class Rep, class Period>
+std::pair<typename SpillingSafeQueue<T, S>::value_type,
+          typename SpillingSafeQueue<T, S>::TaskDoneGuard>
+SpillingSafeQueue<T, S>::PopWithGuard(
+    const std::chrono::duration<Rep, Period> &timeout) {
+  auto item = Pop(timeout);
+  return std::make_pair(std::move(item), TaskDoneGuard(this));
+}
+
+template <class T, class S> void SpillingSafeQueue<T, S>::TaskDone() {
+  LockGuard lock(mMutex);
+  assert(mUnfinishedTasks > 0 && "TaskDone() called too many times");
+  --mUnfinishedTasks;
+  if (mUnfinishedTasks == 0)
+    mAllTasksDone.notify_all();
+}
+
+template <class T, class S> void SpillingSafeQueue<T, S>::Join() {
+  UniqueLock lock(mMutex);
+  mAllTasksDone.wait(lock, [this]() { return mUnfinishedTasks == 0; });
+}
+
+template <class T, class S>
+typename SpillingSafeQueue<T, S>::size_type SpillingSafeQueue<T, S>::Size() {
+  LockGuard lock(mMutex);
+  return mMemory.size() + mSpilled;
+}
+
+template <class T, class S>
+typename SpillingSafeQueue<T, S>::size_type
+SpillingSafeQueue<T, S>::Spilled() {
+  LockGuard lock(mMutex);
+  return mSpilled;
+}
+
+} // namespace rwols
@@ -0,0 +1,233 @@
+///\file    Sync.hpp
+///\brief   Synchronization policies for SafeQueue
+///\author  Raoul Wols
+///\date    October, 2026
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace rwols {
+
+namespace detail {
+
+/// Tells the CPU that we are spinning. Targets without a pause instruction
+/// give up the time slice instead.
+inline void CpuRelax() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield" ::: "memory");
+#else
+  std::this_thread::yield();
+#endif
+}
+
+} // namespace detail
+
+/// The mutex a queue locks and the condition its threads wait on. The
+/// condition needs the std::condition_variable interface (wait, wait_for
+/// with a predicate, notify_one, notify_all) for a std::unique_lock of the
+/// mutex.
+template <class Mutex, class Condition> struct BasicSync {
+  using mutex_type = Mutex;
+  using condition_type = Condition;
+};
+
+/// A condition that sleeps on a sequence counter instead of on the queue's
+/// mutex. A notify bumps the counter and wakes a sleeper with a futex(2) call
+/// only if somebody sleeps, so notifying an idle queue costs one atomic
+/// increment. A woken thread does not have to get through the mutex before it
+/// is awake: it takes the mutex only to claim its item. Before it sleeps, a
+/// waiter spins briefly on the counter, which saves the system call for
+/// wake-ups that come right after a short wait. Works with any lockable
+/// mutex. Without futexes (outside Linux) it sleeps on an internal condition
+/// variable instead.
+class FutexCondition final {
+public:
+  FutexCondition() = default;
+  FutexCondition(const FutexCondition &) = delete;
+  FutexCondition &operator=(const FutexCondition &) = delete;
+
+  void notify_one() noexcept;
+  void notify_all() noexcept;
+
+  template <class Lock> void wait(Lock &lock);
+  template <class Lock, class Predicate>
+  void wait(Lock &lock, Predicate predicate);
+  template <class Lock, class Clock, class Duration>
+  std::cv_status
+  wait_until(Lock &lock, const std::chrono::time_point<Clock, Duration> &t);
+  template <class Lock, class Clock, class Duration, class Predicate>
+  bool wait_until(Lock &lock, const std::chrono::time_point<Clock, Duration> &t,
+                  Predicate predicate);
+  template <class Lock, class Rep, class Period, class Predicate>
+  bool wait_for(Lock &lock, const std::chrono::duration<Rep, Period> &timeout,
+                Predicate predicate);
+
+private:
+  static constexpr int kSpins = 128;
+  static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t),
+                "The futex word must be a plain 32-bit integer");
+
+  std::atomic<std::uint32_t> mSequence{0};
+  std::atomic<std::uint32_t> mSleepers{0};
+#if !defined(__linux__)
+  std::mutex mMutex;
+  std::condition_variable mChanged;
+#endif
+
+  /// Sleeps while the counter still reads `sequence`, for at most `timeout`.
+  /// Returns false on timeout.
+  bool Sleep(std::uint32_t sequence, std::chrono::nanoseconds timeout);
+  void Wake(int count) noexcept;
+  template <class Lock>
+  bool Wait(Lock &lock, std::chrono::nanoseconds timeout);
+};
+
+/// The standard library's mutex and condition variable.
+using StdSync = BasicSync<std::mutex, std::condition_variable>;
+/// std::mutex with a FutexCondition.
+using FutexSync = BasicSync<std::mutex, FutexCondition>;
+
+// Implementation follows.
+
+inline void FutexCondition::notify_one() noexcept {
+  mSequence.fetch_add(1);
+  if (mSleepers.load() != 0)
+    Wake(1);
+}
+
+inline void FutexCondition::notify_all() noexcept {
+  mSequence.fetch_add(1);
+  if (mSleepers.load() != 0)
+    Wake(0);
+}
+
+#if defined(__linux__)
+
+inline bool FutexCondition::Sleep(std::uint32_t sequence,
+                                  std::chrono::nanoseconds timeout) {
+  ::timespec relative;
+  ::timespec *until = nullptr;
+  if (timeout != std::chrono::nanoseconds::max()) {
+    const auto seconds =
+        std::chrono::duration_cast<std::chrono::seconds>(timeout);
+    relative.tv_sec = static_cast<std::time_t>(seconds.count());
+    relative.tv_nsec = static_cast<long>((timeout - seconds).count());
+    until = &relative;
+  }
+  // The kernel only puts us to sleep if the counter still holds `sequence`,
+  // so a notify between reading it and this call is never lost.
+  const auto result =
+      ::syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&mSequence),
+                FUTEX_WAIT_PRIVATE, sequence, until, nullptr, 0);
+  return result == 0 || errno != ETIMEDOUT;
+}
+
+inline void FutexCondition::Wake(int count) noexcept {
+  ::syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&mSequence),
+            FUTEX_WAKE_PRIVATE, count == 0 ? INT32_MAX : count, nullptr,
+            nullptr, 0);
+}
+
+#else
+
+inline bool FutexCondition::Sleep(std::uint32_t sequence,
+                                  std::chrono::nanoseconds timeout) {
+  std::unique_lock<std::mutex> lock(mMutex);
+  const auto changed = [&]() { return mSequence.load() != sequence; };
+  if (timeout == std::chrono::nanoseconds::max()) {
+    mChanged.wait(lock, changed);
+    return true;
+  }
+  return mChanged.wait_for(lock, timeout, changed);
+}
+
+inline void FutexCondition::Wake(int count) noexcept {
+  // Taking the mutex orders this wake after a sleeper's last check.
+  { std::lock_guard<std::mutex> lock(mMutex); }
+  if (count == 1)
+    mChanged.notify_one();
+  else
+    mChanged.notify_all();
+}
+
+#endif
+
+template <class Lock>
+bool FutexCondition::Wait(Lock &lock, std::chrono::nanoseconds timeout) {
+  // Read the counter while the lock still protects the caller's predicate:
+  // any change to it notifies after this point.
+  const auto sequence = mSequence.load();
+  lock.unlock();
+  bool woken = false;
+  for (int i = 0; i < kSpins && !woken; ++i) {
+    detail::CpuRelax();
+    woken = mSequence.load(std::memory_order_relaxed) != sequence;
+  }
+  if (!woken) {
+    mSleepers.fetch_add(1);
+    woken = Sleep(sequence, timeout);
+    mSleepers.fetch_sub(1);
+  }
+  lock.lock();
+  return woken;
+}
+
+template <class Lock> void FutexCondition::wait(Lock &lock) {
+  Wait(lock, std::chrono::nanoseconds::max());
+}
+
+template <class Lock, class Predicate>
+void FutexCondition::wait(Lock &lock, Predicate predicate) {
+  while (!predicate())
+    wait(lock);
+}
+
+template <class Lock, class Clock, class Duration>
+std::cv_status
+FutexCondition::wait_until(Lock &lock,
+                           const std::chrono::time_point<Clock, Duration> &t) {
+  const auto left =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(t - Clock::now());
+  if (left <= std::chrono::nanoseconds::zero())
+    return std::cv_status::timeout;
+  return Wait(lock, left) ? std::cv_status::no_timeout
+                          : std::cv_status::timeout;
+}
+
+template <class Lock, class Clock, class Duration, class Predicate>
+bool FutexCondition::wait_until(
+    Lock &lock, const std::chrono::time_point<Clock, Duration> &t,
+    Predicate predicate) {
+  while (!predicate()) {
+    if (wait_until(lock, t) == std::cv_status::timeout)
+      return predicate();
+  }
+  return true;
+}
+
+template <class Lock, class Rep, class Period, class Predicate>
+bool FutexCondition::wait_for(Lock &lock,
+                              const std::chrono::duration<Rep, Period> &timeout,
+                              Predicate predicate) {
+  return wait_until(lock, std::chrono::steady_clock::now() + timeout,
+                    std::move(predicate));
+}
+
+} // namespace rwols
@@ -0,0 +1,148 @@
+///\file    Watchdog.hpp
+///\brief   Reports items that were popped but never finished
+///\author  Raoul Wols
+///\date    October, 2026
+
+#pragma once
+
+#include <rwols/SafeQueue.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace rwols {
+
+struct WatchdogStats {
+  /// Scans of the queue so far.
+  std::uint64_t checks = 0;
+  /// Items that were reported, each one once.
+  std::uint64_t reported = 0;
+  /// Items over the threshold at the last scan.
+  std::size_t stalled = 0;
+  /// How long the oldest of those had been in flight at the last scan.
+  std::chrono::steady_clock::duration oldest{0};
+  /// Unfinished tasks the tracker could not see at the last scan, such as
+  /// items popped before the watchdog started. If this stays above zero
+  /// while the queue is idle, a consumer holds an item nobody reports.
+  std::size_t untracked = 0;
+};
+
+/// Watches a queue for consumers that popped an item and never finished it,
+/// which would make Join() and the queue's destructor block forever:
+/// \code
+///   rwols::SafeQueue<Job> q;
+///   rwols::Watchdog<rwols::SafeQueue<Job>> watchdog(
+///       q, std::chrono::seconds(30), [](const rwols::InFlightTask &task) {
+///         std::cerr << "thread " << task.consumer << " is stuck\n";
+///       });
+/// \endcode
+/// The watchdog turns on the queue's in-flight tracking and scans it from a
+/// thread of its own every `interval` (a quarter of the threshold by
+/// default). Each scan only looks at the items over the threshold, under one
+/// lock acquisition. Every stalled item is reported once, on the watchdog's
+/// thread; the callback must not throw. Destroy the watchdog before the
+/// queue.
+template <class Queue> class Watchdog final {
+public:
+  using Clock = std::chrono::steady_clock;
+  using Callback = std::function<void(const InFlightTask &)>;
+
+  Watchdog(Queue &q, Clock::duration threshold, Callback callback,
+           Clock::duration interval = Clock::duration::zero());
+  Watchdog(const Watchdog &) = delete;
+  Watchdog &operator=(const Watchdog &) = delete;
+  ~Watchdog();
+
+  /// Scans the queue right away, on the calling thread.
+  void Check();
+
+  WatchdogStats Stats();
+
+private:
+  Queue &mQ;
+  Clock::duration mThreshold;
+  Clock::duration mInterval;
+  Callback mCallback;
+  std::mutex mCheckMutex; // Keeps scans from reporting an item twice.
+
+  std::mutex mMutex; // Guards the members below.
+  std::condition_variable mStop;
+  bool mStopping = false;
+  std::set<std::uint64_t> mReported; // Tickets still in flight.
+  WatchdogStats mStats;
+
+  std::thread mThread; // Last: starts once everything else is set up.
+
+  void Run();
+};
+
+// Implementation follows.
+
+template <class Queue>
+Watchdog<Queue>::Watchdog(Queue &q, Clock::duration threshold,
+                          Callback callback, Clock::duration interval)
+    : mQ(q), mThreshold(threshold),
+      mInterval(interval > Clock::duration::zero() ? interval : threshold / 4),
+      mCallback(std::move(callback)) {
+  if (mInterval <= Clock::duration::zero())
+    mInterval = std::chrono::milliseconds(1);
+  mQ.TrackInFlight();
+  mThread = std::thread([this]() { Run(); });
+}
+
+template <class Queue> Watchdog<Queue>::~Watchdog() {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStopping = true;
+  }
+  mStop.notify_all();
+  mThread.join();
+}
+
+template <class Queue> void Watchdog<Queue>::Run() {
+  std::unique_lock<std::mutex> lock(mMutex);
+  while (!mStop.wait_for(lock, mInterval, [this]() { return mStopping; })) {
+    lock.unlock();
+    Check();
+    lock.lock();
+  }
+}
+
+template <class Queue> void Watchdog<Queue>::Check() {
+  std::lock_guard<std::mutex> checking(mCheckMutex);
+  const auto stalled = mQ.InFlight(mThreshold);
+  const auto untracked = mQ.UntrackedCount();
+  const auto now = Clock::now();
+  std::vector<InFlightTask> fresh;
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    // Forget finished items, so that the set stays as small as the stall.
+    std::set<std::uint64_t> still;
+    for (const auto &task : stalled) {
+      still.insert(task.ticket);
+      if (mReported.count(task.ticket) == 0)
+        fresh.push_back(task);
+    }
+    mReported.swap(still);
+    ++mStats.checks;
+    mStats.reported += fresh.size();
+    mStats.stalled = stalled.size();
+    mStats.oldest = stalled.empty() ? Clock::duration::zero()
+                                    : now - stalled.front().popped;
+    mStats.untracked = untracked;
+  }
+  for (const auto &task : fresh)
+    mCallback(task);
+}
+
+template <class Queue> WatchdogStats Watchdog<Queue>::Stats() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mStats;
+}
+
+} // namespace rwols
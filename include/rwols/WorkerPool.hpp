@@ -0,0 +1,265 @@
+///\file    WorkerPool.hpp
+///\brief   Queue with a consumer pool that grows and shrinks with the load
+///\author  Raoul Wols
+///\date    October, 2026
+
+#pragma once
+
+#include <rwols/SafeQueue.hpp>
+#include <rwols/detail/Maybe.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace rwols {
+
+struct PoolOptions {
+  /// Workers that are kept even when there is nothing to do.
+  std::size_t minWorkers = 0;
+  /// Workers are never spawned beyond this.
+  std::size_t maxWorkers = std::max(1u, std::thread::hardware_concurrency());
+  /// A worker is spawned when more items than this wait per running worker.
+  std::size_t spawnDepth = 16;
+  /// A worker is also spawned when an item waited longer than this between
+  /// push and pop. At most one worker is spawned per this interval, so that a
+  /// new worker gets the chance to bring the wait down.
+  std::chrono::steady_clock::duration spawnWait =
+      std::chrono::milliseconds(10);
+  /// A worker that found nothing to do for this long retires, unless that
+  /// would take the pool below minWorkers.
+  std::chrono::steady_clock::duration idleTimeout = std::chrono::seconds(1);
+};
+
+/// A queue with its own consumer threads, where the number of threads follows
+/// the load:
+/// \code
+///   rwols::PoolOptions options;
+///   options.maxWorkers = 32;
+///   rwols::WorkerPool<Request> pool([](Request &&r) { Handle(r); }, options);
+///   pool.Push(request);
+///   pool.Join();
+/// \endcode
+/// Every item is stamped when it is pushed. When the queue gets deep, or an
+/// item waited too long before a worker got to it, the pool spawns another
+/// worker, up to maxWorkers. Workers that stay idle for idleTimeout retire,
+/// down to minWorkers. Join() waits for every pushed item and rethrows the
+/// first exception the handler threw, or that a worker got when it failed
+/// to spawn another one. Destruction drains the queue and stops
+/// the workers. The pool owns its queue instead of attaching to one, so that
+/// every push goes through it and gets stamped.
+template <class T> class WorkerPool final {
+public:
+  using value_type = T;
+  using const_reference = const value_type &;
+  using size_type = std::size_t;
+  using Handler = std::function<void(value_type &&)>;
+
+  explicit WorkerPool(Handler handler, PoolOptions options = PoolOptions());
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+  ~WorkerPool();
+
+  void Push(const_reference item);
+  void Push(value_type &&item);
+
+  void Join();
+
+  /// Running workers.
+  size_type Workers() const noexcept { return mWorkers.load(); }
+  /// Items pushed but not yet picked up by a worker.
+  size_type Depth() const noexcept { return mDepth.load(); }
+
+private:
+  using Clock = std::chrono::steady_clock;
+  using LockGuard = std::lock_guard<std::mutex>;
+
+  /// An empty value tells a worker to stop.
+  struct Item {
+    Clock::time_point pushed;
+    detail::Maybe<value_type> value;
+  };
+
+  SafeQueue<Item> mQ;
+  Handler mHandler;
+  PoolOptions mOptions;
+  std::atomic<size_type> mDepth{0};
+  std::atomic<size_type> mWorkers{0}; // Changed under mMutex only.
+
+  std::mutex mMutex; // Guards the members below.
+  std::list<std::thread> mThreads;
+  std::vector<std::thread> mRetired; // Exited, but not joined yet.
+  Clock::time_point mLastSpawn;
+  bool mStopping = false;
+  std::exception_ptr mError;
+
+  void Enqueue(value_type &&item);
+  void Stop();
+  void MaybeSpawn(Clock::duration waited);
+  void Spawn();
+  bool Retire(typename std::list<std::thread>::iterator self);
+  void Run(typename std::list<std::thread>::iterator self);
+};
+
+// Implementation follows.
+
+template <class T>
+WorkerPool<T>::WorkerPool(Handler handler, PoolOptions options)
+    : mHandler(std::move(handler)), mOptions(std::move(options)) {
+  if (mOptions.maxWorkers == 0 || mOptions.minWorkers > mOptions.maxWorkers)
+    throw std::invalid_argument(
+        "WorkerPool needs 0 <= minWorkers <= maxWorkers and maxWorkers > 0");
+  try {
+    LockGuard lock(mMutex);
+    while (mWorkers < mOptions.minWorkers)
+      Spawn();
+  } catch (...) {
+    // No destructor runs for us, so the workers spawned so far are stopped
+    // here; joinable threads would terminate the program.
+    Stop();
+    throw;
+  }
+}
+
+template <class T> WorkerPool<T>::~WorkerPool() {
+  mQ.Join();
+  Stop();
+}
+
+template <class T> void WorkerPool<T>::Stop() {
+  size_type workers;
+  {
+    LockGuard lock(mMutex);
+    mStopping = true;
+    workers = mWorkers;
+  }
+  for (size_type i = 0; i < workers; ++i)
+    mQ.Push(Item{Clock::now(), detail::Maybe<value_type>()});
+  // No worker retires or spawns once we are stopping, so the lists are ours.
+  for (auto &thread : mThreads)
+    thread.join();
+  for (auto &thread : mRetired)
+    thread.join();
+}
+
+template <class T> void WorkerPool<T>::Push(const_reference item) {
+  value_type copy(item);
+  Enqueue(std::move(copy));
+}
+
+template <class T> void WorkerPool<T>::Push(value_type &&item) {
+  Enqueue(std::move(item));
+}
+
+template <class T> void WorkerPool<T>::Enqueue(value_type &&item) {
+  ++mDepth;
+  try {
+    mQ.Push(Item{Clock::now(), detail::Maybe<value_type>(std::move(item))});
+  } catch (...) {
+    --mDepth;
+    throw;
+  }
+  MaybeSpawn(Clock::duration::zero());
+}
+
+template <class T> void WorkerPool<T>::MaybeSpawn(Clock::duration waited) {
+  // Decide without the lock first: this runs on every push and every pop.
+  const auto workers = mWorkers.load();
+  if (workers >= mOptions.maxWorkers)
+    return;
+  if (workers != 0 && mDepth.load() <= mOptions.spawnDepth * workers &&
+      waited <= mOptions.spawnWait)
+    return;
+  LockGuard lock(mMutex);
+  if (mStopping || mWorkers >= mOptions.maxWorkers)
+    return;
+  // With no workers at all, the item would wait forever.
+  if (mWorkers != 0 && Clock::now() - mLastSpawn < mOptions.spawnWait)
+    return;
+  Spawn();
+}
+
+template <class T> void WorkerPool<T>::Spawn() {
+  mThreads.emplace_back();
+  const auto self = std::prev(mThreads.end());
+  // The new thread only touches `self` under mMutex, which we hold.
+  try {
+    *self = std::thread([this, self]() { Run(self); });
+  } catch (...) {
+    mThreads.erase(self);
+    throw;
+  }
+  ++mWorkers;
+  mLastSpawn = Clock::now();
+}
+
+template <class T>
+bool WorkerPool<T>::Retire(typename std::list<std::thread>::iterator self) {
+  LockGuard lock(mMutex);
+  if (mStopping || mWorkers <= mOptions.minWorkers)
+    return false;
+  // Leave first, then look for work: a concurrent Push() either sees fewer
+  // workers and spawns one if needed, or we see its item and stay.
+  --mWorkers;
+  if (mDepth.load() != 0) {
+    ++mWorkers;
+    return false;
+  }
+  // Earlier retirees are gone by now; a thread cannot join itself.
+  for (auto &thread : mRetired)
+    thread.join();
+  mRetired.clear();
+  mRetired.push_back(std::move(*self));
+  mThreads.erase(self);
+  return true;
+}
+
+template <class T>
+void WorkerPool<T>::Run(typename std::list<std::thread>::iterator self) {
+  while (true) {
+    try {
+      auto pair = mQ.PopWithGuard(mOptions.idleTimeout);
+      if (!pair.first.value)
+        return;
+      --mDepth;
+      try {
+        MaybeSpawn(Clock::now() - pair.first.pushed);
+      } catch (...) {
+        // No thread to spare: carry on with the workers we have.
+        LockGuard lock(mMutex);
+        if (!mError)
+          mError = std::current_exception();
+      }
+      try {
+        mHandler(std::move(*pair.first.value));
+      } catch (...) {
+        LockGuard lock(mMutex);
+        if (!mError)
+          mError = std::current_exception();
+      }
+    } catch (const TimeoutError &) {
+      if (Retire(self))
+        return;
+    }
+  }
+}
+
+template <class T> void WorkerPool<T>::Join() {
+  mQ.Join();
+  std::exception_ptr error;
+  {
+    LockGuard lock(mMutex);
+    std::swap(error, mError);
+  }
+  if (error)
+    std::rethrow_exception(error);
+}
+
+} // namespace rwols
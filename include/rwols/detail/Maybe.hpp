@@ -0,0 +1,53 @@
+///\file    Maybe.hpp
+///\brief   Optional value for C++14
+///\author  Raoul Wols
+///\date    October, 2026
+
+#pragma once
+
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace rwols {
+namespace detail {
+
+/// Holds a value or nothing, for types that need not be default
+/// constructible.
+template <class T> class Maybe final {
+public:
+  Maybe() = default;
+  explicit Maybe(T &&value) : mHasValue(true) {
+    new (&mStorage) T(std::move(value));
+  }
+  Maybe(Maybe &&other) : mHasValue(other.mHasValue) {
+    if (mHasValue)
+      new (&mStorage) T(std::move(*other));
+  }
+  Maybe &operator=(Maybe &&other) {
+    if (this != &other) {
+      Reset();
+      mHasValue = other.mHasValue;
+      if (mHasValue)
+        new (&mStorage) T(std::move(*other));
+    }
+    return *this;
+  }
+  ~Maybe() { Reset(); }
+
+  explicit operator bool() const noexcept { return mHasValue; }
+  T &operator*() noexcept { return *reinterpret_cast<T *>(&mStorage); }
+
+private:
+  typename std::aligned_storage<sizeof(T), alignof(T)>::type mStorage;
+  bool mHasValue = false;
+
+  void Reset() {
+    if (mHasValue)
+      (**this).~T();
+    mHasValue = false;
+  }
+};
+
+} // namespace detail
+} // namespace rwols
@@ -0,0 +1,343 @@
+// Measures enqueue-to-dequeue latency: every item is stamped with
+// steady_clock at Push and recorded into a histogram right after Pop.
+// Also counts dTLB load misses while cycling 2 KiB items through a large
+// FixedSafeQueue, with and without HugePageStorage, and the cost of one
+// lock/unlock pair for each lock in Locks.hpp under contention.
+//
+// Usage: SafeQueueBenchmark [items-per-producer]
+
+#include "LatencyHistogram.hpp"
+
+#include <rwols/FixedSafeQueue.hpp>
+#include <rwols/HugePageStorage.hpp>
+#include <rwols/IntrusiveSafeQueue.hpp>
+#include <rwols/Locks.hpp>
+#include <rwols/SafeQueue.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace rwols;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Stamped {
+  Clock::time_point pushed;
+  bool stop = false;
+  IntrusiveMpscHook hook;
+
+  Stamped() = default;
+  Stamped(const Stamped &other) : pushed(other.pushed), stop(other.stop) {}
+  Stamped &operator=(const Stamped &other) {
+    pushed = other.pushed;
+    stop = other.stop;
+    return *this;
+  }
+};
+
+std::uint64_t NanosecondsSince(Clock::time_point t) {
+  return static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t)
+          .count());
+}
+
+void Report(const std::string &name, int producers, int consumers,
+            const LatencyHistogram &histogram, Clock::duration wall) {
+  const auto ms =
+      std::chrono::duration_cast<std::chrono::milliseconds>(wall).count();
+  std::printf("%-28s %dP%dC %9llu items %6lld ms | ns p50 %8llu p90 %8llu "
+              "p99 %8llu p99.9 %8llu max %10llu\n",
+              name.c_str(), producers, consumers,
+              static_cast<unsigned long long>(histogram.Count()),
+              static_cast<long long>(ms),
+              static_cast<unsigned long long>(histogram.Percentile(50)),
+              static_cast<unsigned long long>(histogram.Percentile(90)),
+              static_cast<unsigned long long>(histogram.Percentile(99)),
+              static_cast<unsigned long long>(histogram.Percentile(99.9)),
+              static_cast<unsigned long long>(histogram.Max()));
+  std::fflush(stdout);
+}
+
+/// Runs `producers` threads that each push `items` stamped items, and
+/// `consumers` threads that pop with `pop` until they receive a stop item.
+template <class Queue, class PushFn, class PopFn>
+void Run(const std::string &name, int producers, int consumers, int items,
+         Queue &q, PushFn push, PopFn pop) {
+  std::vector<LatencyHistogram> histograms(consumers);
+  std::vector<std::thread> threads;
+  const auto start = Clock::now();
+  for (int c = 0; c < consumers; ++c) {
+    threads.emplace_back([&, c]() {
+      while (true) {
+        const Stamped item = pop(q);
+        if (item.stop)
+          break;
+        histograms[c].Record(NanosecondsSince(item.pushed));
+      }
+    });
+  }
+  std::vector<std::thread> pushers;
+  for (int p = 0; p < producers; ++p) {
+    pushers.emplace_back([&, p]() {
+      for (int i = 0; i < items; ++i)
+        push(q, p, i, false);
+    });
+  }
+  for (auto &pusher : pushers)
+    pusher.join();
+  for (int c = 0; c < consumers; ++c)
+    push(q, 0, items + c, true);
+  for (auto &thread : threads)
+    thread.join();
+  const auto wall = Clock::now() - start;
+  LatencyHistogram total;
+  for (const auto &histogram : histograms)
+    total.Merge(histogram);
+  Report(name, producers, consumers, total, wall);
+}
+
+Stamped Stamp(bool stop) {
+  Stamped item;
+  item.stop = stop;
+  item.pushed = Clock::now();
+  return item;
+}
+
+template <class Sync>
+void SafeQueueBlocking(const std::string &name, int producers, int consumers,
+                       int items) {
+  using Queue = SafeQueue<Stamped, std::deque<Stamped>, Sync>;
+  Queue q;
+  Run(name, producers, consumers, items, q,
+      [](Queue &q, int, int, bool stop) { q.Push(Stamp(stop)); },
+      [](Queue &q) { return q.PopWithGuard().first; });
+}
+
+void SafeQueueTimed(int producers, int consumers, int items) {
+  SafeQueue<Stamped> q;
+  Run("SafeQueue/Pop(1ms)", producers, consumers, items, q,
+      [](SafeQueue<Stamped> &q, int, int, bool stop) { q.Push(Stamp(stop)); },
+      [](SafeQueue<Stamped> &q) {
+        while (true) {
+          try {
+            return q.PopWithGuard(std::chrono::milliseconds(1)).first;
+          } catch (const TimeoutError &) {
+          }
+        }
+      });
+}
+
+void SafeQueueSpin(int producers, int consumers, int items) {
+  SafeQueue<Stamped> q;
+  Run("SafeQueue/TryPop+yield", producers, consumers, items, q,
+      [](SafeQueue<Stamped> &q, int, int, bool stop) { q.Push(Stamp(stop)); },
+      [](SafeQueue<Stamped> &q) {
+        Stamped item;
+        while (!q.TryPop(item))
+          std::this_thread::yield();
+        q.TaskDone();
+        return item;
+      });
+}
+
+void FixedQueueBlocking(int producers, int consumers, int items) {
+  using Queue = FixedSafeQueue<Stamped, 1024>;
+  auto q = std::make_unique<Queue>();
+  Run("FixedSafeQueue<1024>/Pop", producers, consumers, items, *q,
+      [](Queue &q, int, int, bool stop) { q.Push(Stamp(stop)); },
+      [](Queue &q) { return q.PopWithGuard().first; });
+}
+
+void IntrusiveMpsc(int producers, int items) {
+  using Queue = IntrusiveMpscQueue<Stamped, &Stamped::hook>;
+  Queue q;
+  std::vector<std::unique_ptr<Stamped[]>> nodes;
+  for (int p = 0; p < producers; ++p)
+    nodes.emplace_back(new Stamped[items + 1]);
+  Run("IntrusiveMpscQueue/Pop", producers, 1, items, q,
+      [&](Queue &q, int p, int i, bool stop) {
+        auto &node = nodes[p][i];
+        node.stop = stop;
+        node.pushed = Clock::now();
+        q.Push(node);
+      },
+      [](Queue &q) {
+        const Stamped item = q.Pop();
+        q.TaskDone();
+        return item;
+      });
+}
+
+/// Every thread takes the lock `rounds` times for a tiny critical section.
+template <class Lock>
+void LockRounds(const std::string &name, int threads, int rounds) {
+  Lock lock;
+  std::uint64_t counter = 0;
+  std::vector<std::thread> workers;
+  const auto start = Clock::now();
+  for (int t = 0; t < threads; ++t)
+    workers.emplace_back([&]() {
+      for (int i = 0; i < rounds; ++i) {
+        std::lock_guard<Lock> guard(lock);
+        ++counter;
+      }
+    });
+  for (auto &worker : workers)
+    worker.join();
+  const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      Clock::now() - start)
+                      .count();
+  std::printf("%-28s %d threads %9llu locks | ns per lock %8.1f\n",
+              name.c_str(), threads,
+              static_cast<unsigned long long>(counter),
+              static_cast<double>(ns) / static_cast<double>(counter));
+  std::fflush(stdout);
+}
+
+/// Counts dTLB load misses of the calling thread through perf_event_open(2).
+/// Many containers and VMs do not expose the counter; Stop() then returns -1.
+class DtlbMissCounter final {
+public:
+  DtlbMissCounter() {
+#if defined(__linux__)
+    perf_event_attr attr{};
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                  (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    mFd = static_cast<int>(
+        ::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+  }
+  DtlbMissCounter(const DtlbMissCounter &) = delete;
+  DtlbMissCounter &operator=(const DtlbMissCounter &) = delete;
+  ~DtlbMissCounter() {
+#if defined(__linux__)
+    if (mFd >= 0)
+      ::close(mFd);
+#endif
+  }
+
+  void Start() {
+#if defined(__linux__)
+    if (mFd >= 0) {
+      ::ioctl(mFd, PERF_EVENT_IOC_RESET, 0);
+      ::ioctl(mFd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+  }
+
+  long long Stop() {
+#if defined(__linux__)
+    long long count = 0;
+    if (mFd >= 0) {
+      ::ioctl(mFd, PERF_EVENT_IOC_DISABLE, 0);
+      if (::read(mFd, &count, sizeof(count)) == sizeof(count))
+        return count;
+    }
+#endif
+    return -1;
+  }
+
+private:
+  int mFd = -1;
+};
+
+struct BigThing {
+  char data[2048];
+  BigThing() { std::fill(std::begin(data), std::end(data), 0); };
+};
+
+template <class Queue>
+void CycleBigThings(const std::string &name, Queue &q, int rounds) {
+  DtlbMissCounter counter;
+  const auto start = Clock::now();
+  counter.Start();
+  for (int round = 0; round < rounds; ++round) {
+    for (std::size_t i = 0; i < Queue::capacity(); ++i)
+      q.Emplace();
+    for (std::size_t i = 0; i < Queue::capacity(); ++i)
+      q.PopWithGuard();
+  }
+  const auto misses = counter.Stop();
+  const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      Clock::now() - start)
+                      .count();
+  if (misses < 0)
+    std::printf("%-40s %6lld ms | dTLB load misses n/a\n", name.c_str(),
+                static_cast<long long>(ms));
+  else
+    std::printf("%-40s %6lld ms | dTLB load misses %12lld\n", name.c_str(),
+                static_cast<long long>(ms), misses);
+  std::fflush(stdout);
+}
+
+void HugePages(int rounds) {
+  constexpr std::size_t slots = 4096; // 8 MiB of BigThings
+  {
+    using Queue = FixedSafeQueue<BigThing, slots>;
+    auto q = std::make_unique<Queue>();
+    CycleBigThings("FixedSafeQueue<BigThing, 4096>", *q, rounds);
+  }
+  {
+    using Queue = FixedSafeQueue<BigThing, slots, HugePageStorage>;
+    Queue q;
+    const char *kind = q.storage().Kind() == PageKind::Huge ? "MAP_HUGETLB"
+                       : q.storage().Kind() == PageKind::Transparent
+                           ? "MADV_HUGEPAGE"
+                           : "fallback";
+    CycleBigThings(std::string("HugePageStorage (") + kind + ")", q, rounds);
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const int items = argc > 1 ? std::atoi(argv[1]) : 100000;
+  const std::pair<int, int> configurations[] = {{1, 1}, {1, 4}, {4, 1}, {4, 4}};
+  for (const auto &config : configurations) {
+    SafeQueueBlocking<StdSync>("SafeQueue/Pop", config.first, config.second,
+                               items);
+    SafeQueueBlocking<FutexSync>("SafeQueue<FutexSync>/Pop", config.first,
+                                 config.second, items);
+    SafeQueueBlocking<SpinSync>("SafeQueue<SpinSync>/Pop", config.first,
+                                config.second, items);
+    SafeQueueBlocking<TicketSync>("SafeQueue<TicketSync>/Pop", config.first,
+                                  config.second, items);
+    SafeQueueBlocking<ClhSync>("SafeQueue<ClhSync>/Pop", config.first,
+                               config.second, items);
+    SafeQueueTimed(config.first, config.second, items);
+    SafeQueueSpin(config.first, config.second, items);
+    FixedQueueBlocking(config.first, config.second, items);
+    if (config.second == 1)
+      IntrusiveMpsc(config.first, items);
+  }
+  for (int threads : {1, 2, 4, 8}) {
+    LockRounds<std::mutex>("std::mutex", threads, items);
+    LockRounds<SpinLock>("SpinLock", threads, items);
+    LockRounds<TicketLock>("TicketLock", threads, items);
+    LockRounds<ClhLock>("ClhLock", threads, items);
+  }
+  HugePages(std::max(1, items / 4096));
+  return 0;
+}
@@ -0,0 +1,144 @@
+#include <rwols/BroadcastQueue.hpp>
+
+#include <gmock/gmock.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace rwols;
+
+namespace {
+
+struct Counted {
+  static int alive;
+  int value;
+  explicit Counted(int v) : value(v) { ++alive; }
+  Counted(const Counted &other) : value(other.value) { ++alive; }
+  ~Counted() { --alive; }
+};
+int Counted::alive = 0;
+
+} // namespace
+
+TEST(BroadcastQueue, EverySubscriberSeesEveryItem) {
+  BroadcastQueue<std::string> q(8);
+  auto a = q.Subscribe();
+  auto b = q.Subscribe();
+  q.Push("one");
+  q.Push("two");
+  const auto &first = a.Pop();
+  EXPECT_EQ(first, "one");
+  EXPECT_EQ(&b.Pop(), &first); // Stored once, not copied per subscriber.
+  EXPECT_EQ(a.Pop(), "two");
+  EXPECT_EQ(b.Pop(), "two");
+  a.TaskDone();
+  a.TaskDone();
+  b.TaskDone();
+  b.TaskDone();
+  EXPECT_THROW(a.Pop(std::chrono::milliseconds(10)), TimeoutError);
+}
+
+TEST(BroadcastQueue, LateSubscriberStartsAtTheEnd) {
+  BroadcastQueue<int> q(8);
+  auto a = q.Subscribe();
+  q.Push(1);
+  auto b = q.Subscribe();
+  q.Push(2);
+  EXPECT_EQ(b.PopWithGuard().first, 2);
+  EXPECT_EQ(a.PopWithGuard().first, 1);
+  EXPECT_EQ(a.PopWithGuard().first, 2);
+}
+
+TEST(BroadcastQueue, SlotsAreReclaimedAfterTheSlowestSubscriber) {
+  Counted::alive = 0;
+  {
+    BroadcastQueue<Counted> q(2);
+    auto fast = q.Subscribe();
+    auto slow = q.Subscribe();
+    q.Emplace(1);
+    q.Emplace(2);
+    fast.PopWithGuard();
+    EXPECT_EQ(Counted::alive, 2);
+    slow.PopWithGuard();
+    EXPECT_EQ(Counted::alive, 1);
+    q.Emplace(3);
+    fast.PopWithGuard();
+    fast.PopWithGuard();
+    slow.PopWithGuard();
+    slow.PopWithGuard();
+    EXPECT_EQ(Counted::alive, 0);
+  }
+  EXPECT_EQ(Counted::alive, 0);
+}
+
+TEST(BroadcastQueue, PushBlocksOnTheSlowestSubscriber) {
+  BroadcastQueue<int> q(1);
+  auto a = q.Subscribe();
+  auto b = q.Subscribe();
+  q.Push(1);
+  std::atomic<bool> pushed{false};
+  std::thread producer([&]() {
+    q.Push(2);
+    pushed = true;
+  });
+  a.PopWithGuard();
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_FALSE(pushed);
+  b.PopWithGuard();
+  producer.join();
+  EXPECT_TRUE(pushed);
+  a.PopWithGuard();
+  b.PopWithGuard();
+}
+
+TEST(BroadcastQueue, WithoutSubscribersItemsAreDropped) {
+  BroadcastQueue<int> q(1);
+  q.Push(1);
+  q.Push(2);
+  q.Join();
+}
+
+TEST(BroadcastQueue, UnsubscribingReleasesUnfinishedItems) {
+  BroadcastQueue<int> q(1);
+  auto a = q.Subscribe();
+  {
+    auto b = q.Subscribe();
+    q.Push(1);
+    b.Pop();
+  }
+  a.PopWithGuard();
+  q.Push(2);
+  a.PopWithGuard();
+}
+
+TEST(BroadcastQueue, MovedSubscriberKeepsItsCursor) {
+  BroadcastQueue<int> q(4);
+  auto a = q.Subscribe();
+  q.Push(1);
+  q.Push(2);
+  a.PopWithGuard();
+  auto b = std::move(a);
+  EXPECT_EQ(b.PopWithGuard().first, 2);
+}
+
+TEST(BroadcastQueue, JoinWaitsForEverySubscriber) {
+  BroadcastQueue<int> q(16);
+  std::vector<BroadcastQueue<int>::Subscriber> subscribers;
+  for (int i = 0; i < 3; ++i)
+    subscribers.push_back(q.Subscribe());
+  std::vector<int> sums(3);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 3; ++i)
+    threads.emplace_back([&, i]() {
+      for (int j = 0; j < 1000; ++j)
+        sums[i] += subscribers[i].PopWithGuard().first;
+    });
+  for (int j = 0; j < 1000; ++j)
+    q.Push(j);
+  q.Join();
+  for (auto &thread : threads)
+    thread.join();
+  EXPECT_EQ(sums, std::vector<int>(3, 999 * 1000 / 2));
+}
@@ -0,0 +1,130 @@
+#include <rwols/ByteRingQueue.hpp>
+
+#include <gmock/gmock.h>
+
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace rwols;
+
+namespace {
+
+void PushString(ByteRingQueue &q, const std::string &s) {
+  auto writer = q.Reserve(s.size());
+  std::memcpy(writer.data(), s.data(), s.size());
+  writer.Commit();
+}
+
+std::string PopString(ByteRingQueue &q) {
+  auto reader = q.Pop();
+  return std::string(reader.data(), reader.size());
+}
+
+} // namespace
+
+TEST(ByteRingQueue, ReserveCommitPop) {
+  ByteRingQueue q(256);
+  PushString(q, "hello");
+  PushString(q, "");
+  PushString(q, "world!!!!");
+  EXPECT_EQ(PopString(q), "hello");
+  EXPECT_EQ(PopString(q), "");
+  EXPECT_EQ(PopString(q), "world!!!!");
+  EXPECT_THROW(q.Pop(std::chrono::milliseconds(10)), TimeoutError);
+}
+
+TEST(ByteRingQueue, RecordsAreReadInPlace) {
+  ByteRingQueue q(256);
+  auto writer = q.Reserve(4);
+  char *bytes = writer.data();
+  std::memcpy(bytes, "abcd", 4);
+  writer.Commit();
+  auto reader = q.Pop();
+  EXPECT_EQ(reader.data(), bytes);
+}
+
+TEST(ByteRingQueue, UncommittedRecordHoldsBackLaterOnes) {
+  ByteRingQueue q(256);
+  auto first = q.Reserve(1);
+  PushString(q, "second");
+  EXPECT_THROW(q.Pop(std::chrono::milliseconds(10)), TimeoutError);
+  first.data()[0] = 'x';
+  first.Commit();
+  EXPECT_EQ(PopString(q), "x");
+  EXPECT_EQ(PopString(q), "second");
+}
+
+TEST(ByteRingQueue, AbandonedReservationIsSkipped) {
+  ByteRingQueue q(256);
+  { auto abandoned = q.Reserve(10); }
+  PushString(q, "kept");
+  EXPECT_EQ(PopString(q), "kept");
+  q.Join();
+}
+
+TEST(ByteRingQueue, FullRingBlocksUntilRelease) {
+  ByteRingQueue q(64); // Room for four 8-byte records with their headers.
+  for (int i = 0; i < 4; ++i)
+    PushString(q, "12345678");
+  EXPECT_THROW(q.Reserve(8, std::chrono::milliseconds(10)), TimeoutError);
+  auto reader = q.Pop();
+  EXPECT_THROW(q.Reserve(8, std::chrono::milliseconds(10)), TimeoutError);
+  reader.Release();
+  q.Reserve(8, std::chrono::milliseconds(10)).Commit();
+  for (int i = 0; i < 4; ++i)
+    PopString(q);
+}
+
+TEST(ByteRingQueue, OutOfOrderReleaseReclaimsFromTheOldest) {
+  ByteRingQueue q(64);
+  for (int i = 0; i < 4; ++i)
+    PushString(q, "12345678");
+  auto a = q.Pop();
+  auto b = q.Pop();
+  b.Release();
+  EXPECT_THROW(q.Reserve(8, std::chrono::milliseconds(10)), TimeoutError);
+  a.Release();
+  q.Reserve(24, std::chrono::milliseconds(10)).Commit();
+  PopString(q);
+  PopString(q);
+  EXPECT_EQ(q.Pop().size(), 24u);
+}
+
+TEST(ByteRingQueue, WrapsAroundWithPadding) {
+  ByteRingQueue q(64);
+  PushString(q, std::string(20, 'a')); // 32 bytes
+  PushString(q, std::string(8, 'b'));  // 16 bytes
+  EXPECT_EQ(PopString(q), std::string(20, 'a'));
+  // 16 bytes are left at the end; this record goes to the start of the ring.
+  PushString(q, std::string(20, 'c'));
+  EXPECT_EQ(PopString(q), std::string(8, 'b'));
+  EXPECT_EQ(PopString(q), std::string(20, 'c'));
+}
+
+TEST(ByteRingQueue, TooLargeRecordThrows) {
+  ByteRingQueue q(64);
+  EXPECT_THROW(q.Reserve(57), std::length_error);
+}
+
+TEST(ByteRingQueue, ManyProducersAndConsumers) {
+  ByteRingQueue q(1024);
+  std::vector<std::thread> threads;
+  std::atomic<int> total{0};
+  for (int p = 0; p < 4; ++p)
+    threads.emplace_back([&q, p]() {
+      for (int i = 0; i < 1000; ++i)
+        PushString(q, std::string(static_cast<std::size_t>(i % 50), 'x'));
+    });
+  for (int c = 0; c < 2; ++c)
+    threads.emplace_back([&q, &total]() {
+      for (int i = 0; i < 2000; ++i)
+        total += static_cast<int>(q.Pop().size());
+    });
+  for (auto &thread : threads)
+    thread.join();
+  q.Join();
+  EXPECT_EQ(total, 4 * 20 * (49 * 50 / 2));
+}
@@ -0,0 +1,65 @@
+#include <rwols/ConflatingSafeQueue.hpp>
+
+#include <gmock/gmock.h>
+
+#include <string>
+#include <thread>
+
+using namespace rwols;
+
+TEST(ConflatingSafeQueue, DistinctKeysKeepOrder) {
+  ConflatingSafeQueue<std::string, int> q;
+  EXPECT_TRUE(q.Push("a", 1));
+  EXPECT_TRUE(q.Push("b", 2));
+  EXPECT_EQ(q.PopWithGuard().first, std::make_pair(std::string("a"), 1));
+  EXPECT_EQ(q.PopWithGuard().first, std::make_pair(std::string("b"), 2));
+  EXPECT_EQ(q.Conflated(), 0u);
+}
+
+TEST(ConflatingSafeQueue, UpdateReplacesPendingValueInPlace) {
+  ConflatingSafeQueue<std::string, int> q;
+  q.Push("a", 1);
+  q.Push("b", 2);
+  EXPECT_FALSE(q.Push("a", 3));
+  EXPECT_EQ(q.Size(), 2u);
+  EXPECT_EQ(q.Conflated(), 1u);
+  EXPECT_EQ(q.PopWithGuard().first, std::make_pair(std::string("a"), 3));
+  EXPECT_EQ(q.PopWithGuard().first, std::make_pair(std::string("b"), 2));
+  EXPECT_THROW(q.Pop(std::chrono::milliseconds(10)), TimeoutError);
+}
+
+TEST(ConflatingSafeQueue, PoppedKeyIsQueuedAgain) {
+  ConflatingSafeQueue<int, int> q;
+  q.Push(1, 10);
+  q.Push(2, 20);
+  auto first = q.PopWithGuard();
+  EXPECT_TRUE(q.Push(1, 11)); // Not pending any more, so it goes last.
+  EXPECT_EQ(q.PopWithGuard().first.first, 2);
+  EXPECT_EQ(q.PopWithGuard().first.second, 11);
+}
+
+TEST(ConflatingSafeQueue, ConflatedPushIsNotATask) {
+  ConflatingSafeQueue<int, int> q;
+  for (int i = 0; i < 100; ++i)
+    q.Push(i % 3, i);
+  std::thread consumer([&q]() {
+    for (int i = 0; i < 3; ++i)
+      q.PopWithGuard();
+  });
+  q.Join();
+  consumer.join();
+  EXPECT_EQ(q.Conflated(), 97u);
+}
+
+TEST(ConflatingSafeQueue, ConsumerSeesLatestValues) {
+  ConflatingSafeQueue<int, int> q;
+  std::thread producer([&q]() {
+    for (int i = 0; i <= 10000; ++i)
+      q.Push(i % 4, i);
+  });
+  producer.join();
+  int sum = 0;
+  for (int i = 0; i < 4; ++i)
+    sum += q.PopWithGuard().first.second;
+  EXPECT_EQ(sum, 10000 + 9999 + 9998 + 9997);
+}
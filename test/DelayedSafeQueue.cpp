@@ -0,0 +1,140 @@
+#include <rwols/DelayedSafeQueue.hpp>
+
+#include <gmock/gmock.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace rwols;
+using namespace std::chrono;
+
+namespace {
+
+/// Clock that only moves when a test says so.
+struct ManualClock {
+  using duration = std::chrono::milliseconds;
+  using rep = duration::rep;
+  using period = duration::period;
+  using time_point = std::chrono::time_point<ManualClock>;
+  static constexpr bool is_steady = true;
+
+  static time_point now() { return time_point(duration(Now())); }
+  static rep &Now() {
+    static rep now = 0;
+    return now;
+  }
+};
+
+} // namespace
+
+TEST(DelayedSafeQueue, ImmediatePush) {
+  DelayedSafeQueue<int> q;
+  q.Push(1);
+  EXPECT_EQ(q.PopWithGuard().first, 1);
+}
+
+TEST(DelayedSafeQueue, NotPoppedBeforeItsTime) {
+  DelayedSafeQueue<int> q;
+  const auto start = steady_clock::now();
+  q.PushAfter(1, milliseconds(50));
+  EXPECT_THROW(q.Pop(milliseconds(10)), TimeoutError);
+  EXPECT_EQ(q.Pending(), 1u);
+  EXPECT_EQ(q.PopWithGuard().first, 1);
+  EXPECT_GE(steady_clock::now() - start, milliseconds(50));
+}
+
+TEST(DelayedSafeQueue, DueOrder) {
+  DelayedSafeQueue<int> q;
+  const auto now = steady_clock::now();
+  q.PushAt(3, now + milliseconds(30));
+  q.PushAt(1, now + milliseconds(10));
+  q.PushAt(2, now + milliseconds(20));
+  q.PushAt(0, now - milliseconds(10));
+  for (int i = 0; i < 4; ++i)
+    EXPECT_EQ(q.PopWithGuard().first, i);
+}
+
+TEST(DelayedSafeQueue, EarlierItemWakesSleepingConsumer) {
+  DelayedSafeQueue<int> q;
+  q.PushAfter(2, milliseconds(300));
+  std::thread producer([&q]() {
+    std::this_thread::sleep_for(milliseconds(20));
+    q.PushAfter(1, milliseconds(10));
+  });
+  const auto start = steady_clock::now();
+  EXPECT_EQ(q.PopWithGuard().first, 1);
+  EXPECT_LT(steady_clock::now() - start, milliseconds(200));
+  producer.join();
+  EXPECT_EQ(q.Pop(seconds(2)), 2);
+  q.TaskDone();
+}
+
+TEST(DelayedSafeQueue, ItemsDueTogetherWakeEveryConsumer) {
+  DelayedSafeQueue<int> q;
+  std::atomic<int> popped(0);
+  std::vector<std::thread> consumers;
+  for (int i = 0; i < 2; ++i)
+    consumers.emplace_back([&]() {
+      q.PopWithGuard();
+      ++popped;
+    });
+  std::this_thread::sleep_for(milliseconds(20)); // Both sleep, no deadline.
+  const auto due = steady_clock::now() + milliseconds(20);
+  q.PushAt(1, due);
+  q.PushAt(2, due);
+  const auto deadline = steady_clock::now() + seconds(2);
+  while (popped < 2 && steady_clock::now() < deadline)
+    std::this_thread::sleep_for(milliseconds(1));
+  EXPECT_EQ(popped, 2);
+  for (int i = popped; i < 2; ++i)
+    q.Push(0); // Let a stuck consumer go, so that the test can end.
+  for (auto &consumer : consumers)
+    consumer.join();
+}
+
+TEST(DelayedSafeQueue, CascadesThroughAllLevels) {
+  ManualClock::Now() = 0;
+  DelayedSafeQueue<int, ManualClock> q(milliseconds(1));
+  // One item per level of the wheel, and one beyond its reach.
+  const ManualClock::rep delays[] = {5,       63,       64,      100,
+                                     4095,    4096,     5000,    262143,
+                                     262144,  300000,   16777215, 16777216,
+                                     20000000};
+  int expected = 0;
+  for (const auto delay : delays)
+    q.PushAt(expected++, ManualClock::now() + milliseconds(delay));
+  expected = 0;
+  for (const auto delay : delays) {
+    ManualClock::Now() = delay - 1;
+    EXPECT_THROW(q.Pop(milliseconds(0)), TimeoutError) << delay;
+    ManualClock::Now() = delay;
+    EXPECT_EQ(q.Pop(milliseconds(0)), expected++) << delay;
+    q.TaskDone();
+  }
+  EXPECT_EQ(q.Size(), 0u);
+}
+
+TEST(DelayedSafeQueue, ManyPendingItems) {
+  ManualClock::Now() = 0;
+  DelayedSafeQueue<int, ManualClock> q(milliseconds(1));
+  for (int i = 0; i < 100000; ++i)
+    q.PushAt(i, ManualClock::now() + milliseconds((i * 7919) % 100000));
+  EXPECT_EQ(q.Size(), 100000u);
+  ManualClock::Now() = 100000;
+  std::vector<bool> seen(100000);
+  for (int i = 0; i < 100000; ++i) {
+    seen[static_cast<std::size_t>(q.Pop(milliseconds(0)))] = true;
+    q.TaskDone();
+  }
+  EXPECT_EQ(std::count(seen.begin(), seen.end(), true), 100000);
+}
+
+TEST(DelayedSafeQueue, JoinWaitsForPendingItems) {
+  DelayedSafeQueue<int> q;
+  q.PushAfter(1, milliseconds(20));
+  std::thread consumer([&q]() { q.PopWithGuard(); });
+  q.Join();
+  EXPECT_EQ(q.Size(), 0u);
+  consumer.join();
+}
@@ -0,0 +1,183 @@
+#include <rwols/DurableSafeQueue.hpp>
+
+#include <gmock/gmock.h>
+
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace rwols;
+
+namespace {
+
+/// Fresh journal directory that is removed again at the end of the test.
+class TempDirectory final {
+public:
+  TempDirectory() {
+    char pattern[] = "/tmp/rwols-journal-XXXXXX";
+    mPath = ::mkdtemp(pattern);
+  }
+  ~TempDirectory() {
+    for (const auto &name : Files())
+      ::unlink((mPath + "/" + name).c_str());
+    ::rmdir(mPath.c_str());
+  }
+  const std::string &Path() const { return mPath; }
+  std::vector<std::string> Files() const {
+    std::vector<std::string> names;
+    if (auto *dir = ::opendir(mPath.c_str())) {
+      while (const auto *entry = ::readdir(dir))
+        if (entry->d_name[0] != '.')
+          names.push_back(entry->d_name);
+      ::closedir(dir);
+    }
+    return names;
+  }
+
+private:
+  std::string mPath;
+};
+
+JournalOptions SmallSegments() {
+  JournalOptions options;
+  options.segmentBytes = 4096;
+  return options;
+}
+
+} // namespace
+
+TEST(DurableSafeQueue, PushPop) {
+  TempDirectory dir;
+  DurableSafeQueue<int> q(dir.Path());
+  q.Push(1);
+  q.Push(2);
+  auto first = q.Pop();
+  auto second = q.Pop();
+  EXPECT_EQ(first.second, 1);
+  EXPECT_EQ(second.second, 2);
+  EXPECT_LT(first.first, second.first);
+  q.TaskDone(first.first);
+  q.TaskDone(second.first);
+  EXPECT_THROW(q.Pop(std::chrono::milliseconds(10)), TimeoutError);
+}
+
+TEST(DurableSafeQueue, ReplaysUnacknowledgedItems) {
+  TempDirectory dir;
+  {
+    DurableSafeQueue<std::string> q(dir.Path());
+    q.Push("one");
+    q.Push("two");
+    q.Push("three");
+    auto pair = q.PopWithGuard();
+    EXPECT_EQ(pair.first, "one");
+    q.TaskDone(q.Pop().first); // "two" is popped and acknowledged.
+  }
+  DurableSafeQueue<std::string> q(dir.Path());
+  auto pair = q.PopWithGuard();
+  EXPECT_EQ(pair.first, "three");
+  EXPECT_THROW(q.Pop(std::chrono::milliseconds(10)), TimeoutError);
+}
+
+TEST(DurableSafeQueue, NoDefaultConstructor) {
+  struct Item {
+    explicit Item(int value) : value(value) {}
+    int value;
+  };
+  TempDirectory dir;
+  {
+    DurableSafeQueue<Item> q(dir.Path());
+    q.Push(Item(1));
+    q.Push(Item(2));
+  }
+  DurableSafeQueue<Item> q(dir.Path());
+  auto pair = q.PopWithGuard();
+  EXPECT_EQ(pair.first.value, 1);
+}
+
+TEST(DurableSafeQueue, ReplayKeepsOrderAndNewIdsAreLarger) {
+  TempDirectory dir;
+  {
+    DurableSafeQueue<int> q(dir.Path(), SmallSegments());
+    for (int i = 0; i < 1000; ++i)
+      q.Push(i);
+  }
+  DurableSafeQueue<int> q(dir.Path(), SmallSegments());
+  q.Push(1000);
+  std::uint64_t last = 0;
+  for (int i = 0; i <= 1000; ++i) {
+    auto entry = q.Pop();
+    EXPECT_EQ(entry.second, i);
+    EXPECT_GT(entry.first, last);
+    last = entry.first;
+    q.TaskDone(entry.first);
+  }
+}
+
+TEST(DurableSafeQueue, AcknowledgedSegmentsAreDeleted) {
+  TempDirectory dir;
+  DurableSafeQueue<int> q(dir.Path(), SmallSegments());
+  for (int i = 0; i < 1000; ++i)
+    q.Push(i);
+  EXPECT_GT(dir.Files().size(), 3u);
+  for (int i = 0; i < 1000; ++i)
+    q.PopWithGuard();
+  EXPECT_LE(dir.Files().size(), 2u);
+}
+
+TEST(DurableSafeQueue, TornTailIsIgnored) {
+  TempDirectory dir;
+  {
+    DurableSafeQueue<int> q(dir.Path());
+    q.Push(7);
+  }
+  ASSERT_EQ(dir.Files().size(), 1u);
+  const auto path = dir.Path() + "/" + dir.Files().front();
+  const int fd = ::open(path.c_str(), O_RDWR);
+  ASSERT_GE(fd, 0);
+  const int garbage = 0x7fffffff;
+  // Overwrite the payload, which starts right after the 24-byte header.
+  ASSERT_EQ(::pwrite(fd, &garbage, sizeof(garbage), 24),
+            ssize_t(sizeof(garbage)));
+  ::close(fd);
+  DurableSafeQueue<int> q(dir.Path());
+  EXPECT_THROW(q.Pop(std::chrono::milliseconds(10)), TimeoutError);
+}
+
+TEST(DurableSafeQueue, ConcurrentProducersShareCommits) {
+  TempDirectory dir;
+  JournalOptions options;
+  options.commitInterval = std::chrono::milliseconds(2);
+  DurableSafeQueue<int> q(dir.Path(), options);
+  std::vector<std::thread> producers;
+  for (int p = 0; p < 4; ++p)
+    producers.emplace_back([&q, p]() {
+      for (int i = 0; i < 50; ++i)
+        q.Push(p * 100 + i);
+    });
+  int sum = 0;
+  for (int i = 0; i < 200; ++i) {
+    auto pair = q.PopWithGuard();
+    sum += pair.first % 100;
+  }
+  for (auto &producer : producers)
+    producer.join();
+  EXPECT_EQ(sum, 4 * (49 * 50 / 2));
+  q.Join();
+}
+
+TEST(DurableSafeQueue, WithoutWaitingForCommit) {
+  TempDirectory dir;
+  JournalOptions options;
+  options.waitForCommit = false;
+  options.commitInterval = std::chrono::seconds(10);
+  DurableSafeQueue<int> q(dir.Path(), options);
+  const auto start = std::chrono::steady_clock::now();
+  q.Push(1);
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(1));
+  EXPECT_EQ(q.PopWithGuard().first, 1);
+}
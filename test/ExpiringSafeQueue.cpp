@@ -0,0 +1,106 @@
+#include <rwols/ExpiringSafeQueue.hpp>
+
+#include <gmock/gmock.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace rwols;
+using namespace std::chrono;
+
+TEST(ExpiringSafeQueue, NoTtlKeepsEverything) {
+  ExpiringSafeQueue<int> q;
+  q.Push(1);
+  q.Push(2);
+  EXPECT_EQ(q.PopWithGuard().first, 1);
+  EXPECT_EQ(q.PopWithGuard().first, 2);
+  EXPECT_EQ(q.Dropped(), 0u);
+}
+
+TEST(ExpiringSafeQueue, PopSkipsExpiredItems) {
+  std::vector<int> expired;
+  ExpiringSafeQueue<int> q(milliseconds(20),
+                           [&](int &&i) { expired.push_back(i); });
+  q.Push(1);
+  q.Push(2);
+  std::this_thread::sleep_for(milliseconds(40));
+  q.Push(3);
+  EXPECT_EQ(q.Size(), 3u);
+  EXPECT_EQ(q.PopWithGuard().first, 3);
+  EXPECT_THAT(expired, ::testing::ElementsAre(1, 2));
+  EXPECT_EQ(q.Dropped(), 2u);
+  EXPECT_EQ(q.Size(), 0u);
+}
+
+TEST(ExpiringSafeQueue, PerItemDeadlines) {
+  ExpiringSafeQueue<int> q;
+  q.PushFor(1, milliseconds(10));
+  q.PushUntil(2, steady_clock::now() + seconds(10));
+  q.PushFor(3, milliseconds(10));
+  std::this_thread::sleep_for(milliseconds(30));
+  EXPECT_EQ(q.PopWithGuard().first, 2);
+  // Item 3 sits behind the item above, and expires only when it is in front.
+  EXPECT_EQ(q.Size(), 1u);
+  EXPECT_THROW(q.Pop(milliseconds(10)), TimeoutError);
+  EXPECT_EQ(q.Dropped(), 2u);
+}
+
+TEST(ExpiringSafeQueue, ExpiredItemsCountAsDone) {
+  ExpiringSafeQueue<int> q(milliseconds(5));
+  for (int i = 0; i < 10; ++i)
+    q.Push(i);
+  std::this_thread::sleep_for(milliseconds(20));
+  std::thread consumer([&q]() {
+    try {
+      q.Pop(milliseconds(50));
+    } catch (const TimeoutError &) {
+    }
+  });
+  q.Join();
+  consumer.join();
+  EXPECT_EQ(q.Dropped(), 10u);
+}
+
+TEST(ExpiringSafeQueue, CallbackRunsBeforeJoinReturns) {
+  std::atomic<int> expired(0);
+  ExpiringSafeQueue<int> q(std::chrono::hours(1),
+                           [&](int &&) { ++expired; });
+  std::thread consumer([&]() { q.PopWithGuard(); });
+  std::this_thread::sleep_for(milliseconds(20)); // The consumer waits.
+  q.PushUntil(1, steady_clock::now() - milliseconds(1));
+  q.Join(); // No live item arrives, yet the callback must have run.
+  EXPECT_EQ(expired, 1);
+  q.Push(2);
+  consumer.join();
+}
+
+TEST(ExpiringSafeQueue, ThrowingCallbackStillExpiresTheRest) {
+  std::vector<int> expired;
+  ExpiringSafeQueue<int> q(std::chrono::hours(1), [&](int &&item) {
+    expired.push_back(item);
+    if (item == 1)
+      throw std::runtime_error("callback failed");
+  });
+  const auto past = steady_clock::now() - milliseconds(1);
+  for (int i = 0; i < 3; ++i)
+    q.PushUntil(i, past);
+  q.Push(3);
+  EXPECT_THROW(q.Pop(), std::runtime_error);
+  EXPECT_EQ(expired, (std::vector<int>{0, 1, 2}));
+  EXPECT_EQ(q.Dropped(), 3u);
+  EXPECT_EQ(q.PopWithGuard().first, 3);
+}
+
+TEST(ExpiringSafeQueue, TimedPopWaitsForLiveItem) {
+  ExpiringSafeQueue<int> q;
+  q.PushFor(1, milliseconds(1));
+  std::this_thread::sleep_for(milliseconds(5));
+  std::thread producer([&q]() {
+    std::this_thread::sleep_for(milliseconds(20));
+    q.Push(2);
+  });
+  EXPECT_EQ(q.PopWithGuard(seconds(5)).first, 2);
+  producer.join();
+}
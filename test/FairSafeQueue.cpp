@@ -0,0 +1,97 @@
+#include <rwols/FairSafeQueue.hpp>
+
+#include <gmock/gmock.h>
+
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace rwols;
+
+TEST(FairSafeQueue, OneTenantIsFifo) {
+  FairSafeQueue<int, int> q;
+  for (int i = 0; i < 5; ++i)
+    q.Push(7, i);
+  for (int i = 0; i < 5; ++i)
+    EXPECT_EQ(q.PopWithGuard().first, i);
+  EXPECT_EQ(q.ActiveTenants(), 0u);
+}
+
+TEST(FairSafeQueue, BurstDoesNotStarveOthers) {
+  FairSafeQueue<std::string, int> q;
+  for (int i = 0; i < 1000; ++i)
+    q.Push("noisy", i);
+  q.Push("quiet", -1);
+  EXPECT_EQ(q.ActiveTenants(), 2u);
+  EXPECT_EQ(q.PopWithGuard().first, 0);
+  EXPECT_EQ(q.PopWithGuard().first, -1);
+  EXPECT_EQ(q.PopWithGuard().first, 1);
+  EXPECT_EQ(q.Size(), 998u);
+  while (q.Size() != 0)
+    q.PopWithGuard();
+}
+
+TEST(FairSafeQueue, WeightsSetTheShares) {
+  FairSafeQueue<char, char> q;
+  q.SetWeight('a', 3);
+  for (int i = 0; i < 6; ++i) {
+    q.Push('a', 'a');
+    q.Push('b', 'b');
+  }
+  std::string order;
+  for (int i = 0; i < 8; ++i)
+    order += q.PopWithGuard().first;
+  EXPECT_EQ(order, "aaabaaab");
+  while (q.Size() != 0)
+    q.PopWithGuard();
+}
+
+TEST(FairSafeQueue, IdleTenantKeepsNoCredit) {
+  FairSafeQueue<char, char> q(2);
+  q.Push('a', 'a');
+  q.Push('b', 'b');
+  q.Push('b', 'b');
+  EXPECT_EQ(q.PopWithGuard().first, 'a'); // 'a' drains with credit left.
+  q.Push('a', 'a');
+  q.Push('a', 'a');
+  q.Push('a', 'a');
+  std::string order;
+  for (int i = 0; i < 5; ++i)
+    order += q.PopWithGuard().first;
+  EXPECT_EQ(order, "bbaaa");
+}
+
+TEST(FairSafeQueue, ZeroWeightIsRejected) {
+  EXPECT_THROW((FairSafeQueue<int, int>(0)), std::invalid_argument);
+  FairSafeQueue<int, int> q;
+  EXPECT_THROW(q.SetWeight(1, 0), std::invalid_argument);
+}
+
+TEST(FairSafeQueue, ManyTenantsManyConsumers) {
+  FairSafeQueue<int, int> q;
+  std::vector<std::thread> consumers;
+  std::mutex mutex;
+  std::map<int, int> counts;
+  for (int c = 0; c < 4; ++c)
+    consumers.emplace_back([&]() {
+      while (true) {
+        auto pair = q.PopWithGuard();
+        if (pair.first < 0)
+          return;
+        std::lock_guard<std::mutex> lock(mutex);
+        ++counts[pair.first];
+      }
+    });
+  for (int i = 0; i < 10; ++i)
+    for (int tenant = 0; tenant < 1000; ++tenant)
+      q.Push(tenant, tenant);
+  q.Join();
+  for (int c = 0; c < 4; ++c)
+    q.Push(-1, -1);
+  for (auto &consumer : consumers)
+    consumer.join();
+  EXPECT_EQ(counts.size(), 1000u);
+  for (const auto &count : counts)
+    EXPECT_EQ(count.second, 10);
+}
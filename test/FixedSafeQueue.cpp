@@ -0,0 +1,175 @@
+#include <rwols/FixedSafeQueue.hpp>
+
+#include <gmock/gmock.h>
+
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+using namespace rwols;
+
+TEST(FixedSafeQueue, ConstructAndDestruct) { FixedSafeQueue<int, 64> q; }
+
+TEST(FixedSafeQueue, NoHeap) {
+  using Queue = FixedSafeQueue<int, 1024>;
+  EXPECT_GE(sizeof(Queue), 1024 * sizeof(int));
+  EXPECT_EQ(Queue::capacity(), 1024u);
+}
+
+TEST(FixedSafeQueue, PushPop) {
+  FixedSafeQueue<int, 4> q;
+  for (int round = 0; round < 3; ++round) {
+    for (int i = 0; i < 4; ++i)
+      q.Push(i);
+    for (int i = 0; i < 4; ++i)
+      EXPECT_EQ(q.PopWithGuard().first, i);
+  }
+}
+
+TEST(FixedSafeQueue, TryPushWhenFull) {
+  FixedSafeQueue<int, 2> q;
+  EXPECT_TRUE(q.TryPush(1));
+  EXPECT_TRUE(q.TryPush(2));
+  EXPECT_FALSE(q.TryPush(3));
+  EXPECT_EQ(q.PopWithGuard().first, 1);
+  EXPECT_TRUE(q.TryPush(3));
+  EXPECT_EQ(q.PopWithGuard().first, 2);
+  EXPECT_EQ(q.PopWithGuard().first, 3);
+}
+
+TEST(FixedSafeQueue, Timeout) {
+  FixedSafeQueue<int, 2> q;
+  EXPECT_THROW(q.Pop(std::chrono::milliseconds(10)), TimeoutError);
+}
+
+TEST(FixedSafeQueue, UniquePtr) {
+  FixedSafeQueue<std::unique_ptr<int>, 2> q;
+  q.Push(std::make_unique<int>(42));
+  auto x = q.PopWithGuard();
+  ASSERT_TRUE(x.first.get());
+  EXPECT_EQ(*x.first, 42);
+}
+
+TEST(FixedSafeQueue, UnpoppedItemsAreDestroyed) {
+  auto counter = std::make_shared<int>(0);
+  {
+    FixedSafeQueue<std::shared_ptr<int>, 4> q;
+    q.Push(counter);
+    q.TaskDone();
+    EXPECT_EQ(counter.use_count(), 2);
+  }
+  EXPECT_EQ(counter.use_count(), 1);
+}
+
+TEST(FixedSafeQueue, ProducerBlocksWhenFull) {
+  FixedSafeQueue<int, 2> q;
+  std::thread producer([&]() {
+    for (int i = 0; i < 100; ++i)
+      q.Push(i);
+  });
+  for (int i = 0; i < 100; ++i)
+    EXPECT_EQ(q.PopWithGuard().first, i);
+  producer.join();
+}
+
+TEST(FixedSafeQueue, OverflowReject) {
+  FixedSafeQueue<int, 2> q(Overflow::Reject);
+  EXPECT_TRUE(q.Push(1));
+  EXPECT_TRUE(q.Push(2));
+  EXPECT_FALSE(q.Push(3));
+  EXPECT_FALSE(q.TryPush(4));
+  EXPECT_EQ(q.Stats().rejected, 2u);
+  EXPECT_EQ(q.PopWithGuard().first, 1);
+  EXPECT_EQ(q.PopWithGuard().first, 2);
+}
+
+TEST(FixedSafeQueue, OverflowDropOldest) {
+  FixedSafeQueue<std::unique_ptr<int>, 4> q(Overflow::DropOldest);
+  for (int i = 0; i < 10; ++i)
+    EXPECT_TRUE(q.Push(std::unique_ptr<int>(new int(i))));
+  EXPECT_EQ(q.Stats().droppedOldest, 6u);
+  for (int i = 6; i < 10; ++i)
+    EXPECT_EQ(*q.PopWithGuard().first, i);
+  q.Join(); // Dropped items need no TaskDone().
+}
+
+TEST(FixedSafeQueue, OverflowDropKeepsTaskCountExact) {
+  FixedSafeQueue<int, 2> q(Overflow::DropOldest);
+  q.Push(1);
+  q.Push(2);
+  std::atomic<bool> joined{false};
+  std::thread joiner;
+  {
+    auto first = q.PopWithGuard();
+    q.Push(3);
+    q.Push(4); // Drops 2; 1, 3 and 4 are all unfinished.
+    joiner = std::thread([&]() {
+      q.Join();
+      joined = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_FALSE(joined);
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_FALSE(joined); // 3 and 4 are still queued.
+  EXPECT_EQ(q.PopWithGuard().first, 3);
+  EXPECT_EQ(q.PopWithGuard().first, 4);
+  joiner.join();
+  EXPECT_EQ(q.Stats().droppedOldest, 1u);
+}
+
+TEST(FixedSafeQueue, OverflowDropRejectsProducerTaskDone) {
+  FixedSafeQueue<int, 2> q(Overflow::DropOldest);
+  q.Push(1);
+  // Nothing was popped, so this could only finish a queued item, which a
+  // later drop would count a second time.
+  EXPECT_THROW(q.TaskDone(), std::logic_error);
+  EXPECT_EQ(q.PopWithGuard().first, 1);
+}
+
+TEST(FixedSafeQueue, OverflowRejectedPushDoesNotJoin) {
+  FixedSafeQueue<int, 1> q(Overflow::Reject);
+  q.Push(1);
+  EXPECT_FALSE(q.PushAndJoin(2)); // Would wait for item 1 otherwise.
+  EXPECT_EQ(q.PopWithGuard().first, 1);
+}
+
+TEST(FixedSafeQueue, OverflowDropNewest) {
+  FixedSafeQueue<int, 4> q(Overflow::DropNewest);
+  for (int i = 0; i < 10; ++i)
+    q.Push(i);
+  EXPECT_EQ(q.Stats().droppedNewest, 6u);
+  for (int i : {0, 1, 2, 9})
+    EXPECT_EQ(q.PopWithGuard().first, i);
+}
+
+TEST(FixedSafeQueue, OverflowEvict) {
+  FixedSafeQueue<int, 4> q(Overflow::Evict, [](int i) { return i % 2 == 1; });
+  for (int i : {0, 1, 2, 3})
+    q.Push(i);
+  EXPECT_TRUE(q.Push(4));  // Evicts 1.
+  EXPECT_TRUE(q.Push(6));  // Evicts 3.
+  EXPECT_FALSE(q.Push(8)); // Nothing odd left to evict.
+  const auto stats = q.Stats();
+  EXPECT_EQ(stats.evicted, 2u);
+  EXPECT_EQ(stats.rejected, 1u);
+  for (int i : {0, 2, 4, 6})
+    EXPECT_EQ(q.PopWithGuard().first, i);
+}
+
+TEST(FixedSafeQueue, OverflowEvictNeedsPredicate) {
+  using Queue = FixedSafeQueue<int, 4>;
+  EXPECT_THROW(Queue q(Overflow::Evict), std::invalid_argument);
+}
+
+TEST(FixedSafeQueue, OverflowBlockCountsWaits) {
+  FixedSafeQueue<int, 1> q;
+  q.Push(0);
+  std::thread producer([&]() { q.Push(1); });
+  while (q.Stats().blocked == 0)
+    std::this_thread::yield();
+  EXPECT_EQ(q.PopWithGuard().first, 0);
+  EXPECT_EQ(q.PopWithGuard().first, 1);
+  producer.join();
+}
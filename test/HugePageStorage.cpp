@@ -0,0 +1,48 @@
+#include <rwols/FixedSafeQueue.hpp>
+#include <rwols/HugePageStorage.hpp>
+
+#include <gmock/gmock.h>
+
+#include <cstdint>
+#include <thread>
+
+using namespace rwols;
+
+namespace {
+
+struct BigThing {
+  char data[2048];
+  BigThing() { std::fill(std::begin(data), std::end(data), 0); };
+};
+
+} // namespace
+
+TEST(HugePageStorage, PageSize) {
+  const auto size = HugePageSize();
+  EXPECT_GE(size, 4096u);
+  EXPECT_EQ(size & (size - 1), 0u);
+}
+
+TEST(HugePageStorage, Alignment) {
+  HugePageStorage<std::uint64_t, 1024> storage;
+  const auto address = reinterpret_cast<std::uintptr_t>(storage.data());
+  if (storage.Kind() != PageKind::Normal) {
+    EXPECT_EQ(address % HugePageSize(), 0u);
+  }
+  storage.data()[1023] = 42;
+  EXPECT_EQ(storage.data()[1023], 42u);
+}
+
+TEST(HugePageStorage, BigThingQueue) {
+  FixedSafeQueue<BigThing, 4096, HugePageStorage> q;
+  std::thread producer([&]() {
+    for (int i = 0; i < 10000; ++i) {
+      BigThing thing;
+      thing.data[0] = static_cast<char>(i);
+      q.Push(thing);
+    }
+  });
+  for (int i = 0; i < 10000; ++i)
+    EXPECT_EQ(q.PopWithGuard().first.data[0], static_cast<char>(i));
+  producer.join();
+}
@@ -0,0 +1,123 @@
+#include <rwols/IntrusiveSafeQueue.hpp>
+
+#include <gmock/gmock.h>
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace rwols;
+
+namespace {
+
+struct Msg {
+  int value = 0;
+  IntrusiveHook hook;
+  IntrusiveMpscHook mpscHook;
+};
+
+using Queue = IntrusiveSafeQueue<Msg, &Msg::hook>;
+using MpscQueue = IntrusiveMpscQueue<Msg, &Msg::mpscHook>;
+
+} // namespace
+
+TEST(IntrusiveSafeQueue, PushPop) {
+  Queue q;
+  Msg a, b;
+  a.value = 1;
+  b.value = 2;
+  q.Push(a);
+  q.Push(b);
+  EXPECT_EQ(&q.Pop(), &a);
+  EXPECT_EQ(&q.Pop(), &b);
+  EXPECT_EQ(q.TryPop(), nullptr);
+  q.TaskDone();
+  q.TaskDone();
+}
+
+TEST(IntrusiveSafeQueue, Timeout) {
+  Queue q;
+  EXPECT_THROW(q.Pop(std::chrono::milliseconds(10)), TimeoutError);
+}
+
+TEST(IntrusiveSafeQueue, TwoThreads) {
+  Queue q;
+  std::vector<Msg> msgs(100);
+  std::thread worker([&]() {
+    for (int i = 0; i < 100; ++i) {
+      EXPECT_EQ(q.Pop().value, i);
+      q.TaskDone();
+    }
+  });
+  for (int i = 0; i < 100; ++i) {
+    msgs[i].value = i;
+    q.Push(msgs[i]);
+  }
+  q.Join();
+  worker.join();
+}
+
+TEST(IntrusiveSafeQueue, OneNodeInBothKindsOfQueue) {
+  Queue q;
+  MpscQueue r;
+  Msg a;
+  q.Push(a);
+  r.Push(a);
+  EXPECT_EQ(&q.Pop(), &a);
+  EXPECT_EQ(&r.Pop(), &a);
+  q.TaskDone();
+  r.TaskDone();
+}
+
+TEST(IntrusiveMpscQueue, PushPop) {
+  MpscQueue q;
+  Msg a, b;
+  q.Push(a);
+  q.Push(b);
+  EXPECT_EQ(&q.Pop(), &a);
+  EXPECT_EQ(&q.Pop(), &b);
+  EXPECT_EQ(q.TryPop(), nullptr);
+  // Nodes can be relinked as soon as they have been popped.
+  q.Push(a);
+  EXPECT_EQ(&q.Pop(), &a);
+  q.TaskDone();
+  q.TaskDone();
+  q.TaskDone();
+}
+
+TEST(IntrusiveMpscQueue, Timeout) {
+  MpscQueue q;
+  EXPECT_THROW(q.Pop(std::chrono::milliseconds(10)), TimeoutError);
+}
+
+TEST(IntrusiveMpscQueue, ManyProducers) {
+  constexpr int numProducers = 4;
+  constexpr int numItems = 10000;
+  MpscQueue q;
+  std::vector<std::unique_ptr<Msg[]>> msgs;
+  for (int p = 0; p < numProducers; ++p)
+    msgs.emplace_back(new Msg[numItems]);
+  std::thread consumer([&]() {
+    std::vector<int> expected(numProducers, 0);
+    for (int i = 0; i < numProducers * numItems; ++i) {
+      auto &msg = q.Pop();
+      const int producer = msg.value / numItems;
+      // Items of one producer arrive in the order they were pushed.
+      EXPECT_EQ(msg.value % numItems, expected[producer]++);
+      q.TaskDone();
+    }
+  });
+  std::vector<std::thread> producers;
+  for (int p = 0; p < numProducers; ++p) {
+    producers.emplace_back([&, p]() {
+      for (int i = 0; i < numItems; ++i) {
+        msgs[p][i].value = p * numItems + i;
+        q.Push(msgs[p][i]);
+      }
+    });
+  }
+  for (auto &producer : producers)
+    producer.join();
+  q.Join();
+  consumer.join();
+}
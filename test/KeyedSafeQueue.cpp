@@ -0,0 +1,108 @@
+#include <rwols/KeyedSafeQueue.hpp>
+
+#include <gmock/gmock.h>
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace rwols;
+
+TEST(KeyedSafeQueue, ItemsOfOneKeyComeInOrder) {
+  KeyedSafeQueue<std::string, int> q;
+  q.Push("a", 1);
+  q.Push("a", 2);
+  EXPECT_EQ(q.Size(), 2u);
+  EXPECT_EQ(q.PopWithGuard().first, std::make_pair(std::string("a"), 1));
+  EXPECT_EQ(q.PopWithGuard().first, std::make_pair(std::string("a"), 2));
+  EXPECT_EQ(q.Size(), 0u);
+}
+
+TEST(KeyedSafeQueue, HeldKeyIsNotPoppedAgain) {
+  KeyedSafeQueue<int, int> q;
+  q.Push(1, 10);
+  q.Push(1, 11);
+  {
+    auto held = q.PopWithGuard();
+    EXPECT_EQ(held.first.second, 10);
+    EXPECT_THROW(q.Pop(std::chrono::milliseconds(10)), TimeoutError);
+    q.Push(2, 20); // Another key is not held up.
+    EXPECT_EQ(q.PopWithGuard().first.second, 20);
+  }
+  EXPECT_EQ(q.PopWithGuard(std::chrono::milliseconds(10)).first.second, 11);
+}
+
+TEST(KeyedSafeQueue, ReleasedKeyGoesToTheBack) {
+  KeyedSafeQueue<int, int> q;
+  q.Push(1, 10);
+  q.Push(1, 11);
+  q.Push(2, 20);
+  q.Push(3, 30);
+  std::vector<int> order;
+  for (int i = 0; i < 4; ++i)
+    order.push_back(q.PopWithGuard().first.second);
+  EXPECT_THAT(order, ::testing::ElementsAre(10, 20, 30, 11));
+}
+
+TEST(KeyedSafeQueue, JoinWaitsForAllKeys) {
+  KeyedSafeQueue<int, int> q;
+  for (int i = 0; i < 100; ++i)
+    q.Push(i % 5, i);
+  std::atomic<int> done(0);
+  std::vector<std::thread> consumers;
+  for (int i = 0; i < 4; ++i)
+    consumers.emplace_back([&]() {
+      try {
+        while (true) {
+          auto item = q.Pop(std::chrono::milliseconds(50));
+          ++done;
+          q.TaskDone(item.first);
+        }
+      } catch (const TimeoutError &) {
+      }
+    });
+  q.Join();
+  for (auto &consumer : consumers)
+    consumer.join();
+  EXPECT_EQ(done, 100);
+  EXPECT_EQ(q.Size(), 0u);
+}
+
+TEST(KeyedSafeQueue, ParallelConsumersKeepPerKeyOrder) {
+  const int keys = 8, perKey = 2000, consumers = 4;
+  KeyedSafeQueue<int, int> q;
+  std::vector<std::atomic<int>> last(keys);
+  std::vector<std::atomic<int>> busy(keys);
+  for (int k = 0; k < keys; ++k) {
+    last[k] = -1;
+    busy[k] = 0;
+  }
+  std::atomic<bool> ok(true);
+  std::vector<std::thread> threads;
+  for (int c = 0; c < consumers; ++c)
+    threads.emplace_back([&]() {
+      while (true) {
+        auto pair = q.PopWithGuard();
+        const int key = pair.first.first, value = pair.first.second;
+        if (value < 0)
+          return;
+        if (busy[key]++ != 0 || last[key] != value - 1)
+          ok = false;
+        last[key] = value;
+        --busy[key];
+      }
+    });
+  for (int i = 0; i < perKey; ++i)
+    for (int k = 0; k < keys; ++k)
+      q.Push(k, i);
+  q.Join();
+  for (int c = 0; c < consumers; ++c)
+    q.Push(c, -1);
+  for (auto &thread : threads)
+    thread.join();
+  EXPECT_TRUE(ok);
+  for (int k = 0; k < keys; ++k)
+    EXPECT_EQ(last[k], perKey - 1);
+}
@@ -0,0 +1,84 @@
+///\file    LatencyHistogram.hpp
+///\brief   HDR-style log-linear histogram for the benchmarks
+///\author  Raoul Wols
+///\date    October, 2026
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+namespace rwols {
+
+/// Buckets values by their most significant bit and then splits each of those
+/// ranges into 2^kSubBits linear sub-buckets. That keeps the relative error
+/// below 1 / 2^kSubBits over the full 64-bit range, with a fixed 16 KiB of
+/// counters and O(1) Record().
+class LatencyHistogram final {
+public:
+  void Record(std::uint64_t value) noexcept {
+    ++mCounts[Index(value)];
+    ++mTotal;
+    mMax = std::max(mMax, value);
+  }
+
+  void Merge(const LatencyHistogram &other) noexcept {
+    for (std::size_t i = 0; i < mCounts.size(); ++i)
+      mCounts[i] += other.mCounts[i];
+    mTotal += other.mTotal;
+    mMax = std::max(mMax, other.mMax);
+  }
+
+  std::uint64_t Count() const noexcept { return mTotal; }
+  std::uint64_t Max() const noexcept { return mMax; }
+
+  /// Returns the upper bound of the bucket holding the given percentile,
+  /// with percentile in [0, 100].
+  std::uint64_t Percentile(double percentile) const noexcept {
+    if (mTotal == 0)
+      return 0;
+    auto rank = static_cast<std::uint64_t>(percentile / 100.0 * mTotal);
+    rank = std::max<std::uint64_t>(1, std::min(rank, mTotal));
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < mCounts.size(); ++i) {
+      seen += mCounts[i];
+      if (seen >= rank)
+        return std::min(UpperBound(i), mMax);
+    }
+    return mMax;
+  }
+
+private:
+  static constexpr int kSubBits = 5;
+  static constexpr std::uint64_t kSubCount = 1u << kSubBits;
+
+  std::array<std::uint64_t, 64 * kSubCount> mCounts{};
+  std::uint64_t mTotal = 0;
+  std::uint64_t mMax = 0;
+
+  static int MostSignificantBit(std::uint64_t value) noexcept {
+    int msb = 0;
+    while (value >>= 1)
+      ++msb;
+    return msb;
+  }
+
+  static std::size_t Index(std::uint64_t value) noexcept {
+    if (value < kSubCount)
+      return static_cast<std::size_t>(value);
+    const int shift = MostSignificantBit(value) - kSubBits;
+    const auto sub = (value >> shift) - kSubCount;
+    return static_cast<std::size_t>((shift + 1) * kSubCount + sub);
+  }
+
+  static std::uint64_t UpperBound(std::size_t index) noexcept {
+    if (index < kSubCount)
+      return index;
+    const auto shift = index / kSubCount - 1;
+    const auto sub = index % kSubCount + kSubCount;
+    return ((sub + 1) << shift) - 1;
+  }
+};
+
+} // namespace rwols
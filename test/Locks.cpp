@@ -0,0 +1,86 @@
+#include <rwols/Locks.hpp>
+#include <rwols/SafeQueue.hpp>
+
+#include <gmock/gmock.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace rwols;
+
+template <class Lock> class Locks : public ::testing::Test {};
+using LockTypes = ::testing::Types<SpinLock, TicketLock, ClhLock>;
+TYPED_TEST_CASE(Locks, LockTypes);
+
+TYPED_TEST(Locks, MutualExclusion) {
+  TypeParam lock;
+  long counter = 0;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t)
+    threads.emplace_back([&]() {
+      for (int i = 0; i < 20000; ++i) {
+        std::lock_guard<TypeParam> guard(lock);
+        ++counter;
+      }
+    });
+  for (auto &thread : threads)
+    thread.join();
+  EXPECT_EQ(counter, 80000);
+}
+
+TYPED_TEST(Locks, SeveralLocksAtOnce) {
+  TypeParam a, b;
+  for (int i = 0; i < 100; ++i) {
+    std::lock_guard<TypeParam> first(a);
+    std::lock_guard<TypeParam> second(b);
+  }
+}
+
+TYPED_TEST(Locks, GuardsSafeQueue) {
+  SafeQueue<int, std::deque<int>, BasicSync<TypeParam, FutexCondition>> q;
+  std::atomic<long> sum(0);
+  std::vector<std::thread> consumers;
+  for (int c = 0; c < 3; ++c)
+    consumers.emplace_back([&]() {
+      while (true) {
+        auto pair = q.PopWithGuard();
+        if (pair.first < 0)
+          return;
+        sum += pair.first;
+      }
+    });
+  std::vector<std::thread> producers;
+  for (int p = 0; p < 3; ++p)
+    producers.emplace_back([&]() {
+      for (int i = 1; i <= 5000; ++i)
+        q.Push(i);
+    });
+  for (auto &producer : producers)
+    producer.join();
+  q.Join();
+  for (int c = 0; c < 3; ++c)
+    q.Push(-1);
+  for (auto &consumer : consumers)
+    consumer.join();
+  EXPECT_EQ(sum, 3L * 5000 * 5001 / 2);
+}
+
+TEST(SpinLock, TryLock) {
+  SpinLock lock;
+  EXPECT_TRUE(lock.try_lock());
+  EXPECT_FALSE(lock.try_lock());
+  lock.unlock();
+  EXPECT_TRUE(lock.try_lock());
+  lock.unlock();
+}
+
+TEST(TicketLock, TryLock) {
+  TicketLock lock;
+  EXPECT_TRUE(lock.try_lock());
+  EXPECT_FALSE(lock.try_lock());
+  lock.unlock();
+  EXPECT_TRUE(lock.try_lock());
+  lock.unlock();
+}
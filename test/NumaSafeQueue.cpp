@@ -0,0 +1,105 @@
+#include <rwols/NumaSafeQueue.hpp>
+
+#include <gmock/gmock.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace rwols;
+
+TEST(NumaSafeQueue, Topology) {
+  EXPECT_GE(NumaNodeCount(), 1u);
+  EXPECT_LT(CurrentNumaNode(), NumaNodeCount());
+}
+
+TEST(NumaSafeQueue, PushPop) {
+  NumaSafeQueue<int> q;
+  q.Push(42);
+  EXPECT_EQ(q.PopWithGuard().first, 42);
+}
+
+TEST(NumaSafeQueue, LocalLaneFirst) {
+  NumaSafeQueue<int> q(2);
+  EXPECT_EQ(q.Nodes(), 2u);
+  q.EmplaceOnNode(0, 1);
+  q.EmplaceOnNode(1, 2);
+  q.EmplaceOnNode(0, 3);
+  EXPECT_EQ(q.PopOnNode(1), 2);
+  // Node 1 is drained, so it falls back to node 0.
+  EXPECT_EQ(q.PopOnNode(1), 1);
+  EXPECT_EQ(q.PopOnNode(0), 3);
+  for (int i = 0; i < 3; ++i)
+    q.TaskDone();
+}
+
+TEST(NumaSafeQueue, NoDefaultConstructor) {
+  struct Item {
+    explicit Item(int value) : value(value) {}
+    int value;
+  };
+  NumaSafeQueue<Item> q(2);
+  q.EmplaceOnNode(1, 1);
+  q.EmplaceOnNode(1, 2);
+  EXPECT_EQ(q.PopOnNode(0).value, 1);
+  EXPECT_EQ(q.Pop(std::chrono::milliseconds(10)).value, 2);
+  q.TaskDone();
+  q.TaskDone();
+}
+
+TEST(NumaSafeQueue, ThrowingEmplace) {
+  struct Item {
+    explicit Item(int value) : value(value) {
+      if (value < 0)
+        throw std::invalid_argument("negative");
+    }
+    int value;
+  };
+  NumaSafeQueue<Item> q(2);
+  EXPECT_THROW(q.EmplaceOnNode(0, -1), std::invalid_argument);
+  // Nothing was counted, so a consumer times out and Join() returns.
+  EXPECT_THROW(q.Pop(std::chrono::milliseconds(10)), TimeoutError);
+  q.Join();
+}
+
+TEST(NumaSafeQueue, Timeout) {
+  NumaSafeQueue<int> q(2);
+  EXPECT_THROW(q.Pop(std::chrono::milliseconds(10)), TimeoutError);
+}
+
+TEST(NumaSafeQueue, GlobalJoin) {
+  constexpr int numNodes = 4;
+  constexpr int numItems = 1000;
+  NumaSafeQueue<int> q(numNodes);
+  std::atomic<long> sum{0};
+  std::vector<std::thread> consumers;
+  for (int node = 0; node < numNodes; ++node) {
+    consumers.emplace_back([&, node]() {
+      while (true) {
+        auto item = q.PopOnNode(node);
+        if (item < 0) {
+          q.TaskDone();
+          break;
+        }
+        sum += item;
+        q.TaskDone();
+      }
+    });
+  }
+  std::vector<std::thread> producers;
+  for (int node = 0; node < numNodes; ++node) {
+    producers.emplace_back([&, node]() {
+      for (int i = 0; i < numItems; ++i)
+        q.EmplaceOnNode(node, i);
+    });
+  }
+  for (auto &producer : producers)
+    producer.join();
+  q.Join();
+  EXPECT_EQ(sum, numNodes * (numItems * (numItems - 1L) / 2));
+  for (int node = 0; node < numNodes; ++node)
+    q.EmplaceOnNode(node, -1);
+  for (auto &consumer : consumers)
+    consumer.join();
+}
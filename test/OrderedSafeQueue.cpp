@@ -0,0 +1,115 @@
+#include <rwols/OrderedSafeQueue.hpp>
+
+#include <gmock/gmock.h>
+
+#include <atomic>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace rwols;
+
+TEST(OrderedSafeQueue, ReleasesInSequence) {
+  std::vector<int> released;
+  OrderedSafeQueue<int> q(8, [&](int &&r) { released.push_back(r); });
+  for (int i = 0; i < 4; ++i)
+    q.Push(i);
+  std::vector<std::pair<std::uint64_t, int>> popped;
+  for (int i = 0; i < 4; ++i)
+    popped.push_back(q.Pop());
+  q.Complete(popped[2].first, popped[2].second * 10);
+  q.Complete(popped[1].first, popped[1].second * 10);
+  EXPECT_TRUE(released.empty());
+  q.Complete(popped[0].first, popped[0].second * 10);
+  EXPECT_EQ(released, (std::vector<int>{0, 10, 20}));
+  q.Complete(popped[3].first, popped[3].second * 10);
+  EXPECT_EQ(released, (std::vector<int>{0, 10, 20, 30}));
+  q.Join();
+}
+
+TEST(OrderedSafeQueue, SkipLeavesAGap) {
+  std::vector<std::string> released;
+  OrderedSafeQueue<int, std::string> q(
+      4, [&](std::string &&r) { released.push_back(std::move(r)); });
+  q.Push(1);
+  q.Push(2);
+  const auto first = q.Pop();
+  const auto second = q.Pop();
+  q.Complete(second.first, "two");
+  q.Skip(first.first);
+  EXPECT_EQ(released, std::vector<std::string>{"two"});
+}
+
+TEST(OrderedSafeQueue, FailedReleaseStillReleasesTheRest) {
+  std::vector<int> released;
+  OrderedSafeQueue<int> q(4, [&](int &&r) {
+    if (r == 0)
+      throw std::runtime_error("release failed");
+    released.push_back(r);
+  });
+  q.Push(0);
+  q.Push(1);
+  const auto first = q.Pop();
+  const auto second = q.Pop();
+  q.Complete(second.first, 1);
+  // The failing item is the last one outstanding: item 1 waits on it.
+  EXPECT_THROW(q.Complete(first.first, 0), std::runtime_error);
+  EXPECT_EQ(released, std::vector<int>{1});
+  q.Join();
+}
+
+TEST(OrderedSafeQueue, WindowBlocksPush) {
+  OrderedSafeQueue<int> q(2, [](int &&) {});
+  q.Push(1);
+  q.Push(2);
+  std::atomic<bool> pushed{false};
+  std::thread producer([&]() {
+    q.Push(3);
+    pushed = true;
+  });
+  const auto first = q.Pop();
+  const auto second = q.Pop();
+  q.Complete(second.first, 0);
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_FALSE(pushed); // The oldest item still holds the window.
+  q.Complete(first.first, 0);
+  producer.join();
+  const auto third = q.Pop();
+  q.Complete(third.first, 0);
+}
+
+TEST(OrderedSafeQueue, ParallelWorkersKeepOrder) {
+  std::vector<int> released;
+  OrderedSafeQueue<int> q(16, [&](int &&r) { released.push_back(r); });
+  std::vector<std::thread> workers;
+  for (int w = 0; w < 4; ++w)
+    workers.emplace_back([&q, w]() {
+      std::minstd_rand random(static_cast<unsigned>(w));
+      while (true) {
+        auto item = q.Pop();
+        if (item.second < 0) {
+          q.Skip(item.first);
+          return;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(random() % 50));
+        q.Complete(item.first, item.second * 2);
+      }
+    });
+  for (int i = 0; i < 1000; ++i)
+    q.Push(i);
+  for (int w = 0; w < 4; ++w)
+    q.Push(-1);
+  for (auto &worker : workers)
+    worker.join();
+  q.Join();
+  ASSERT_EQ(released.size(), 1000u);
+  for (int i = 0; i < 1000; ++i)
+    EXPECT_EQ(released[static_cast<std::size_t>(i)], i * 2);
+}
+
+TEST(OrderedSafeQueue, PopTimeout) {
+  OrderedSafeQueue<int> q(2, [](int &&) {});
+  EXPECT_THROW(q.Pop(std::chrono::milliseconds(10)), TimeoutError);
+}
@@ -0,0 +1,152 @@
+#include <rwols/Pipeline.hpp>
+
+#include <gmock/gmock.h>
+
+#include <atomic>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace rwols;
+
+TEST(Pipeline, SingleStage) {
+  std::atomic<int> sum{0};
+  auto pipeline = MakePipeline<int>().Then([&](int x) { sum += x; }).Build();
+  for (int i = 1; i <= 100; ++i)
+    pipeline.Push(i);
+  pipeline.Join();
+  EXPECT_EQ(sum, 5050);
+}
+
+TEST(Pipeline, StagesChangeTheType) {
+  std::mutex mutex;
+  std::multiset<std::string> seen;
+  auto pipeline = MakePipeline<int>()
+                      .Then([](int x) { return x * 2; }, 2)
+                      .Then([](int x) { return std::to_string(x); }, 3)
+                      .Then(
+                          [&](std::string s) {
+                            std::lock_guard<std::mutex> lock(mutex);
+                            seen.insert(std::move(s));
+                          },
+                          1)
+                      .Build();
+  EXPECT_EQ(pipeline.Stages(), 3u);
+  for (int i = 0; i < 10; ++i)
+    pipeline.Push(i);
+  pipeline.Join();
+  EXPECT_EQ(seen.size(), 10u);
+  EXPECT_EQ(seen.count("18"), 1u);
+}
+
+TEST(Pipeline, EqualThreadCountsAreFused) {
+  std::mutex mutex;
+  std::set<std::thread::id> first, second;
+  auto pipeline = MakePipeline<int>()
+                      .Then(
+                          [&](int x) {
+                            std::lock_guard<std::mutex> lock(mutex);
+                            first.insert(std::this_thread::get_id());
+                            return x;
+                          },
+                          2)
+                      .Then(
+                          [&](int) {
+                            std::lock_guard<std::mutex> lock(mutex);
+                            second.insert(std::this_thread::get_id());
+                          },
+                          2)
+                      .Build();
+  EXPECT_EQ(pipeline.Stages(), 1u);
+  for (int i = 0; i < 100; ++i)
+    pipeline.Push(i);
+  pipeline.Join();
+  for (const auto &id : second)
+    EXPECT_EQ(first.count(id), 1u);
+}
+
+TEST(Pipeline, ExplicitQueueKindPreventsFusion) {
+  std::atomic<int> count{0};
+  auto pipeline = MakePipeline<int>()
+                      .Then([](int x) { return x; }, 1)
+                      .Then<Bounded<4>>([](int x) { return x; }, 1)
+                      .Then<Unbounded>([&](int) { ++count; }, 1)
+                      .Build();
+  EXPECT_EQ(pipeline.Stages(), 3u);
+  for (int i = 0; i < 100; ++i)
+    pipeline.Push(i);
+  pipeline.Join();
+  EXPECT_EQ(count, 100);
+}
+
+TEST(Pipeline, SingleProducerStagesKeepOrder) {
+  std::vector<int> seen;
+  auto pipeline = MakePipeline<int>()
+                      .Then<SingleProducer<4>>([](int x) { return x + 1; })
+                      .Then<SingleProducer<2>>(
+                          [&](int x) { seen.push_back(x); })
+                      .Build();
+  EXPECT_EQ(pipeline.Stages(), 2u);
+  for (int i = 0; i < 1000; ++i)
+    pipeline.Push(i);
+  pipeline.Join();
+  ASSERT_EQ(seen.size(), 1000u);
+  for (int i = 0; i < 1000; ++i)
+    EXPECT_EQ(seen[i], i + 1);
+}
+
+TEST(Pipeline, SingleProducerNeedsOneThreadOnEachSide) {
+  auto twoThreads = [](int) {};
+  EXPECT_THROW(MakePipeline<int>().Then<SingleProducer<4>>(twoThreads, 2),
+               std::invalid_argument);
+  EXPECT_THROW(MakePipeline<int>()
+                   .Then([](int x) { return x; }, 2)
+                   .Then<SingleProducer<4>>([](int) {}),
+               std::invalid_argument);
+}
+
+TEST(Pipeline, SingleProducerFirstStageRejectsSecondPusher) {
+  std::atomic<int> count(0);
+  auto pipeline = MakePipeline<int>()
+                      .Then<SingleProducer<4>>([&](int) { ++count; })
+                      .Build();
+  pipeline.Push(1);
+  std::thread other(
+      [&]() { EXPECT_THROW(pipeline.Push(2), std::logic_error); });
+  other.join();
+  pipeline.Push(3);
+  pipeline.Join();
+  EXPECT_EQ(count, 2);
+}
+
+TEST(Pipeline, JoinRethrowsStageException) {
+  std::atomic<int> count{0};
+  auto pipeline = MakePipeline<int>()
+                      .Then([](int x) {
+                        if (x == 3)
+                          throw std::runtime_error("three");
+                        return x;
+                      })
+                      .Then([&](int) { ++count; }, 2)
+                      .Build();
+  for (int i = 0; i < 10; ++i)
+    pipeline.Push(i);
+  EXPECT_THROW(pipeline.Join(), std::runtime_error);
+  EXPECT_EQ(count, 9);
+  pipeline.Join();
+}
+
+TEST(Pipeline, DestructionDrainsTheQueues) {
+  std::atomic<int> count{0};
+  {
+    auto pipeline = MakePipeline<int>()
+                        .Then([](int x) { return x + 1; }, 2)
+                        .Then([&](int) { ++count; }, 1)
+                        .Build();
+    for (int i = 0; i < 100; ++i)
+      pipeline.Push(i);
+  }
+  EXPECT_EQ(count, 100);
+}
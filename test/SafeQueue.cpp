@@ -2,9 +2,12 @@
 
 #include <gmock/gmock.h>
 
+#include <atomic>
 #include <iostream>
 #include <memory>
+#include <stdexcept>
 #include <thread>
+#include <vector>
 
 #define sqPRINT std::cerr << "[++++++++++] "
 
@@ -82,6 +85,26 @@ TEST(SafeQueue, TaskDoneGuard) {
   worker.join();
 }
 
+TEST(SafeQueue, TimedOutPopWithGuardFinishesNothing) {
+  SafeQueue<int> q;
+  q.Push(1);
+  std::atomic<bool> joined{false};
+  std::thread joiner;
+  {
+    auto held = q.PopWithGuard();
+    EXPECT_THROW(q.PopWithGuard(std::chrono::milliseconds(10)),
+                 TimeoutError);
+    joiner = std::thread([&]() {
+      q.Join();
+      joined = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_FALSE(joined); // The held item is not done yet.
+  }
+  joiner.join();
+  EXPECT_TRUE(joined);
+}
+
 TEST(SafeQueue, MoveOnlyType) {
   struct Foo {
     Foo() = default;
@@ -193,3 +216,301 @@ TEST(SafeQueue, Stress) {
   for (auto &producer : producers)
     producer.join();
 }
+
+TEST(SafeQueue, ProducerHandleBatches) {
+  SafeQueue<int> q;
+  auto producer = q.MakeProducer(3);
+  producer.Push(1);
+  producer.Push(2);
+  EXPECT_TRUE(q.Empty());
+  producer.Push(3);
+  EXPECT_EQ(q.Size(), 3u);
+  for (int i = 1; i <= 3; ++i)
+    EXPECT_EQ(q.PopWithGuard().first, i);
+  producer.Push(4);
+  producer.Flush();
+  EXPECT_EQ(q.PopWithGuard().first, 4);
+}
+
+TEST(SafeQueue, ProducerHandleThrowingConstructorReservesNothing) {
+  struct Item {
+    explicit Item(bool fail) {
+      if (fail)
+        throw std::runtime_error("construction failed");
+    }
+  };
+  SafeQueue<Item> q;
+  {
+    auto producer = q.MakeProducer(100);
+    EXPECT_THROW(producer.Emplace(true), std::runtime_error);
+  }
+  q.Join(); // Would hang on a task reserved for the failed item.
+  {
+    auto producer = q.MakeProducer(100);
+    producer.Emplace(false);
+    EXPECT_THROW(producer.Emplace(true), std::runtime_error);
+  }
+  q.PopWithGuard();
+  q.Join();
+}
+
+TEST(SafeQueue, ProducerHandleJoinSeesBufferedItems) {
+  SafeQueue<int> q;
+  std::atomic<bool> joined{false};
+  auto producer = q.MakeProducer(100);
+  producer.Push(42);
+  std::thread joiner([&]() {
+    q.Join();
+    joined = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(joined);
+  producer.Flush();
+  EXPECT_EQ(q.PopWithGuard().first, 42);
+  joiner.join();
+  EXPECT_TRUE(joined);
+}
+
+TEST(SafeQueue, ProducerHandleMaxDelay) {
+  SafeQueue<int> q;
+  auto producer = q.MakeProducer(100, std::chrono::milliseconds(20));
+  producer.Push(1);
+  EXPECT_TRUE(q.Empty());
+  std::this_thread::sleep_for(std::chrono::milliseconds(30));
+  producer.Push(2);
+  EXPECT_EQ(q.Size(), 2u);
+  q.PopWithGuard();
+  q.PopWithGuard();
+}
+
+TEST(SafeQueue, ProducerHandleMaxDelayIdleProducer) {
+  SafeQueue<int> q;
+  auto producer = q.MakeProducer(100, std::chrono::milliseconds(20));
+  producer.Push(1);
+  // Buffered before the consumer waits: the waiting Pop() flushes it.
+  EXPECT_EQ(q.Pop(std::chrono::seconds(5)), 1);
+  std::thread consumer(
+      [&]() { EXPECT_EQ(q.Pop(std::chrono::seconds(5)), 2); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  // Pushed while the consumer waits: not buffered at all.
+  producer.Push(2);
+  consumer.join();
+  q.TaskDone();
+  q.TaskDone();
+}
+
+TEST(SafeQueue, JoinFlushesPartialBatches) {
+  SafeQueue<int> q;
+  auto producer = q.MakeProducer(100);
+  producer.Push(1);
+  std::thread consumer([&]() {
+    {
+      auto first = q.PopWithGuard();
+      EXPECT_EQ(first.first, 1);
+      // Keep the joiner waiting while the second item is pushed.
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    EXPECT_EQ(q.PopWithGuard().first, 2);
+  });
+  std::thread joiner([&]() { q.Join(); });
+  // The joiner waits by now, so this push is not buffered.
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  producer.Push(2);
+  joiner.join(); // Would hang on the items that sat in the batch.
+  consumer.join();
+}
+
+TEST(SafeQueue, ProducerHandleManyProducers) {
+  constexpr int numProducers = 4;
+  constexpr int numItems = 1000;
+  SafeQueue<int> q;
+  std::thread consumer([&]() {
+    long sum = 0;
+    for (int i = 0; i < numProducers * numItems; ++i)
+      sum += q.PopWithGuard().first;
+    EXPECT_EQ(sum, numProducers * (numItems * (numItems - 1L) / 2));
+  });
+  std::vector<std::thread> producers;
+  for (int p = 0; p < numProducers; ++p) {
+    producers.emplace_back([&]() {
+      auto handle = q.MakeProducer(16);
+      for (int i = 0; i < numItems; ++i)
+        handle.Push(i);
+    });
+  }
+  for (auto &producer : producers)
+    producer.join();
+  q.Join();
+  consumer.join();
+}
+
+TEST(SafeQueue, ConsumerHandleTakesABatch) {
+  SafeQueue<int> q;
+  for (int i = 0; i < 10; ++i)
+    q.Push(i);
+  {
+    auto consumer = q.MakeConsumer(4);
+    EXPECT_EQ(consumer.PopWithGuard().first, 0);
+    // The rest of the batch is served locally.
+    EXPECT_EQ(q.Size(), 6u);
+    for (int i = 1; i < 4; ++i)
+      EXPECT_EQ(consumer.PopWithGuard().first, i);
+    EXPECT_EQ(consumer.PopWithGuard().first, 4);
+    EXPECT_EQ(q.Size(), 2u);
+  }
+  // Items left in the handle's buffer were handed back.
+  EXPECT_EQ(q.Size(), 5u);
+  for (int i = 0; i < 5; ++i)
+    q.PopWithGuard();
+}
+
+TEST(SafeQueue, ConsumerHandleReleaseKeepsFifoOrder) {
+  SafeQueue<int> q;
+  for (int i = 0; i < 4; ++i)
+    q.Push(i);
+  {
+    auto consumer = q.MakeConsumer(4);
+    EXPECT_EQ(consumer.PopWithGuard().first, 0);
+    q.Push(4); // Pushed while 1, 2 and 3 sit in the handle's buffer.
+  }
+  for (int i = 1; i <= 4; ++i)
+    EXPECT_EQ(q.PopWithGuard().first, i);
+}
+
+TEST(SafeQueue, ConsumerHandleDoesNotHoardAtLowLoad) {
+  SafeQueue<int> q;
+  auto consumer = q.MakeConsumer(16);
+  q.Push(1);
+  EXPECT_EQ(consumer.PopWithGuard().first, 1);
+  EXPECT_THROW(consumer.Pop(std::chrono::milliseconds(10)), TimeoutError);
+}
+
+TEST(SafeQueue, ConsumerHandleManyConsumers) {
+  constexpr int numConsumers = 4;
+  constexpr int numItems = 4000;
+  SafeQueue<int> q;
+  std::atomic<long> sum{0};
+  std::vector<std::thread> consumers;
+  for (int c = 0; c < numConsumers; ++c) {
+    consumers.emplace_back([&]() {
+      auto consumer = q.MakeConsumer(32);
+      while (true) {
+        auto pair = consumer.PopWithGuard();
+        if (pair.first < 0)
+          break;
+        sum += pair.first;
+      }
+    });
+  }
+  for (int i = 0; i < numItems; ++i)
+    q.Push(i);
+  q.Join();
+  for (int c = 0; c < numConsumers; ++c)
+    q.Push(-1);
+  for (auto &consumer : consumers)
+    consumer.join();
+  EXPECT_EQ(sum, numItems * (numItems - 1L) / 2);
+}
+
+TEST(SafeQueue, InFlightIsOffByDefault) {
+  SafeQueue<int> q;
+  q.Push(1);
+  q.Pop();
+  EXPECT_EQ(q.InFlightCount(), 0u);
+  EXPECT_TRUE(q.InFlight(std::chrono::seconds(0)).empty());
+  q.TaskDone();
+}
+
+TEST(SafeQueue, InFlightTracksGuardedPops) {
+  SafeQueue<int> q;
+  q.TrackInFlight();
+  q.Push(1);
+  q.Push(2);
+  q.Push(3);
+  {
+    auto second = [&]() {
+      auto first = q.PopWithGuard();
+      auto second = q.PopWithGuard(std::chrono::seconds(1));
+      const auto tasks = q.InFlight(std::chrono::seconds(0));
+      EXPECT_EQ(tasks.size(), 2u);
+      EXPECT_LT(tasks[0].ticket, tasks[1].ticket);
+      EXPECT_EQ(tasks[0].consumer, std::this_thread::get_id());
+      EXPECT_LE(tasks[0].popped, tasks[1].popped);
+      EXPECT_TRUE(q.InFlight(std::chrono::hours(1)).empty());
+      return second;
+    }(); // Finishes the first item.
+    const auto left = q.InFlight(std::chrono::seconds(0));
+    ASSERT_EQ(left.size(), 1u);
+    EXPECT_EQ(left[0].ticket, 2u);
+  }
+  EXPECT_EQ(q.InFlightCount(), 0u);
+  q.PopWithGuard();
+}
+
+TEST(SafeQueue, InFlightTracksPlainPops) {
+  SafeQueue<int> q;
+  q.TrackInFlight();
+  q.Push(1);
+  q.Push(2);
+  q.Pop();
+  auto pair = q.PopWithGuard();
+  EXPECT_EQ(q.InFlightCount(), 2u);
+  q.TaskDone(); // Finishes the plain Pop(), not the guarded item.
+  const auto left = q.InFlight(std::chrono::seconds(0));
+  ASSERT_EQ(left.size(), 1u);
+  EXPECT_EQ(left[0].ticket, 2u);
+}
+
+TEST(SafeQueue, UntrackedCountsItemsPoppedBeforeTracking) {
+  SafeQueue<int> q;
+  q.Push(1);
+  q.Push(2);
+  q.Pop();
+  q.TrackInFlight();
+  EXPECT_EQ(q.UntrackedCount(), 1u); // Item 2 is still queued.
+  q.TaskDone();
+  EXPECT_EQ(q.UntrackedCount(), 0u);
+  q.PopWithGuard();
+}
+
+TEST(SafeQueue, InFlightIgnoresProducerTaskDone) {
+  SafeQueue<int> q;
+  q.TrackInFlight();
+  q.Push(1);
+  q.Push(2);
+  auto pair = q.PopWithGuard();
+  std::thread consumer([&]() { q.Pop(); });
+  consumer.join();
+  q.TaskDone(); // Finishes the plain Pop(), not the guarded item.
+  EXPECT_EQ(q.InFlightCount(), 1u);
+}
+
+TEST(SafeQueue, InFlightWithConsumerHandle) {
+  SafeQueue<int> q;
+  q.TrackInFlight();
+  for (int i = 0; i < 4; ++i)
+    q.Push(i);
+  std::uint64_t other;
+  {
+    auto consumer = q.MakeConsumer(3);
+    consumer.PopWithGuard(); // Takes 0, 1 and 2; finishes 0 right away.
+    EXPECT_EQ(q.InFlightCount(), 0u); // Buffered items are not in flight.
+    auto pair = q.PopWithGuard();     // Another consumer takes 3.
+    EXPECT_EQ(pair.first, 3);
+    {
+      auto held = consumer.PopWithGuard();
+      EXPECT_EQ(q.InFlightCount(), 2u);
+    }
+    const auto tasks = q.InFlight(std::chrono::seconds(0));
+    ASSERT_EQ(tasks.size(), 1u);
+    other = tasks[0].ticket;
+    // The handle returns item 2 while the other consumer still holds 3.
+    consumer = q.MakeConsumer(1);
+    const auto after = q.InFlight(std::chrono::seconds(0));
+    ASSERT_EQ(after.size(), 1u);
+    EXPECT_EQ(after[0].ticket, other);
+  }
+  EXPECT_EQ(q.InFlightCount(), 0u);
+  EXPECT_EQ(q.PopWithGuard().first, 2);
+  EXPECT_EQ(q.InFlightCount(), 0u);
+}
@@ -0,0 +1,83 @@
+#include <rwols/Select.hpp>
+
+#include <gmock/gmock.h>
+
+#include <string>
+#include <thread>
+
+using namespace rwols;
+
+TEST(Select, ReadyQueue) {
+  SafeQueue<int> control;
+  SafeQueue<std::string> data;
+  data.Push("hello");
+  EXPECT_EQ(WaitAny(control, data), 1u);
+  std::string item;
+  ASSERT_TRUE(data.TryPop(item));
+  EXPECT_EQ(item, "hello");
+  data.TaskDone();
+}
+
+TEST(Select, Priority) {
+  SafeQueue<int> control, data;
+  data.Push(1);
+  control.Push(2);
+  EXPECT_EQ(WaitAny(control, data), 0u);
+  EXPECT_EQ(WaitAny(data, control), 0u);
+  control.PopWithGuard();
+  data.PopWithGuard();
+}
+
+TEST(Select, Timeout) {
+  SafeQueue<int> a, b;
+  EXPECT_THROW(WaitAny(std::chrono::milliseconds(10), a, b), TimeoutError);
+}
+
+TEST(Select, WakesUpOnPush) {
+  SafeQueue<int> a, b, c;
+  Selector<SafeQueue<int>, SafeQueue<int>, SafeQueue<int>> selector(a, b, c);
+  std::thread producer([&]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    c.Push(42);
+  });
+  EXPECT_EQ(selector.Wait(), 2u);
+  int item = 0;
+  ASSERT_TRUE(c.TryPop(item));
+  EXPECT_EQ(item, 42);
+  c.TaskDone();
+  producer.join();
+}
+
+TEST(Select, Dispatcher) {
+  constexpr int numItems = 1000;
+  SafeQueue<bool> control;
+  SafeQueue<int> data1, data2;
+  std::thread producer([&]() {
+    for (int i = 0; i < numItems; ++i)
+      (i % 2 ? data1 : data2).Push(i);
+    data1.Join();
+    data2.Join();
+    control.Push(true);
+  });
+  int received = 0;
+  Selector<SafeQueue<bool>, SafeQueue<int>, SafeQueue<int>> selector(
+      control, data1, data2);
+  bool stop = false;
+  while (!stop) {
+    switch (selector.Wait()) {
+    case 0:
+      stop = control.PopWithGuard().first;
+      break;
+    case 1:
+      data1.PopWithGuard();
+      ++received;
+      break;
+    case 2:
+      data2.PopWithGuard();
+      ++received;
+      break;
+    }
+  }
+  EXPECT_EQ(received, numItems);
+  producer.join();
+}
@@ -0,0 +1,100 @@
+#include <rwols/SharedMemorySafeQueue.hpp>
+
+#include <gmock/gmock.h>
+
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace rwols;
+
+namespace {
+
+struct Message {
+  int id;
+  double value;
+};
+
+std::string UniqueName(const char *test) {
+  return std::string("/rwols-") + test + "-" + std::to_string(::getpid());
+}
+
+} // namespace
+
+TEST(SharedMemorySafeQueue, CreateAndOpen) {
+  const auto name = UniqueName("CreateAndOpen");
+  auto producer = SharedMemorySafeQueue<Message>::Create(name, 8);
+  auto consumer = SharedMemorySafeQueue<Message>::Open(name);
+  SharedMemorySafeQueue<Message>::Unlink(name);
+  EXPECT_EQ(consumer.capacity(), 8u);
+  producer.Push({1, 2.5});
+  auto pair = consumer.PopWithGuard();
+  EXPECT_EQ(pair.first.id, 1);
+  EXPECT_EQ(pair.first.value, 2.5);
+}
+
+TEST(SharedMemorySafeQueue, CreateTwiceFails) {
+  const auto name = UniqueName("CreateTwiceFails");
+  auto q = SharedMemorySafeQueue<int>::Create(name, 8);
+  EXPECT_THROW(SharedMemorySafeQueue<int>::Create(name, 8), std::system_error);
+  SharedMemorySafeQueue<int>::Unlink(name);
+}
+
+TEST(SharedMemorySafeQueue, OpenWrongType) {
+  const auto name = UniqueName("OpenWrongType");
+  auto q = SharedMemorySafeQueue<int>::Create(name, 8);
+  EXPECT_THROW(SharedMemorySafeQueue<Message>::Open(name), std::system_error);
+  SharedMemorySafeQueue<int>::Unlink(name);
+}
+
+TEST(SharedMemorySafeQueue, FullAndTimeout) {
+  auto q = SharedMemorySafeQueue<int>::Anonymous(2);
+  EXPECT_TRUE(q.TryPush(1));
+  EXPECT_TRUE(q.TryPush(2));
+  EXPECT_FALSE(q.TryPush(3));
+  EXPECT_EQ(q.PopWithGuard().first, 1);
+  EXPECT_EQ(q.PopWithGuard().first, 2);
+  EXPECT_THROW(q.Pop(std::chrono::milliseconds(10)), TimeoutError);
+}
+
+TEST(SharedMemorySafeQueue, ZeroCapacity) {
+  EXPECT_THROW(SharedMemorySafeQueue<int>::Anonymous(0), std::invalid_argument);
+  EXPECT_THROW(SharedMemorySafeQueue<int>::Create(UniqueName("ZeroCapacity"), 0),
+               std::invalid_argument);
+}
+
+TEST(SharedMemorySafeQueue, NoDefaultConstructor) {
+  struct Point {
+    Point(int x, int y) : x(x), y(y) {}
+    int x, y;
+  };
+  auto q = SharedMemorySafeQueue<Point>::Anonymous(2);
+  q.Push(Point(1, 2));
+  q.Push(Point(3, 4));
+  EXPECT_EQ(q.PopWithGuard().first.y, 2);
+  EXPECT_EQ(q.PopWithGuard(std::chrono::seconds(1)).first.x, 3);
+}
+
+TEST(SharedMemorySafeQueue, AcrossProcesses) {
+  constexpr int numItems = 10000;
+  auto q = SharedMemorySafeQueue<Message>::Anonymous(64);
+  const pid_t child = ::fork();
+  ASSERT_GE(child, 0);
+  if (child == 0) {
+    for (int i = 0; i < numItems; ++i)
+      q.Push({i, i * 0.5});
+    q.Join();
+    ::_exit(0);
+  }
+  for (int i = 0; i < numItems; ++i) {
+    auto pair = q.PopWithGuard();
+    EXPECT_EQ(pair.first.id, i);
+  }
+  int status = 0;
+  ASSERT_EQ(::waitpid(child, &status, 0), child);
+  EXPECT_TRUE(WIFEXITED(status));
+  EXPECT_EQ(WEXITSTATUS(status), 0);
+}
@@ -0,0 +1,190 @@
+#include <rwols/SpillingSafeQueue.hpp>
+
+#include <gmock/gmock.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace rwols;
+
+namespace {
+
+SpillOptions Small(std::size_t maxItems) {
+  SpillOptions options;
+  options.maxItems = maxItems;
+  options.fileBytes = 256;
+  options.writeBufferBytes = 64;
+  return options;
+}
+
+/// Fails to read back the item 5 while Fail() is set.
+struct FlakySerializer {
+  static bool &Fail() {
+    static bool fail = false;
+    return fail;
+  }
+  static void Serialize(int item, std::string &out) {
+    DefaultSerializer<int>::Serialize(item, out);
+  }
+  static int Deserialize(const char *data, std::size_t size) {
+    const int item = DefaultSerializer<int>::Deserialize(data, size);
+    if (item == 5 && Fail())
+      throw std::runtime_error("corrupt record");
+    return item;
+  }
+};
+
+/// Blocks reading back while Stall() is set, and says when it does.
+struct StallingSerializer {
+  static std::atomic<bool> &Stall() {
+    static std::atomic<bool> stall{false};
+    return stall;
+  }
+  static std::atomic<bool> &Stalled() {
+    static std::atomic<bool> stalled{false};
+    return stalled;
+  }
+  static void Serialize(int item, std::string &out) {
+    DefaultSerializer<int>::Serialize(item, out);
+  }
+  static int Deserialize(const char *data, std::size_t size) {
+    Stalled() = Stall().load();
+    while (Stall())
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    return DefaultSerializer<int>::Deserialize(data, size);
+  }
+};
+
+} // namespace
+
+TEST(SpillingSafeQueue, StaysInMemoryBelowBudget) {
+  SpillingSafeQueue<int> q(Small(4));
+  for (int i = 0; i < 4; ++i)
+    q.Push(i);
+  EXPECT_EQ(q.Spilled(), 0u);
+  for (int i = 0; i < 4; ++i)
+    EXPECT_EQ(q.PopWithGuard().first, i);
+}
+
+TEST(SpillingSafeQueue, KeepsOrderAcrossTiers) {
+  SpillingSafeQueue<int> q(Small(8));
+  for (int i = 0; i < 100; ++i)
+    q.Push(i);
+  EXPECT_EQ(q.Size(), 100u);
+  EXPECT_EQ(q.Spilled(), 92u);
+  for (int i = 0; i < 50; ++i)
+    EXPECT_EQ(q.PopWithGuard().first, i);
+  // New items go behind the spilled ones, even with room in memory.
+  for (int i = 100; i < 120; ++i)
+    q.Push(i);
+  for (int i = 50; i < 120; ++i)
+    EXPECT_EQ(q.PopWithGuard().first, i);
+  EXPECT_EQ(q.Size(), 0u);
+  EXPECT_THROW(q.Pop(std::chrono::milliseconds(10)), TimeoutError);
+}
+
+TEST(SpillingSafeQueue, PagesInBulk) {
+  SpillingSafeQueue<int> q(Small(10));
+  for (int i = 0; i < 40; ++i)
+    q.Push(i);
+  for (int i = 0; i < 11; ++i)
+    q.PopWithGuard();
+  // The eleventh pop paged in the next ten items at once.
+  EXPECT_EQ(q.Spilled(), 20u);
+  for (int i = 11; i < 40; ++i)
+    q.PopWithGuard();
+}
+
+TEST(SpillingSafeQueue, FailedPageInLeavesQueueIntact) {
+  SpillingSafeQueue<int, FlakySerializer> q(Small(4));
+  for (int i = 0; i < 60; ++i)
+    q.Push(i);
+  for (int i = 0; i < 4; ++i)
+    EXPECT_EQ(q.PopWithGuard().first, i);
+  FlakySerializer::Fail() = true;
+  EXPECT_THROW(q.Pop(), std::runtime_error);
+  EXPECT_EQ(q.Size(), 56u);
+  EXPECT_EQ(q.Spilled(), 56u);
+  FlakySerializer::Fail() = false;
+  for (int i = 4; i < 60; ++i)
+    EXPECT_EQ(q.PopWithGuard().first, i);
+  EXPECT_EQ(q.Size(), 0u);
+}
+
+TEST(SpillingSafeQueue, PagesInWithoutTheLock) {
+  SpillingSafeQueue<int, StallingSerializer> q(Small(4));
+  for (int i = 0; i < 20; ++i)
+    q.Push(i);
+  for (int i = 0; i < 4; ++i)
+    q.PopWithGuard();
+  StallingSerializer::Stall() = true;
+  std::thread consumer([&q]() { EXPECT_EQ(q.PopWithGuard().first, 4); });
+  while (!StallingSerializer::Stalled())
+    std::this_thread::yield();
+  // The consumer is in the middle of paging in; the queue is still usable.
+  q.Push(20);
+  EXPECT_EQ(q.Size(), 17u);
+  StallingSerializer::Stall() = false;
+  consumer.join();
+  for (int i = 5; i <= 20; ++i)
+    EXPECT_EQ(q.PopWithGuard().first, i);
+}
+
+TEST(SpillingSafeQueue, ByteBudget) {
+  auto options = Small(1000);
+  options.maxBytes = 10;
+  SpillingSafeQueue<std::string> q(
+      options, [](const std::string &s) { return s.size(); });
+  q.Push("12345");
+  q.Push("67890");
+  q.Push("x");
+  EXPECT_EQ(q.Spilled(), 1u);
+  // An item larger than the budget still fits in an empty memory tier.
+  EXPECT_EQ(q.PopWithGuard().first, "12345");
+  EXPECT_EQ(q.PopWithGuard().first, "67890");
+  EXPECT_EQ(q.PopWithGuard().first, "x");
+  q.Push(std::string(100, 'y'));
+  EXPECT_EQ(q.Spilled(), 0u);
+  EXPECT_EQ(q.PopWithGuard().first.size(), 100u);
+}
+
+TEST(SpillingSafeQueue, JoinCountsSpilledItems) {
+  SpillingSafeQueue<int> q(Small(2));
+  for (int i = 0; i < 10; ++i)
+    q.Push(i);
+  std::thread consumer([&q]() {
+    for (int i = 0; i < 10; ++i) {
+      q.Pop();
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      q.TaskDone();
+    }
+  });
+  q.Join();
+  EXPECT_EQ(q.Size(), 0u);
+  consumer.join();
+}
+
+TEST(SpillingSafeQueue, ConcurrentProducers) {
+  SpillingSafeQueue<int> q(Small(16));
+  std::vector<std::thread> producers;
+  for (int p = 0; p < 4; ++p)
+    producers.emplace_back([&q, p]() {
+      for (int i = 0; i < 1000; ++i)
+        q.Push(p * 1000 + i);
+    });
+  // Each producer's items must come out in the order it pushed them.
+  std::vector<int> last(4, -1);
+  bool ordered = true;
+  for (int i = 0; i < 4000; ++i) {
+    const auto item = q.PopWithGuard().first;
+    ordered = ordered && item % 1000 > last[item / 1000];
+    last[item / 1000] = item % 1000;
+  }
+  for (auto &producer : producers)
+    producer.join();
+  EXPECT_TRUE(ordered);
+  EXPECT_EQ(last, std::vector<int>(4, 999));
+}
@@ -0,0 +1,103 @@
+#include <rwols/SafeQueue.hpp>
+#include <rwols/Sync.hpp>
+
+#include <gmock/gmock.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace rwols;
+using FutexQueue = SafeQueue<int, std::deque<int>, FutexSync>;
+
+TEST(FutexCondition, NotifyWithoutWaitersIsHarmless) {
+  FutexCondition condition;
+  condition.notify_one();
+  condition.notify_all();
+}
+
+TEST(FutexCondition, WaitForTimesOut) {
+  std::mutex mutex;
+  FutexCondition condition;
+  std::unique_lock<std::mutex> lock(mutex);
+  const auto start = std::chrono::steady_clock::now();
+  EXPECT_FALSE(condition.wait_for(lock, std::chrono::milliseconds(20),
+                                  []() { return false; }));
+  EXPECT_GE(std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(20));
+  EXPECT_TRUE(lock.owns_lock());
+}
+
+TEST(FutexCondition, NotifyAllWakesEveryWaiter) {
+  std::mutex mutex;
+  FutexCondition condition;
+  bool go = false;
+  std::atomic<int> woken(0);
+  std::vector<std::thread> waiters;
+  for (int i = 0; i < 4; ++i)
+    waiters.emplace_back([&]() {
+      std::unique_lock<std::mutex> lock(mutex);
+      condition.wait(lock, [&]() { return go; });
+      ++woken;
+    });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    go = true;
+  }
+  condition.notify_all();
+  for (auto &waiter : waiters)
+    waiter.join();
+  EXPECT_EQ(woken, 4);
+}
+
+TEST(FutexSync, PushPop) {
+  FutexQueue q;
+  q.Push(1);
+  q.Push(2);
+  EXPECT_EQ(q.PopWithGuard().first, 1);
+  EXPECT_EQ(q.PopWithGuard().first, 2);
+  EXPECT_THROW(q.Pop(std::chrono::milliseconds(10)), TimeoutError);
+}
+
+TEST(FutexSync, ManyProducersAndConsumers) {
+  FutexQueue q;
+  std::atomic<long> sum(0);
+  std::vector<std::thread> threads;
+  for (int c = 0; c < 4; ++c)
+    threads.emplace_back([&]() {
+      while (true) {
+        auto pair = q.PopWithGuard();
+        if (pair.first < 0)
+          return;
+        sum += pair.first;
+      }
+    });
+  std::vector<std::thread> producers;
+  for (int p = 0; p < 4; ++p)
+    producers.emplace_back([&]() {
+      for (int i = 1; i <= 10000; ++i)
+        q.Push(i);
+    });
+  for (auto &producer : producers)
+    producer.join();
+  q.Join();
+  for (int c = 0; c < 4; ++c)
+    q.Push(-1);
+  for (auto &thread : threads)
+    thread.join();
+  EXPECT_EQ(sum, 4L * 10000 * 10001 / 2);
+}
+
+TEST(FutexSync, PushAndJoinWaitsForConsumer) {
+  FutexQueue q;
+  std::atomic<bool> done(false);
+  std::thread consumer([&]() {
+    auto pair = q.PopWithGuard();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    done = true;
+  });
+  q.PushAndJoin(1);
+  EXPECT_TRUE(done);
+  consumer.join();
+}
@@ -0,0 +1,110 @@
+#include <rwols/Watchdog.hpp>
+
+#include <gmock/gmock.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace rwols;
+using namespace std::chrono;
+
+TEST(Watchdog, ReportsAStalledItemOnce) {
+  SafeQueue<int> q;
+  std::mutex mutex;
+  std::vector<InFlightTask> reports;
+  Watchdog<SafeQueue<int>> watchdog(
+      q, milliseconds(20),
+      [&](const InFlightTask &task) {
+        std::lock_guard<std::mutex> lock(mutex);
+        reports.push_back(task);
+      },
+      milliseconds(5));
+  q.Push(1);
+  auto pair = q.PopWithGuard();
+  std::this_thread::sleep_for(milliseconds(100));
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    ASSERT_EQ(reports.size(), 1u);
+    EXPECT_EQ(reports[0].consumer, std::this_thread::get_id());
+  }
+  const auto stats = watchdog.Stats();
+  EXPECT_GT(stats.checks, 1u);
+  EXPECT_EQ(stats.reported, 1u);
+  EXPECT_EQ(stats.stalled, 1u);
+  EXPECT_GE(stats.oldest, milliseconds(20));
+  { auto done = std::move(pair.second); } // Finishes the item.
+  watchdog.Check();
+  EXPECT_EQ(watchdog.Stats().stalled, 0u);
+  EXPECT_EQ(watchdog.Stats().reported, 1u);
+}
+
+TEST(Watchdog, IgnoresItemsFinishedInTime) {
+  SafeQueue<int> q;
+  std::atomic<int> reports(0);
+  Watchdog<SafeQueue<int>> watchdog(
+      q, milliseconds(200), [&](const InFlightTask &) { ++reports; },
+      milliseconds(5));
+  for (int i = 0; i < 100; ++i) {
+    q.Push(i);
+    auto pair = q.PopWithGuard();
+  }
+  std::this_thread::sleep_for(milliseconds(30));
+  EXPECT_EQ(reports, 0);
+  EXPECT_EQ(watchdog.Stats().stalled, 0u);
+  EXPECT_EQ(q.InFlightCount(), 0u);
+}
+
+TEST(Watchdog, NamesTheStuckConsumer) {
+  SafeQueue<int> q;
+  std::atomic<bool> release(false);
+  std::thread::id stuck;
+  std::thread consumer([&]() {
+    auto pair = q.PopWithGuard();
+    while (!release)
+      std::this_thread::sleep_for(milliseconds(1));
+  });
+  const auto consumerId = consumer.get_id();
+  {
+    Watchdog<SafeQueue<int>> watchdog(
+        q, milliseconds(10),
+        [&](const InFlightTask &task) { stuck = task.consumer; });
+    q.Push(1);
+    std::this_thread::sleep_for(milliseconds(30));
+    watchdog.Check();
+  }
+  EXPECT_EQ(stuck, consumerId);
+  release = true;
+  consumer.join();
+  q.Join();
+}
+
+TEST(Watchdog, ReportsAPlainPop) {
+  SafeQueue<int> q;
+  std::atomic<int> reports(0);
+  Watchdog<SafeQueue<int>> watchdog(
+      q, milliseconds(10), [&](const InFlightTask &) { ++reports; });
+  q.Push(1);
+  q.Pop();
+  std::this_thread::sleep_for(milliseconds(30));
+  watchdog.Check();
+  EXPECT_EQ(reports, 1);
+  q.TaskDone();
+  watchdog.Check();
+  EXPECT_EQ(watchdog.Stats().stalled, 0u);
+}
+
+TEST(Watchdog, CountsUntrackedTasks) {
+  SafeQueue<int> q;
+  q.Push(1);
+  q.Pop(); // Popped before the watchdog started tracking.
+  {
+    Watchdog<SafeQueue<int>> watchdog(
+        q, milliseconds(10), [](const InFlightTask &) {});
+    watchdog.Check();
+    EXPECT_EQ(watchdog.Stats().stalled, 0u);
+    EXPECT_EQ(watchdog.Stats().untracked, 1u);
+  }
+  q.TaskDone();
+}
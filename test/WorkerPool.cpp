@@ -0,0 +1,105 @@
+#include <rwols/WorkerPool.hpp>
+
+#include <gmock/gmock.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+
+using namespace rwols;
+using namespace std::chrono;
+
+namespace {
+
+PoolOptions Options(std::size_t minWorkers, std::size_t maxWorkers) {
+  PoolOptions options;
+  options.minWorkers = minWorkers;
+  options.maxWorkers = maxWorkers;
+  options.spawnDepth = 4;
+  options.spawnWait = milliseconds(1);
+  options.idleTimeout = milliseconds(20);
+  return options;
+}
+
+} // namespace
+
+TEST(WorkerPool, HandlesEveryItem) {
+  std::atomic<int> sum(0);
+  WorkerPool<int> pool([&](int &&i) { sum += i; }, Options(0, 4));
+  for (int i = 1; i <= 1000; ++i)
+    pool.Push(i);
+  pool.Join();
+  EXPECT_EQ(sum, 500500);
+}
+
+TEST(WorkerPool, KeepsMinimumWorkers) {
+  WorkerPool<int> pool([](int &&) {}, Options(2, 4));
+  EXPECT_EQ(pool.Workers(), 2u);
+  std::this_thread::sleep_for(milliseconds(60));
+  EXPECT_EQ(pool.Workers(), 2u);
+}
+
+TEST(WorkerPool, GrowsUnderLoadAndShrinksWhenIdle) {
+  WorkerPool<int> pool(
+      [](int &&) { std::this_thread::sleep_for(milliseconds(2)); },
+      Options(0, 4));
+  for (int i = 0; i < 200; ++i)
+    pool.Push(i);
+  const auto deadline = steady_clock::now() + seconds(5);
+  while (pool.Workers() < 4 && steady_clock::now() < deadline)
+    std::this_thread::sleep_for(milliseconds(1));
+  EXPECT_EQ(pool.Workers(), 4u);
+  pool.Join();
+  EXPECT_EQ(pool.Depth(), 0u);
+  while (pool.Workers() > 0 && steady_clock::now() < deadline)
+    std::this_thread::sleep_for(milliseconds(5));
+  EXPECT_EQ(pool.Workers(), 0u);
+}
+
+TEST(WorkerPool, SpawnsAgainAfterRetiring) {
+  std::atomic<int> handled(0);
+  WorkerPool<int> pool([&](int &&) { ++handled; }, Options(0, 2));
+  pool.Push(1);
+  pool.Join();
+  std::this_thread::sleep_for(milliseconds(60)); // Every worker retires.
+  pool.Push(2);
+  pool.Join();
+  EXPECT_EQ(handled, 2);
+}
+
+TEST(WorkerPool, JoinRethrowsHandlerError) {
+  WorkerPool<int> pool(
+      [](int &&i) {
+        if (i == 3)
+          throw std::runtime_error("bad item");
+      },
+      Options(1, 2));
+  for (int i = 0; i < 10; ++i)
+    pool.Push(i);
+  EXPECT_THROW(pool.Join(), std::runtime_error);
+  pool.Join(); // The error is reported once.
+}
+
+TEST(WorkerPool, ThrowingPushLeavesNoDepth) {
+  struct Item {
+    explicit Item(bool fail) : fail(fail) {}
+    Item(Item &&other) : fail(other.fail) {
+      if (fail)
+        throw std::runtime_error("move failed");
+    }
+    bool fail;
+  };
+  WorkerPool<Item> pool([](Item &&) {}, Options(0, 1));
+  EXPECT_THROW(pool.Push(Item(true)), std::runtime_error);
+  EXPECT_EQ(pool.Depth(), 0u);
+  pool.Push(Item(false));
+  pool.Join();
+  EXPECT_EQ(pool.Depth(), 0u);
+}
+
+TEST(WorkerPool, RejectsBadBounds) {
+  EXPECT_THROW(WorkerPool<int>([](int &&) {}, Options(3, 2)),
+               std::invalid_argument);
+  EXPECT_THROW(WorkerPool<int>([](int &&) {}, Options(0, 0)),
+               std::invalid_argument);
+}